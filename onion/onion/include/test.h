@@ -4,4 +4,7 @@ void graphictest_main();
 void graphictest_display();
 
 
-void worldtest_main();
\ No newline at end of file
+void worldtest_main();
+int visibletiletest_main();
+int chunklighttest_main();
+void chunkloadbenchmark_main();
\ No newline at end of file
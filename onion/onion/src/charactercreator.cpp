@@ -626,6 +626,9 @@ void character_creator_display_func()
 		last_frame = UpdateEvent::frame;
 	}
 
+	// Draw the screen again when the background next scrolls
+	invalidate_display(last_frame + bg_scroll_speed + 1);
+
 	Application* app = get_application_settings();
 	Transform::model.reset();
 	Transform::model.scale(-1.f);
@@ -2,6 +2,7 @@
 #include "../include/charactercreator.h"
 #include "../include/test.h"
 
+#include <cstdlib>
 #include <iostream>
 
 using namespace onion;
@@ -268,11 +269,69 @@ void convert_hune()
 
 
 
-// The entry point for the program.
-int main()
+// Converts chunk text files into the cooked binary format, without opening a window.
+// Usage: --cook-chunks <flat|tilemap|smooth> <tile size> <data file>...
+// Paths are relative to res/data/world/, and each file is cooked to a file with its extension replaced by ".chunk".
+int cookchunks_main(int argc, char** argv)
 {
+	std::string type = argc > 2 ? argv[2] : "";
+	int tile_size = argc > 3 ? atoi(argv[3]) : 0;
+	if (argc < 5 || (type != "flat" && type != "tilemap" && type != "smooth") || tile_size <= 0)
+	{
+		std::cout << "Usage: --cook-chunks <flat|tilemap|smooth> <tile size> <data file>...\n";
+		return 1;
+	}
+	world::Chunk::set_tile_size(tile_size);
+
+	int failures = 0;
+	for (int k = 4; k < argc; ++k)
+	{
+		world::Chunk* chunk;
+		if (type == "smooth")
+			chunk = new world::SmoothChunk(argv[k]);
+		else if (type == "tilemap")
+			chunk = new world::TileMapChunk(argv[k]);
+		else
+			chunk = new world::FlatChunk(argv[k]);
+
+		std::string cooked_path = world::Chunk::get_cooked_path(argv[k]);
+		if (chunk->cook(cooked_path.c_str()))
+		{
+			std::cout << "Cooked " << argv[k] << " to " << cooked_path << ".\n";
+		}
+		else
+		{
+			std::cout << "Failed to cook " << argv[k] << ". See log.txt for details.\n";
+			++failures;
+		}
+
+		delete chunk;
+	}
+
+	return failures == 0 ? 0 : 1;
+}
+
+
+
+// The entry point for the program. Passing a command, such as the name of a test, runs it instead of the game.
+int main(int argc, char** argv)
+{
+	String command = argc > 1 ? argv[1] : "";
+	if (command == "--cook-chunks")
+		return cookchunks_main(argc, argv);
+
 	init("settings.ini");
 
+	if (command == "--chunk-light-test")
+		return chunklighttest_main();
+	if (command == "--visible-tile-test")
+		return visibletiletest_main();
+	if (command == "--chunk-load-benchmark")
+	{
+		chunkloadbenchmark_main();
+		return 0;
+	}
+
 	worldtest_main();
 	//character_creator_setup();
 	return 0;
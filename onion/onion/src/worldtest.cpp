@@ -1,4 +1,9 @@
 #include <onion.h>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
 #include "../include/test.h"
 
 using namespace onion;
@@ -186,10 +191,362 @@ void worldtest_main()
 	//world::World* world = new world::BasicWorld(chunk);
 
 	// Lighting setup
-	Lighting::add_light_array<CubeLight>("cubeLights", "numCubeLights", 8);
+	Lighting::add_light_array<CubeLight>("cubeLights", "cubeLightClusters", "NR_CUBE_LIGHTS");
 	Lighting::set_ambient_light(vec3f(0.04f, 0.13f, 0.27f));
 
 	// Run the main loop
 	set_state(new world::WorldState(world));
 	state_main();
-}
\ No newline at end of file
+}
+
+
+
+// A flat chunk with set dimensions and no data file, exposing which tiles are visible.
+class TestVisibleTileChunk : public world::FlatChunk
+{
+public:
+	TestVisibleTileChunk(const vec2i& dimensions, const vec2i& origin) : world::FlatChunk("", origin)
+	{
+		m_Dimensions = dimensions;
+	}
+
+	bool is_visible(Int i, Int j) const
+	{
+		Int index = get_index(i, j) * 6;
+		for (auto iter = m_VisibleTiles.begin(); iter != m_VisibleTiles.end(); ++iter)
+			if (index >= iter->index && index < iter->index + (iter->count * 6))
+				return true;
+		return false;
+	}
+};
+
+// An axonometric camera that can check exactly whether a point on the plane z = 0 is visible.
+class TestAxonometricCamera : public world::DynamicAxonometricWorldCamera
+{
+public:
+	TestAxonometricCamera(const mat2x3i& frame_bounds, float top_view_angle, float side_view_angle)
+		: world::DynamicAxonometricWorldCamera(frame_bounds, top_view_angle, side_view_angle) {}
+
+	bool contains(Int x, Int y) const
+	{
+		// Solve for the point as the zero position plus a * first radius plus b * second radius, scaled by the determinant
+		Int det = (m_Radii[0].get(0) * m_Radii[1].get(1)) - (m_Radii[0].get(1) * m_Radii[1].get(0));
+		Int dx = x - m_ZeroPosition.get(0);
+		Int dy = y - m_ZeroPosition.get(1);
+		Int a = (dx * m_Radii[1].get(1)) - (dy * m_Radii[1].get(0));
+		Int b = (m_Radii[0].get(0) * dy) - (m_Radii[0].get(1) * dx);
+
+		if (det > 0)
+			return a >= 0 && a <= det && b >= 0 && b <= det;
+		return a <= 0 && a >= det && b <= 0 && b >= det;
+	}
+
+	// The corner of the visible part of the plane z = 0 opposite the second radius from the zero position
+	vec2i get_far_corner() const
+	{
+		return m_ZeroPosition + m_Radii[1];
+	}
+};
+
+/// <summary>Checks whether any corner of a tile is visible according to its GJK distance from the camera, as FlatChunk used to.</summary>
+/// <param name="view">The camera to check the corners against.</param>
+/// <param name="x">The x-coordinate of the tile's first corner.</param>
+/// <param name="y">The y-coordinate of the tile's first corner.</param>
+/// <param name="tile_size">The width and height of the tile.</param>
+/// <param name="outside">Set to true if every corner that GJK reports visible lies outside the view, or false otherwise.</param>
+/// <returns>True if GJK reports any corner visible, false otherwise.</returns>
+static bool is_visible_by_gjk(const TestAxonometricCamera& view, Int x, Int y, Int tile_size, bool& outside)
+{
+	bool visible = false;
+	outside = true;
+
+	for (int k = 3; k >= 0; --k)
+	{
+		Int corner_x = k % 2 == 0 ? x : x + tile_size - 1;
+		Int corner_y = k / 2 == 0 ? y : y + tile_size - 1;
+
+		world::Point corner(vec3i(corner_x, corner_y, 0));
+		if (corner.get_distance(&view) == 0)
+		{
+			visible = true;
+			if (view.contains(corner_x, corner_y))
+				outside = false;
+		}
+	}
+
+	return visible;
+}
+
+int visibletiletest_main()
+{
+	int failures = 0;
+
+	// Division should round towards negative infinity for every combination of signs
+	const Int divisions[][3] = {
+		{ 7, 2, 3 }, { -7, 2, -4 }, { 7, -2, -4 }, { -7, -2, 3 },
+		{ 6, 3, 2 }, { -6, 3, -2 }, { 6, -3, -2 }, { -6, -3, 2 }, { 0, -5, 0 }
+	};
+	for (int k = 8; k >= 0; --k)
+	{
+		if (floor_div(divisions[k][0], divisions[k][1]) != divisions[k][2])
+		{
+			std::cout << "floor_div(" << divisions[k][0] << ", " << divisions[k][1] << ") is not " << divisions[k][2] << ".\n";
+			++failures;
+		}
+	}
+
+	const Int tile_size = 16;
+	world::Chunk::set_tile_size(tile_size);
+
+	mat2x3i frame_bounds;
+	frame_bounds(0, 1) = 320;
+	frame_bounds(1, 1) = 240;
+	frame_bounds(2, 1) = 200;
+
+	// GJK places points beyond the far edge of an unrotated view inside it, so the old per-corner test kept tiles that cannot be seen
+	{
+		TestAxonometricCamera view(frame_bounds, 0.f, 0.f);
+		view.set_position(vec3i(160, 120, 0));
+
+		vec2i p = view.get_far_corner() + vec2i(25, 50);
+		world::Point point(vec3i(p.get(0), p.get(1), 0));
+		if (point.get_distance(&view) == 0)
+			std::cout << "GJK places (" << p.get(0) << ", " << p.get(1) << "), 50 pixels beyond the view, inside it.\n";
+
+		Int min_x, max_x;
+		if (view.contains(p.get(0), p.get(1)) || view.get_ground_span(p.get(1), p.get(1), min_x, max_x))
+		{
+			std::cout << "The row 50 pixels beyond the view is visible.\n";
+			++failures;
+		}
+	}
+
+	const float top_angles[] = { 0.f, 0.5f, 1.f };
+	const float side_angles[] = { 0.f, 0.4f, 1.3f, 2.5f, 3.14159f, -0.8f };
+	const vec2i dimensions(20, 15);
+	int tiles = 0, agreed = 0, gjk_outside = 0, between_corners = 0, unexplained = 0;
+
+	for (int t = 2; t >= 0; --t)
+	{
+		for (int r = 5; r >= 0; --r)
+		{
+			TestAxonometricCamera view(frame_bounds, top_angles[t], side_angles[r]);
+			view.set_position(vec3i(160, 120, 0));
+
+			for (Int x = -600; x <= 600; x += 150)
+			{
+				for (Int y = -600; y <= 600; y += 150)
+				{
+					TestVisibleTileChunk chunk(dimensions, vec2i(x, y));
+					chunk.reset_visible(&view);
+
+					// Compare each tile against the GJK test of its corners, and explain every disagreement
+					for (Int i = dimensions.get(0) - 1; i >= 0; --i)
+					{
+						for (Int j = dimensions.get(1) - 1; j >= 0; --j)
+						{
+							const Int tile_x = x + (tile_size * i);
+							const Int tile_y = y + (tile_size * j);
+
+							bool outside;
+							bool expected = is_visible_by_gjk(view, tile_x, tile_y, tile_size, outside);
+							++tiles;
+
+							if (chunk.is_visible(i, j) == expected)
+							{
+								++agreed;
+							}
+							else if (expected)
+							{
+								// GJK reported a corner visible, which is only wrong if that corner lies outside the view
+								if (outside)
+									++gjk_outside;
+								else
+									++unexplained;
+							}
+							else
+							{
+								// No corner is visible, which is only right if the view does not overlap the tile between its corners either
+								bool overlaps = false;
+								for (Int py = tile_y; py < tile_y + tile_size && !overlaps; ++py)
+									for (Int px = tile_x; px < tile_x + tile_size && !overlaps; ++px)
+										overlaps = view.contains(px, py);
+
+								if (overlaps)
+									++between_corners;
+								else
+									++unexplained;
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	std::cout << "Compared " << tiles << " tiles against the GJK corner test: " << agreed << " agreed.\n";
+	std::cout << gjk_outside << " were hidden although GJK reported a corner outside the view as visible.\n";
+	std::cout << between_corners << " were visible although the view only overlaps them between their corners.\n";
+	std::cout << unexplained << " mismatched without explanation.\n";
+	if (unexplained > 0)
+		++failures;
+
+	std::cout << (failures == 0 ? "Visible tile test passed.\n" : "Visible tile test failed.\n");
+	return failures == 0 ? 0 : 1;
+}
+
+
+
+// The directory that chunk paths are relative to.
+static const char* const g_WorldDirectory = "res/data/world";
+
+/// <summary>Creates a temporary directory for generated chunk files, so that they are never written among the game's data.</summary>
+/// <param name="name">The name of the directory, within the system's temporary directory.</param>
+/// <param name="path">Set to the path of the directory, relative to the directory that chunk paths are relative to.</param>
+/// <returns>The full path of the directory, or an empty path if it could not be created or reached from the world directory.</returns>
+static std::filesystem::path create_temp_chunk_directory(const char* name, std::string& path)
+{
+	std::error_code error;
+	std::filesystem::path directory = std::filesystem::temp_directory_path(error) / name;
+	if (error || (!std::filesystem::create_directories(directory, error) && error))
+	{
+		std::cout << "Could not create a temporary directory for chunks.\n";
+		return std::filesystem::path();
+	}
+
+	// Chunks are opened relative to the world directory, which may be on a different drive
+	path = std::filesystem::relative(directory, g_WorldDirectory, error).generic_string();
+	if (error || path.empty())
+	{
+		std::cout << "Could not reach " << directory.string() << " from " << g_WorldDirectory << ".\n";
+		std::filesystem::remove_all(directory, error);
+		return std::filesystem::path();
+	}
+
+	path += "/";
+	return directory;
+}
+
+
+
+// A flat chunk whose static lights can be inspected once it has been parsed.
+class TestLightChunk : public world::FlatChunk
+{
+public:
+	TestLightChunk(const char* path, const vec2i& origin) : world::FlatChunk(path, origin) {}
+
+	const std::vector<CubeLight*>& parse()
+	{
+		delete __load();
+		unset_tile_image();
+		return m_StaticLights;
+	}
+};
+
+int chunklighttest_main()
+{
+	world::Chunk::set_tile_size(16);
+
+	std::string path;
+	std::filesystem::path directory = create_temp_chunk_directory("onion_chunk_light_test", path);
+	if (directory.empty())
+		return 1;
+	path += "lighttest.txt";
+
+	// A chunk with a single cube light, 70 x 30 pixels in size
+	std::ofstream file(directory / "lighttest.txt");
+	file << "sprites = \"debug.png\"\n\n";
+	file << "begin tile\n";
+	file << "    x           = 0\n";
+	file << "    y           = 0\n";
+	file << "    sprite      = 0\n";
+	file << "end\n\n";
+	file << "begin obj DEBUG light2\n";
+	file << "    pos         = (10, 20, 5)\n";
+	file << "end\n";
+	file.close();
+
+	int failures = 0;
+	const vec2i origins[] = { vec2i(0, 0), vec2i(320, 240), vec2i(-480, 160) };
+	for (int n = 0; n < 3; ++n)
+	{
+		const vec2i& origin = origins[n];
+		TestLightChunk chunk(path.c_str(), origin);
+		const std::vector<CubeLight*>& lights = chunk.parse();
+
+		// The light should be moved by the origin of the chunk, along with its bounds
+		vec3f mins(10.f + origin.get(0), 20.f + origin.get(1), 5.f);
+		vec3f maxs(80.f + origin.get(0), 50.f + origin.get(1), 5.f);
+		if (lights.size() != 1 || lights[0]->mins != mins || lights[0]->maxs != maxs)
+		{
+			std::cout << "Light in chunk at (" << origin.get(0) << ", " << origin.get(1) << ") is not at its world position.\n";
+			++failures;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::remove_all(directory, error);
+
+	std::cout << (failures == 0 ? "Chunk light test passed.\n" : "Chunk light test failed.\n");
+	return failures == 0 ? 0 : 1;
+}
+
+
+
+// Exposes the parsing stage of a chunk, so that it can be timed without a window.
+template <typename T>
+class TestBenchmarkChunk : public T
+{
+public:
+	TestBenchmarkChunk(const char* path) : T(path) {}
+
+	double time_load()
+	{
+		auto start = std::chrono::steady_clock::now();
+		delete this->__load();
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+		this->unset_tile_image();
+		return elapsed.count();
+	}
+};
+
+void chunkloadbenchmark_main()
+{
+	world::Chunk::set_tile_size(16);
+
+	std::string path;
+	std::filesystem::path directory = create_temp_chunk_directory("onion_chunk_load_benchmark", path);
+	if (directory.empty())
+		return;
+	path += "benchmark.txt";
+
+	for (int size = 64; size <= 512; size *= 2)
+	{
+		// Each tile is a full column, so every tile widens the chunk
+		std::ofstream file(directory / "benchmark.txt");
+		file << "sprites = \"debug.png\"\n\n";
+		for (int x = 0; x < size; ++x)
+		{
+			file << "begin tile\n";
+			file << "    x           = " << x << "\n";
+			file << "    y           = 0\n";
+			file << "    dy          = " << size << "\n";
+			file << "    sprite      = " << (x % 4) << "\n";
+			file << "end\n";
+		}
+		file.close();
+
+		TestBenchmarkChunk<world::FlatChunk> flat(path.c_str());
+		TestBenchmarkChunk<world::SmoothChunk> smooth(path.c_str());
+		double flat_time = flat.time_load();
+		double smooth_time = smooth.time_load();
+
+		std::cout << "Loaded " << size << "x" << size << " chunk: "
+			<< flat_time << " ms flat, "
+			<< smooth_time << " ms smooth.\n";
+	}
+
+	std::error_code error;
+	std::filesystem::remove_all(directory, error);
+}
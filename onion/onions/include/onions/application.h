@@ -5,11 +5,37 @@
 
 #define FRAME_RATE 30
 
+// The number of quality tiers that the application can be scaled between.
+#define ONION_QUALITY_TIERS 4
+
+// The number of frames measured after the quality tier changes before it can change again.
+#define ONION_QUALITY_SETTLE_FRAMES (2 * FRAME_RATE)
+
+// The fraction of the frame budget that frames must take less than, on average, before the quality tier is raised.
+#define ONION_QUALITY_HEADROOM 0.6
+
 
 namespace onion
 {
 
 
+	// The settings that change between quality tiers.
+	struct QualityTier
+	{
+		// The fraction of the logical resolution that the application is drawn at, before being scaled up to fit the window. Snapped to one over a whole number if the application is scaled up by whole numbers.
+		float render_scale;
+
+		// The most lights that can reach any cell of the light grid. Negative if there is no limit.
+		int max_cluster_lights;
+
+		// The distance from the camera, in cells, within which streamed chunks are simulated. Negative if every loaded chunk is simulated.
+		int simulation_radius;
+
+		// The number of frames that flickering lights hold each intensity for.
+		int flicker_interval;
+	};
+
+
 	// Contains all settings for the application window.
 	struct Application
 	{
@@ -25,6 +51,41 @@ namespace onion
 		// True if the application window should be fullscreen.
 		bool fullscreen;
 
+		// The width that the application is drawn at before being scaled up by a whole number to fit the window. Zero to draw straight to the window.
+		int render_width;
+
+		// The height that the application is drawn at before being scaled up by a whole number to fit the window. Zero to draw straight to the window.
+		int render_height;
+
+		// The longest that an update should take, including drawing, on average, in milliseconds. Zero to keep the quality tier fixed.
+		int frame_budget;
+
+		// The lowest quality tier that the application can be scaled down to.
+		int min_quality;
+
+		// The highest quality tier that the application can be scaled up to.
+		int max_quality;
+
+		// The current quality tier, from 0 for the lowest quality to ONION_QUALITY_TIERS - 1 for the highest. Changes as frames are measured, if there is a frame budget.
+		int quality;
+
+
+		/// <summary>Checks whether the application is drawn at a lower resolution and scaled up to fit the window.</summary>
+		/// <returns>True if the application has a render size, false if it is drawn straight to the window.</returns>
+		bool is_render_scaled() const;
+
+		/// <summary>Retrieves the width that the application is drawn at.</summary>
+		/// <returns>The render width if the application is scaled up, or the width of the window otherwise.</returns>
+		int get_logical_width() const;
+
+		/// <summary>Retrieves the height that the application is drawn at.</summary>
+		/// <returns>The render height if the application is scaled up, or the height of the window otherwise.</returns>
+		int get_logical_height() const;
+
+		/// <summary>Retrieves the settings of the current quality tier.</summary>
+		/// <returns>The settings of the quality tier.</returns>
+		const QualityTier& get_quality_tier() const;
+
 
 		/// <summary>Initializes the Application object.</summary>
 		Application();
@@ -58,6 +58,13 @@ namespace onion
 		static int frames_per_second;
 	};
 
+	/// <summary>Marks the screen as changed, so that it is drawn again on the next frame. Frames where nothing has changed are not drawn.</summary>
+	void invalidate_display();
+
+	/// <summary>Marks the screen as changing on a later frame, such as the next frame of an animation, so that it is drawn again once that frame is reached.</summary>
+	/// <param name="frame">The frame that the screen changes on.</param>
+	void invalidate_display(int frame);
+
 	class UpdateListener : public EventListener<>
 	{
 	private:
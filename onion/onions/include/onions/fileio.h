@@ -146,11 +146,20 @@ namespace onion
 	public:
 		/// <summary>Opens the file.</summary>
 		/// <param name="path">The path to the file.</summary>
-		SaveFile(std::string path);
+		/// <param name="binary">True if the file should be opened in binary mode, so that bytes are written exactly as given.</param>
+		SaveFile(std::string path, bool binary = false);
 
 		/// <summary>Closes down the file.</summary>
 		~SaveFile();
 
+		/// <summary>Returns whether the file is still good for saving or not.</summary>
+		/// <returns>True if the file is good, false otherwise.</returns>
+		bool good();
+
+		/// <summary>Pads a binary file with zeroes up to the next multiple of an alignment.</summary>
+		/// <param name="alignment">The alignment, in bytes.</param>
+		void align(std::size_t alignment);
+
 
 		/// <summary>Saves an integer to a binary file.</summary>
 		/// <param name="value">An integer to save.</returns>
@@ -160,6 +169,20 @@ namespace onion
 		/// <returns>A string to save.</returns>
 		void save_string_binary(std::string value);
 
+		/// <summary>Saves a 32-bit integer to a binary file.</summary>
+		/// <param name="value">An integer to save.</param>
+		void save_int32_binary(int32_t value);
+
+		/// <summary>Saves raw bytes to a binary file.</summary>
+		/// <param name="bytes">A pointer to the start of the bytes.</param>
+		/// <param name="size">The number of bytes to save.</param>
+		void save_bytes_binary(const char* bytes, std::size_t size);
+
+		/// <summary>Saves an ID and its key-string pairs to a binary file.</summary>
+		/// <param name="id">The ID to save.</param>
+		/// <param name="data">The key-string pairs to save.</param>
+		void save_data_binary(String id, const StringData& data);
+
 
 		void save_data(String id, const StringData& data);
 	};
@@ -207,6 +230,62 @@ namespace onion
 		String load_data(StringData& data);
 	};
 
+	// A file mapped directly into memory, read from front to back.
+	class MappedFile
+	{
+	private:
+		// The start of the mapped memory. NULL if the file could not be mapped.
+		char* m_Data = nullptr;
+
+		// The size of the file, in bytes.
+		std::size_t m_Size = 0;
+
+		// The offset of the next byte to read.
+		std::size_t m_Position = 0;
+
+		// Platform-specific handles keeping the mapping open.
+		void* m_Handles[2] = { nullptr, nullptr };
+
+	public:
+		/// <summary>Maps the file into memory. The memory is copy-on-write, so it can be modified without changing the file.</summary>
+		/// <param name="path">The path to the file.</param>
+		MappedFile(std::string path);
+
+		/// <summary>Unmaps the file.</summary>
+		~MappedFile();
+
+		/// <summary>Returns whether the file is still good for loading or not.</summary>
+		/// <returns>True if the file was mapped and no read has run past the end of it, false otherwise.</returns>
+		bool good() const;
+
+
+		/// <summary>Skips ahead to the next multiple of an alignment.</summary>
+		/// <param name="alignment">The alignment, in bytes.</param>
+		void align(std::size_t alignment);
+
+		/// <summary>Loads a 16-bit integer, as saved by SaveFile::save_int_binary().</summary>
+		/// <returns>An integer from the file.</returns>
+		int16_t load_int_binary();
+
+		/// <summary>Loads a 32-bit integer, as saved by SaveFile::save_int32_binary().</summary>
+		/// <returns>An integer from the file.</returns>
+		int32_t load_int32_binary();
+
+		/// <summary>Loads a string, as saved by SaveFile::save_string_binary().</summary>
+		/// <returns>A string from the file.</returns>
+		std::string load_string_binary();
+
+		/// <summary>Retrieves raw bytes from the file without copying them.</summary>
+		/// <param name="size">The number of bytes to retrieve.</param>
+		/// <returns>A pointer to the bytes in the mapped memory, or NULL if the file does not have that many bytes left.</returns>
+		char* load_bytes_binary(std::size_t size);
+
+		/// <summary>Loads an ID and its key-string pairs, as saved by SaveFile::save_data_binary().</summary>
+		/// <param name="data">A reference to where the key-string pairs will be stored.</param>
+		/// <returns>The ID.</returns>
+		String load_data_binary(StringData& data);
+	};
+
 
 
 }
\ No newline at end of file
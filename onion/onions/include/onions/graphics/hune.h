@@ -161,6 +161,10 @@ namespace onion
 		/// <summary>Retrieves the current frame of animation.</summary>
 		/// <returns>The current frame of animation.</returns>
 		virtual int get_frame() const = 0;
+
+		/// <summary>Retrieves the update frame on which the frame of animation next changes.</summary>
+		/// <returns>The update frame that the animation next changes on, or INT_MAX if it never changes.</returns>
+		virtual int get_next_change() const = 0;
 	};
 
 	HuneAnimation* generate_hune_standing_animation();
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <vector>
 #include <unordered_map>
 #include "../error.h"
@@ -335,7 +336,8 @@ namespace onion
 
 			/// <summary>Loads shaders from vertex and fragment shader files.</summary>
 			/// <param name="path">The path to the vertex and fragment shader files, from the res/data/shaders/ folder, omitting file extensions.</param>
-			_Shader(const char* path, const std::vector<String>& uniform_names);
+			/// <param name="defines">Lines of preprocessor definitions, inserted after the #version directive of each shader.</param>
+			_Shader(const char* path, const std::vector<String>& uniform_names, const std::string& defines = "");
 			
 			/// <summary>Constructs a shader from raw text.</summary>
 			/// <param name="vertex_shader_text">The vertex shader, in raw text form.</param>
@@ -468,6 +470,12 @@ namespace onion
 			// The ID of the VAO containing buffer information.
 			_ID* m_VAO;
 
+			/// <summary>Generates the buffer and VAO, and uploads the data.</summary>
+			/// <param name="bytes">A pointer to the start of the compiled data.</param>
+			/// <param name="size">The size of the data, in bytes.</param>
+			/// <param name="attribs">The vertex attributes of the shader that will use the buffer.</param>
+			void __create(const char* bytes, std::size_t size, const VertexAttribs& attribs);
+
 		protected:
 			/// <summary>Activates anything else that needs to be activated.</summary>
 			virtual void __activate() const;
@@ -477,6 +485,12 @@ namespace onion
 			/// <param name="data">The data to use in the buffer.</param>
 			_VertexBuffer(const _VertexBufferData* data, const VertexAttribs& attribs);
 
+			/// <summary>Constructs a buffer from data that has already been compiled.</summary>
+			/// <param name="bytes">A pointer to the start of the compiled data, laid out as _VertexBufferData::compile() would.</param>
+			/// <param name="size">The size of the data, in bytes.</param>
+			/// <param name="attribs">The vertex attributes of the shader that will use the buffer.</param>
+			_VertexBuffer(const char* bytes, std::size_t size, const VertexAttribs& attribs);
+
 			/// <summary>Frees the buffer from memory.</summary>
 			virtual ~_VertexBuffer();
 
@@ -486,6 +500,12 @@ namespace onion
 
 			/// <summary>Activates the buffer.</summary>
 			void activate() const;
+
+			/// <summary>Overwrites part of the buffer, without reallocating it.</summary>
+			/// <param name="offset">The offset to start overwriting at, in bytes.</param>
+			/// <param name="bytes">A pointer to the start of the compiled data, laid out as _VertexBufferData::compile() would.</param>
+			/// <param name="size">The size of the data, in bytes.</param>
+			void update(std::size_t offset, const char* bytes, std::size_t size);
 		};
 
 
@@ -508,6 +528,9 @@ namespace onion
 			// The height of the image.
 			int m_Height;
 
+			// Pixels that have been decoded but not uploaded yet. NULL otherwise.
+			unsigned char* m_Pixels = nullptr;
+
 			/// <summary>Frees the buffer from memory.</summary>
 			void free();
 
@@ -533,6 +556,16 @@ namespace onion
 			/// <returns>True if the image was loaded successfully, false otherwise.</returns>
 			bool load(const char* path, bool pixel_perfect = true);
 
+			/// <summary>Reads the pixels of an image from file, without touching OpenGL. Safe to call from any thread. The image must be uploaded before it is used.</summary>
+			/// <param name="path">The file path to the image, starting from the res/img/ folder.</param>
+			/// <returns>True if the image was decoded successfully, false otherwise.</returns>
+			bool decode(const char* path);
+
+			/// <summary>Uploads decoded pixels to a texture. Must be called from the thread that owns the OpenGL context.</summary>
+			/// <param name="pixel_perfect">True if the image should be pixel perfect, false if it can blend.</param>
+			/// <returns>True if there were decoded pixels to upload, false otherwise.</returns>
+			bool upload(bool pixel_perfect = true);
+
 			/// <summary>Retrieves the width of the image.</summary>
 			/// <returns>The width of the image, in pixels.</returns>
 			int get_width() const;
@@ -541,6 +574,16 @@ namespace onion
 			/// <returns>The height of the image, in pixels.</returns>
 			int get_height() const;
 
+			/// <summary>Checks the transparency of the decoded pixels in a rectangle of the image. Only possible after the image is decoded and before it is uploaded.</summary>
+			/// <param name="left">The left edge of the rectangle, in pixels.</param>
+			/// <param name="top">The top edge of the rectangle, in pixels.</param>
+			/// <param name="width">The width of the rectangle, in pixels.</param>
+			/// <param name="height">The height of the rectangle, in pixels.</param>
+			/// <param name="transparent">Set to true if any pixel in the rectangle is fully transparent, false otherwise.</param>
+			/// <param name="translucent">Set to true if any pixel in the rectangle is partially transparent, false otherwise.</param>
+			/// <returns>True if the pixels were checked, false if there are no decoded pixels to check.</returns>
+			bool get_transparency(int left, int top, int width, int height, bool& transparent, bool& translucent) const;
+
 			/// <summary>Checks whether this buffer is the active one.</summary>
 			/// <returns>True if this buffer is active, false otherwise.</returns>
 			bool is_active() const;
@@ -550,6 +593,195 @@ namespace onion
 		};
 
 
+		// Handles an integer texture with a pair of 16-bit integers per texel, which shaders read with texelFetch().
+		class _IntegerTexture
+		{
+		private:
+			// The ID of this texture.
+			_ID* m_Texture;
+
+			// The width of the texture.
+			int m_Width;
+
+			// The height of the texture.
+			int m_Height;
+
+		public:
+			/// <summary>Uploads pairs of integers to a texture. Must be called from the thread that owns the OpenGL context.</summary>
+			/// <param name="data">Two integers for each texel, row by row starting from the bottom.</param>
+			/// <param name="width">The number of texels in each row.</param>
+			/// <param name="height">The number of rows.</param>
+			_IntegerTexture(const std::int16_t* data, int width, int height);
+
+			/// <summary>Frees the texture from memory.</summary>
+			~_IntegerTexture();
+
+			/// <summary>Retrieves the width of the texture.</summary>
+			/// <returns>The number of texels in each row.</returns>
+			int get_width() const;
+
+			/// <summary>Retrieves the height of the texture.</summary>
+			/// <returns>The number of rows.</returns>
+			int get_height() const;
+
+			/// <summary>Binds the texture to the n-th texture slot.</summary>
+			void activate(int slot = 0) const;
+
+			/// <summary>Overwrites a rectangle of texels. Must be called from the thread that owns the OpenGL context.</summary>
+			/// <param name="x">The x-coordinate of the bottom-left texel to overwrite.</param>
+			/// <param name="y">The y-coordinate of the bottom-left texel to overwrite.</param>
+			/// <param name="width">The number of texels in each row of the rectangle.</param>
+			/// <param name="height">The number of rows in the rectangle.</param>
+			/// <param name="data">Two integers for each texel, row by row starting from the bottom.</param>
+			void update(int x, int y, int width, int height, const std::int16_t* data);
+		};
+
+
+		// Handles a texture with three floats per texel, which shaders sample with linear filtering between texels.
+		class _FloatTexture
+		{
+		private:
+			// The ID of this texture.
+			_ID* m_Texture;
+
+		public:
+			/// <summary>Uploads colors to a texture. Must be called from the thread that owns the OpenGL context.</summary>
+			/// <param name="data">Three floats for each texel, row by row starting from the bottom.</param>
+			/// <param name="width">The number of texels in each row.</param>
+			/// <param name="height">The number of rows.</param>
+			_FloatTexture(const float* data, int width, int height);
+
+			/// <summary>Frees the texture from memory.</summary>
+			~_FloatTexture();
+
+			/// <summary>Binds the texture to the n-th texture slot.</summary>
+			void activate(int slot = 0) const;
+		};
+
+
+		// Handles a framebuffer with several color targets and a depth buffer, the size of the viewport. A later pass reads each target with texelFetch().
+		class _FrameBuffer
+		{
+		private:
+			// The internal format of each color target.
+			std::vector<Uint> m_Formats;
+
+			// The ID of the framebuffer, or NULL if it has not been created at the current size yet.
+			_ID* m_Framebuffer = nullptr;
+
+			// The ID of each color target.
+			std::vector<_ID*> m_Targets;
+
+			// The ID of the depth buffer.
+			_ID* m_Depth = nullptr;
+
+			// The ID of an empty vertex array, bound when drawing a full-screen pass.
+			_ID* m_VAO = nullptr;
+
+			// The width of every target, in pixels.
+			int m_Width = 0;
+
+			// The height of every target, in pixels.
+			int m_Height = 0;
+
+			// The ID of the framebuffer that was bound when this one was bound. Zero for the default framebuffer.
+			Uint m_Previous = 0;
+
+			/// <summary>Frees the framebuffer and all of its targets.</summary>
+			void __destroy();
+
+		public:
+			/// <summary>Constructs a framebuffer. The targets are created the first time it is bound.</summary>
+			/// <param name="formats">The internal format of each color target, as a GLenum value.</param>
+			_FrameBuffer(const std::vector<Uint>& formats);
+
+			/// <summary>Frees the framebuffer and all of its targets.</summary>
+			~_FrameBuffer();
+
+			/// <summary>Binds the framebuffer to be drawn into and clears it, resizing every target to the viewport first if needed.</summary>
+			/// <param name="clear">The value to clear every color target to.</param>
+			void bind(const vec4f& clear);
+
+			/// <summary>Binds the framebuffer that was bound before this one again, and copies the depth buffer into it so that later passes are hidden behind what was drawn.</summary>
+			void unbind() const;
+
+			/// <summary>Binds the framebuffer that was bound before this one again, and copies the first color target into a rectangle of it, scaled without filtering.</summary>
+			/// <param name="x">The left edge of the rectangle, in pixels.</param>
+			/// <param name="y">The bottom edge of the rectangle, in pixels.</param>
+			/// <param name="width">The width of the rectangle, in pixels.</param>
+			/// <param name="height">The height of the rectangle, in pixels.</param>
+			void blit(int x, int y, int width, int height) const;
+
+			/// <summary>Binds a color target to the n-th texture slot.</summary>
+			/// <param name="target">The index of the color target.</param>
+			/// <param name="slot">The texture slot.</param>
+			void activate(int target, int slot) const;
+
+			/// <summary>Draws a single triangle that covers the whole viewport. The vertex shader should place the corners from gl_VertexID.</summary>
+			void display();
+		};
+
+
+		// Handles a buffer texture that shaders read with texelFetch(). Each buffer is bound to its own texture slot, counting down from the last slot, and shaders are linked to it by the name of their sampler.
+		class _TextureBuffer
+		{
+		private:
+			friend class _Shader; // Allows the shader to link its samplers to the texture buffers
+
+			// All texture buffers.
+			static std::unordered_map<std::string, _TextureBuffer*> m_Buffers;
+
+			// The texture slot that the next texture buffer will be bound to.
+			static int m_NextAvailableSlot;
+
+			// The name of the buffer.
+			std::string m_Name;
+
+			// The ID of the buffer storing the data.
+			_ID* m_Buffer;
+
+			// The ID of the texture that reads from the buffer.
+			_ID* m_Texture;
+
+			// The texture slot that the buffer is bound to.
+			int m_Slot;
+
+			/// <summary>Uploads data to the buffer and binds it to its texture slot.</summary>
+			/// <param name="data">The data to upload.</param>
+			/// <param name="bytes">The size of the data, in bytes.</param>
+			/// <param name="integer">True if each texel is a single integer, false if each texel is four floats.</param>
+			void __update(const void* data, std::size_t bytes, bool integer);
+
+		public:
+			/// <summary>Retrieves the texture buffer with the given name, constructing it if it does not exist yet.</summary>
+			/// <param name="name">The name of the texture buffer, as its sampler is referred to in the shaders.</param>
+			/// <returns>The texture buffer with that name.</returns>
+			static _TextureBuffer* get_buffer(std::string name);
+
+
+			/// <summary>Constructs an empty texture buffer handler.</summary>
+			/// <param name="name">The name of the texture buffer, as its sampler is referred to in the shaders.</param>
+			_TextureBuffer(std::string name);
+
+			/// <summary>Frees the buffer and texture from memory.</summary>
+			~_TextureBuffer();
+
+			/// <summary>Retrieves the texture slot that the buffer is bound to.</summary>
+			/// <returns>The index of the texture slot.</returns>
+			int get_slot() const;
+
+			/// <summary>Replaces the contents of the buffer with texels of four floats. Must be called from the thread that owns the OpenGL context.</summary>
+			/// <param name="data">Four floats for each texel.</param>
+			/// <param name="texels">The number of texels.</param>
+			void update(const float* data, std::size_t texels);
+
+			/// <summary>Replaces the contents of the buffer with texels of one integer. Must be called from the thread that owns the OpenGL context.</summary>
+			/// <param name="data">One integer for each texel.</param>
+			/// <param name="texels">The number of texels.</param>
+			void update(const std::int32_t* data, std::size_t texels);
+		};
+
+
 
 		// Handles all calls to display something using information from a buffer.
 		class _VertexBufferDisplayer
@@ -565,6 +797,16 @@ namespace onion
 			/// <param name="count">The number of sequential shapes to display.</param>
 			virtual void display(BUFFER_KEY start, int count = 1) const = 0;
 
+			/// <summary>Displays several ranges of shapes using the currently bound shader and information from the buffer.</summary>
+			/// <param name="starts">The index of the starting vertex of each range.</param>
+			/// <param name="counts">The number of sequential shapes to display in each range.</param>
+			/// <param name="num">The number of ranges.</param>
+			virtual void display(const BUFFER_KEY* starts, const Int* counts, Int num) const;
+
+			/// <summary>Retrieves the buffer being used.</summary>
+			/// <returns>A pointer to the buffer, or NULL if none has been set.</returns>
+			_VertexBuffer* get_buffer() const;
+
 			/// <summary>Sets the buffer to use.</summary>
 			/// <param name="buffer">The new buffer to use.</param>
 			void set_buffer(_VertexBuffer* buffer);
@@ -579,6 +821,12 @@ namespace onion
 			/// This should be equal to the index of the starting vertex in the buffer array.</param>
 			/// <param name="count">The number of sequential shapes to display.</param>
 			virtual void display(BUFFER_KEY start, Int count = 1) const;
+
+			/// <summary>Displays several ranges of squares in a single draw call.</summary>
+			/// <param name="starts">The index of the starting vertex of each range.</param>
+			/// <param name="counts">The number of sequential squares to display in each range.</param>
+			/// <param name="num">The number of ranges.</param>
+			virtual void display(const BUFFER_KEY* starts, const Int* counts, Int num) const;
 		};
 
 	}
@@ -770,7 +1018,11 @@ namespace onion
 		template <typename _FirstUniform, typename... _OtherUniforms>
 		void set_uniforms(std::vector<opengl::_UniformAttribute*>::const_iterator iter, const _FirstUniform& first, const _OtherUniforms&... others)
 		{
-			if (opengl::_UniformTypedAttribute<_FirstUniform>* u = dynamic_cast<opengl::_UniformTypedAttribute<_FirstUniform>*>(*iter))
+			if (!*iter)
+			{
+				// The uniform is not used by this variant of the shader, so the compiler removed it
+			}
+			else if (opengl::_UniformTypedAttribute<_FirstUniform>* u = dynamic_cast<opengl::_UniformTypedAttribute<_FirstUniform>*>(*iter))
 			{
 				u->set(first);
 			}
@@ -785,7 +1037,8 @@ namespace onion
 	public:
 		/// <summary>Loads shaders from a file.</summary>
 		/// <param name="path">The path to the vertex and fragment shader files, from the res/shaders/ folder, omitting file extensions.</param>
-		Shader(const char* path, const std::vector<String>& uniform_names) : opengl::_Shader(path, uniform_names)
+		/// <param name="defines">Lines of preprocessor definitions, inserted after the #version directive of each shader.</param>
+		Shader(const char* path, const std::vector<String>& uniform_names, const std::string& defines = "") : opengl::_Shader(path, uniform_names, defines)
 		{
 			if (sizeof...(_Uniforms) != m_UniformAttributes.size())
 			{
@@ -824,5 +1077,66 @@ namespace onion
 	};
 
 
+	// A cache of variants of one shader program, each compiled with a different set of preprocessor definitions.
+	template <typename... _Uniforms>
+	class ShaderPermutations
+	{
+	private:
+		// The path to the shader files, from the res/shaders/ folder, omitting file extensions.
+		std::string m_Path;
+
+		// The names of the uniforms passed to each variant.
+		std::vector<String> m_UniformNames;
+
+		// The variant compiled without any preprocessor definitions.
+		Shader<_Uniforms...>* m_Default;
+
+		// Each variant that has been requested, indexed by key. Variants that have not been compiled yet are null.
+		std::vector<Shader<_Uniforms...>*> m_Variants;
+
+	public:
+		/// <summary>Constructs the cache, compiling only the variant without any preprocessor definitions.</summary>
+		/// <param name="path">The path to the vertex and fragment shader files, from the res/shaders/ folder, omitting file extensions.</param>
+		/// <param name="uniform_names">The names of the uniforms passed to each variant.</param>
+		ShaderPermutations(const char* path, const std::vector<String>& uniform_names) :
+			m_Path(path),
+			m_UniformNames(uniform_names),
+			m_Default(new Shader<_Uniforms...>(path, uniform_names)) {}
+
+		/// <summary>Deletes every compiled variant.</summary>
+		~ShaderPermutations()
+		{
+			delete m_Default;
+			for (auto iter = m_Variants.begin(); iter != m_Variants.end(); ++iter)
+				delete *iter;
+		}
+
+		/// <summary>Retrieves the variant without any preprocessor definitions. Every variant has the same vertex attributes as it.</summary>
+		/// <returns>The default variant of the shader.</returns>
+		Shader<_Uniforms...>* get_default() const
+		{
+			return m_Default;
+		}
+
+		/// <summary>Retrieves a variant of the shader, compiling it the first time it is requested.</summary>
+		/// <param name="key">A unique, non-negative index identifying the variant.</param>
+		/// <param name="defines">Lines of preprocessor definitions for the variant. Only used when the variant is compiled. If empty, the default variant is returned.</param>
+		/// <returns>The variant of the shader.</returns>
+		Shader<_Uniforms...>* get(Int key, const std::string& defines)
+		{
+			if (defines.empty() || key < 0)
+				return m_Default;
+
+			if (key >= (Int)m_Variants.size())
+				m_Variants.resize(key + 1, nullptr);
+
+			Shader<_Uniforms...>*& variant = m_Variants[key];
+			if (!variant)
+				variant = new Shader<_Uniforms...>(m_Path.c_str(), m_UniformNames, defines);
+			return variant;
+		}
+	};
+
+
 
 }
\ No newline at end of file
@@ -100,6 +100,19 @@ namespace onion
 #define SPRITE_ID std::string
 #define SPRITE_KEY BUFFER_KEY
 
+	// How the pixels of a sprite or texture cover whatever is behind them.
+	enum SpriteAlpha
+	{
+		// Every pixel is fully opaque.
+		SPRITE_OPAQUE,
+
+		// Every pixel is either fully opaque or fully transparent, so the sprite can be displayed without blending by discarding the transparent pixels.
+		SPRITE_ALPHA_TESTED,
+
+		// Some pixels are partially transparent, so the sprite must be blended with whatever is behind it.
+		SPRITE_TRANSLUCENT
+	};
+
 	// An individual sprite on a sprite sheet.
 	struct Sprite
 	{
@@ -113,11 +126,15 @@ namespace onion
 		// The height of the sprite
 		const int height;
 
+		// How the pixels of the sprite cover whatever is behind them.
+		const SpriteAlpha alpha;
+
 		/// <summary>Constructs sprite information.</summary>
 		/// <param name="key">The key of the sprite.</param>
 		/// <param name="width">The width of the sprite.</param>
 		/// <param name="height">The height of the sprite.</param>
-		Sprite(SPRITE_KEY key, int width, int height);
+		/// <param name="alpha">How the pixels of the sprite cover whatever is behind them.</param>
+		Sprite(SPRITE_KEY key, int width, int height, SpriteAlpha alpha = SPRITE_TRANSLUCENT);
 	};
 
 	typedef _Manager<SPRITE_ID, Sprite> _SpriteManager;
@@ -136,11 +153,15 @@ namespace onion
 		// The height of the texture.
 		const int height;
 
+		// How the pixels of the texture cover whatever is behind them.
+		const SpriteAlpha alpha;
+
 		/// <summary>Constructs texture information.</summary>
 		/// <param name="tex">The matrix associated with the texture.</param>
 		/// <param name="width">The width of the texture, in pixels.</param>
 		/// <param name="height">The height of the texture, in pixels.</param>
-		Texture(const TEXTURE_MATRIX& tex, int width, int height);
+		/// <param name="alpha">How the pixels of the texture cover whatever is behind them.</param>
+		Texture(const TEXTURE_MATRIX& tex, int width, int height, SpriteAlpha alpha = SPRITE_TRANSLUCENT);
 
 		/// <summary>Automatically constructs a texture matrix, that maps RED to the left edge of the texture, GREEN to the right edge of the texture, and BLUE to the bottom edge of the texture.
 		/// (It is constructed this way specifically to make it easier to reflect the sprite horizontally.)</summary>
@@ -150,7 +171,8 @@ namespace onion
 		/// <param name="height">The height of the texture, in pixels.</param>
 		/// <param name="image_width">The width of the image that the texture is on, in pixels.</param>
 		/// <param name="image_height">The height of the image that the texture is on, in pixels.</param>
-		Texture(int left, int top, int width, int height, float image_width, float image_height);
+		/// <param name="alpha">How the pixels of the texture cover whatever is behind them.</param>
+		Texture(int left, int top, int width, int height, float image_width, float image_height, SpriteAlpha alpha = SPRITE_TRANSLUCENT);
 	};
 
 	typedef _Manager<TEXTURE_ID, Texture> _TextureManager;
@@ -362,11 +384,20 @@ namespace onion
 		_SpriteManager m_SpriteManager;
 
 
-		/// <summary>Loads a image from an image file.</summary>
+		/// <summary>Decodes an image from an image file. The image is uploaded once the sprites on it have been loaded.</summary>
 		/// <param name="path">The path to the image file, from the res/img/ folder.</param>
-		/// <returns>The loaded image.</returns>
+		/// <returns>The decoded image.</returns>
 		virtual opengl::_Image* load_image(const char* path) = 0;
 
+		/// <summary>Checks how the pixels in a rectangle of a decoded image cover whatever is behind them.</summary>
+		/// <param name="image">The decoded image.</param>
+		/// <param name="left">The left edge of the rectangle, in pixels.</param>
+		/// <param name="top">The top edge of the rectangle, in pixels.</param>
+		/// <param name="width">The width of the rectangle, in pixels.</param>
+		/// <param name="height">The height of the rectangle, in pixels.</param>
+		/// <returns>How the pixels in the rectangle cover whatever is behind them. SPRITE_TRANSLUCENT if the pixels cannot be checked.</returns>
+		static SpriteAlpha __get_alpha(const opengl::_Image* image, int left, int top, int width, int height);
+
 		/// <summary>Loads vertex attribute data from a meta file.</summary>
 		/// <param name="file">The meta file containing vertex attribute data.</param>
 		/// <param name="image">The loaded image.</param>
@@ -417,6 +448,13 @@ namespace onion
 		// The object used to display the sprites.
 		opengl::_VertexBufferDisplayer* m_Displayer = nullptr;
 
+		/// <summary>Retrieves the shader to display sprites with. Sprite sheets that pick between variants of their shader at draw time override this.</summary>
+		/// <returns>The shader to activate when displaying a sprite.</returns>
+		virtual _SpriteShader* __get_display_shader() const
+		{
+			return m_Shader;
+		}
+
 	public:
 		/// <summary>Destroys the displayer object (but not the shader, because shaders may be shared between different sprite sheets).</summary>
 		virtual ~SpriteSheet()
@@ -447,6 +485,9 @@ namespace onion
 			LoadFile file(fpath);
 			opengl::_VertexBufferData* data = __load(file, image);
 
+			// Upload the image, now that the sprites have been read from its pixels
+			image->upload();
+
 			// Generate an image buffer
 			if (!m_Displayer)
 				m_Displayer = new opengl::_SquareBufferDisplayer();
@@ -467,7 +508,7 @@ namespace onion
 		void display(SPRITE_KEY key, const _Args&... args) const
 		{
 			// Activate the shader
-			m_Shader->activate(Transform::model.get(), args...);
+			__get_display_shader()->activate(Transform::model.get(), args...);
 
 			// Display the sprite
 			m_Displayer->display(key);
@@ -479,7 +520,7 @@ namespace onion
 		void display(const Sprite* sprite, const _Args&... args) const
 		{
 			// Activate the shader
-			m_Shader->activate(Transform::model.get(), args...);
+			__get_display_shader()->activate(Transform::model.get(), args...);
 
 			// Display the sprite
 			m_Displayer->display(sprite->key);
@@ -490,13 +531,16 @@ namespace onion
 	class PixelSpriteSheet : public SpriteSheet<_Args...>
 	{
 	protected:
-		/// <summary>Generates a pixel-perfect image.</summary>
+		/// <summary>Decodes a pixel-perfect image.</summary>
 		/// <param name="path">The path to the image file, from the res/img/ folder.</param>
-		/// <returns>The loaded image.</returns>
+		/// <returns>The decoded image.</returns>
 		opengl::_Image* load_image(const char* path)
 		{
 			set_sprite_sheet(path, this);
-			return new opengl::_Image(path, true);
+
+			opengl::_Image* image = new opengl::_Image();
+			image->decode(path);
+			return image;
 		}
 	};
 
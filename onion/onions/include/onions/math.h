@@ -124,6 +124,13 @@ namespace onion
 
 
 
+	/// <summary>Divides two integers, rounding towards negative infinity.</summary>
+	/// <param name="n">The numerator.</param>
+	/// <param name="d">The denominator, which may be negative but not zero.</param>
+	/// <returns>The floor of n / d.</returns>
+	Int floor_div(Int n, Int d);
+
+
 	/// <summary>Implements the binary GCD algorithm to find the greatest common divisor of two nonnegative integers.</summary>
 	/// <param name="a">The first integer. Should be nonnegative.</param>
 	/// <param name="b">The second integer. Should be nonnegative.</param>
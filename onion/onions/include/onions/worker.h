@@ -0,0 +1,63 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "math.h"
+
+namespace onion
+{
+
+	// A fixed set of worker threads that run queued tasks in the background.
+	class WorkerPool
+	{
+	private:
+		// The threads running tasks.
+		std::vector<std::thread> m_Threads;
+
+		// Tasks waiting for a thread, in the order they were queued.
+		std::deque<std::function<void()>> m_Tasks;
+
+		// Guards the task queue.
+		std::mutex m_Mutex;
+
+		// Signalled when a task is queued, or the pool is stopping.
+		std::condition_variable m_TaskQueued;
+
+		// True once the pool has started shutting down.
+		bool m_Stopping = false;
+
+		/// <summary>Runs queued tasks until the pool is stopped.</summary>
+		void __run();
+
+	public:
+		/// <summary>Starts the worker threads.</summary>
+		/// <param name="num_threads">The number of threads to start. If 0, one fewer than the number of hardware threads is used.</param>
+		WorkerPool(Uint num_threads = 0);
+
+		/// <summary>Finishes all queued tasks, then joins the worker threads.</summary>
+		~WorkerPool();
+
+		/// <summary>Retrieves the pool shared by the whole application.</summary>
+		/// <returns>A reference to the shared pool, which is started the first time it is retrieved.</returns>
+		static WorkerPool& get_shared();
+
+
+		/// <summary>Retrieves the number of worker threads.</summary>
+		/// <returns>The number of threads in the pool.</returns>
+		Uint get_num_threads() const;
+
+		/// <summary>Queues a task to be run on a worker thread.</summary>
+		/// <param name="task">The task to run.</param>
+		void push(std::function<void()> task);
+
+		/// <summary>Calls a function for every index in a range, splitting the range across the worker threads and the calling thread. Returns once every call has finished.</summary>
+		/// <param name="count">The number of indices, starting from 0.</param>
+		/// <param name="batch_size">The number of consecutive indices handed out at once. Ranges no larger than this run entirely on the calling thread.</param>
+		/// <param name="func">The function to call with each index. Must be safe to call from several threads at once.</param>
+		void parallel_for(Uint count, Uint batch_size, const std::function<void(Uint)>& func);
+	};
+
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include <atomic>
 #include "object.h"
 #include "../event.h"
 
@@ -11,16 +12,38 @@ namespace onion
 		class Agent
 		{
 		public:
-			/// <summary>Updates the actor.</summary>
+			/// <summary>Updates the actor. Agents of different actors may be updated on different threads at the same time, so this should not modify anything shared between actors.</summary>
 			/// <param name="view">The geometry of what is visible.</param>
 			/// <param name="frames_passed">The number of frames since the last update.</param>
 			/// <returns>The desired translation of the actor, in subpixel units.</returns>
 			virtual vec3i update(const WorldCamera* view, int frames_passed) = 0;
 		};
 
+		// Identifies an actor. Actors are moved in order of their IDs, so an ID never depends on which thread constructed the actor.
+		struct ActorID
+		{
+			// The origin of the chunk that the actor was loaded from. Actors that were not loaded from a chunk use the largest possible origin, so they are ordered after every loaded actor.
+			vec2i origin;
+
+			// The order that the actor was loaded from its chunk in, or constructed in if it was not loaded from a chunk.
+			Uint index;
+
+			/// <summary>Compares two IDs, by origin and then by index.</summary>
+			/// <param name="other">The other ID.</param>
+			/// <returns>True if this ID is ordered before the other, false otherwise.</returns>
+			bool operator<(const ActorID& other) const;
+		};
+
 		// An object that can move around and do stuff.
 		class Actor : public Object
 		{
+		private:
+			// The index to give the next actor constructed. Atomic, since actors can be constructed while chunks are parsed on worker threads.
+			static std::atomic<Uint> m_NextID;
+
+			// A unique ID, which is replaced by the chunk if the actor was loaded from one.
+			ActorID m_ID;
+
 		protected:
 			// The agent that controls the actor movement.
 			Agent* m_Agent;
@@ -28,6 +51,11 @@ namespace onion
 			// Wrapper for the shape that handles subpixel translations.
 			SubpixelHandler m_SubpixelHandler;
 
+			/// <summary>Responds to another object colliding with this one.</summary>
+			/// <param name="obj">The object that collided with this one.</param>
+			/// <returns>True, since actors cannot pass through each other.</returns>
+			virtual bool __collision(Object* obj);
+
 		public:
 			/// <summary>Constructs an actor object.</summary>
 			/// <param name="bounds">The bounds of the object. Should be constructed with new specifically for this object.</param>
@@ -39,6 +67,19 @@ namespace onion
 			virtual ~Actor();
 
 
+			/// <summary>Retrieves the ID of the actor. Actors are moved in order of their IDs.</summary>
+			/// <returns>The unique ID of the actor.</returns>
+			const ActorID& get_id() const;
+
+			/// <summary>Sets the ID of an actor loaded from a chunk, from the origin of the chunk and the order it was loaded in.</summary>
+			/// <param name="origin">The origin of the chunk that the actor was loaded from.</param>
+			/// <param name="index">The number of actors loaded from the chunk before this one.</param>
+			void set_id(const vec2i& origin, Uint index);
+
+			/// <summary>Retrieves the subpixel position of the actor within its current pixel.</summary>
+			/// <returns>A const reference to the subpixel position.</returns>
+			const vec3i& get_subpixels() const;
+
 			/// <summary>Translates the actor by a number of subpixel units.</summary>
 			/// <param name="trans">The vector of translation, in subpixel units.</returns>
 			void translate(const vec3i& trans);
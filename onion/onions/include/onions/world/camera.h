@@ -59,6 +59,24 @@ namespace onion
 			/// <returns>A vector representing the direction facing the screen.</returns>
 			virtual vec3i get_normal() const = 0;
 
+			/// <summary>Finds the range of x-coordinates that are visible on the plane z = 0, between two y-coordinates.</summary>
+			/// <param name="min_y">The minimum y-coordinate.</param>
+			/// <param name="max_y">The maximum y-coordinate.</param>
+			/// <param name="min_x">Outputs the minimum visible x-coordinate.</param>
+			/// <param name="max_x">Outputs the maximum visible x-coordinate.</param>
+			/// <returns>True if any point on the plane between the y-coordinates is visible, false otherwise.</returns>
+			virtual bool get_ground_span(Int min_y, Int max_y, Int& min_x, Int& max_x) const = 0;
+
+			/// <summary>Finds a conservative range of x-coordinates that could be visible, between two y-coordinates and two heights.</summary>
+			/// <param name="min_y">The minimum y-coordinate.</param>
+			/// <param name="max_y">The maximum y-coordinate.</param>
+			/// <param name="min_z">The minimum z-coordinate.</param>
+			/// <param name="max_z">The maximum z-coordinate.</param>
+			/// <param name="min_x">Outputs the minimum x-coordinate that could be visible.</param>
+			/// <param name="max_x">Outputs the maximum x-coordinate that could be visible.</param>
+			/// <returns>True if any point in the range could be visible, false if none are.</returns>
+			bool get_visible_span(Int min_y, Int max_y, Int min_z, Int max_z, Int& min_x, Int& max_x) const;
+
 
 			/// <summary>Compares two shapes to see which should be rendered behind the other.</summary>
 			/// <param name="lhs">One shape being compared.</param>
@@ -103,6 +121,14 @@ namespace onion
 			/// <returns>A vector representing the direction facing the screen.</returns>
 			vec3i get_normal() const;
 
+			/// <summary>Finds the range of x-coordinates that are visible on the plane z = 0, between two y-coordinates.</summary>
+			/// <param name="min_y">The minimum y-coordinate.</param>
+			/// <param name="max_y">The maximum y-coordinate.</param>
+			/// <param name="min_x">Outputs the minimum visible x-coordinate.</param>
+			/// <param name="max_x">Outputs the maximum visible x-coordinate.</param>
+			/// <returns>True if any point on the plane between the y-coordinates is visible, false otherwise.</returns>
+			bool get_ground_span(Int min_y, Int max_y, Int& min_x, Int& max_x) const;
+
 
 			/// <summary>Compares two shapes to see which should be rendered behind the other.</summary>
 			/// <param name="lhs">One shape being compared.</param>
@@ -182,6 +208,14 @@ namespace onion
 			/// <returns>A vector representing the direction facing the screen.</returns>
 			vec3i get_normal() const;
 
+			/// <summary>Finds the range of x-coordinates that are visible on the plane z = 0, between two y-coordinates.</summary>
+			/// <param name="min_y">The minimum y-coordinate.</param>
+			/// <param name="max_y">The maximum y-coordinate.</param>
+			/// <param name="min_x">Outputs the minimum visible x-coordinate.</param>
+			/// <param name="max_x">Outputs the maximum visible x-coordinate.</param>
+			/// <returns>True if any point on the plane between the y-coordinates is visible, false otherwise.</returns>
+			bool get_ground_span(Int min_y, Int max_y, Int& min_x, Int& max_x) const;
+
 
 			/// <summary>Compares two shapes to see which should be rendered behind the other.</summary>
 			/// <param name="lhs">One shape being compared.</param>
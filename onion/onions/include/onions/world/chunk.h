@@ -1,4 +1,7 @@
 #pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <unordered_set>
 #include "../matrix.h"
 #include "object.h"
@@ -15,6 +18,45 @@ namespace onion
 #define TILE_CORNER_TOP_RIGHT		2
 #define TILE_CORNER_TOP_LEFT		3
 
+
+// The first four bytes of every cooked chunk file.
+#define ONION_CHUNK_COOKED_MAGIC	"ONCK"
+
+// The version of the cooked chunk format. Cooked files with any other version are ignored, and the text file is loaded instead.
+#define ONION_CHUNK_COOKED_VERSION	2
+
+// The alignment of the vertex data within a cooked chunk file, in bytes.
+#define ONION_CHUNK_COOKED_ALIGNMENT	16
+
+// The number of tiles along a row that share a minimum and maximum height, when culling smooth chunks.
+#define ONION_CHUNK_HEIGHT_BLOCK	8
+
+// The number of rows of tiles handed to a worker thread at once, when building the vertices of smooth chunks.
+#define ONION_CHUNK_PARALLEL_ROWS	16
+
+// The most texels along each side of a chunk's lightmap. Larger chunks bake their light more coarsely.
+#define ONION_CHUNK_LIGHTMAP_MAX	256
+
+
+		// The stages that a chunk goes through while loading.
+		enum ChunkState
+		{
+			// The chunk is not in memory.
+			CHUNK_UNLOADED,
+
+			// The chunk is waiting for a worker thread to parse it.
+			CHUNK_QUEUED,
+
+			// The chunk file is being parsed, and its vertices and objects constructed.
+			CHUNK_PARSING,
+
+			// The chunk has been parsed, and is waiting for its buffer and texture to be uploaded on the render thread.
+			CHUNK_UPLOADING,
+
+			// The chunk is loaded and can be displayed.
+			CHUNK_READY
+		};
+
 		class Chunk
 		{
 		private:
@@ -36,16 +78,49 @@ namespace onion
 			// Images containing tile sprites that are currently loaded in memory.
 			static std::unordered_map<std::string, TileImageManager*> m_Images;
 
+			// Guards the images containing tile sprites, since chunks can be parsed on worker threads.
+			static std::mutex m_ImagesMutex;
+
 			// The image that stores the tiles.
 			opengl::_Image* m_TileImage = nullptr;
 
+			// The path to the image that stores the tiles, from the res/img/world/tiles/ folder.
+			std::string m_TileImagePath;
+
 
 			// Used to display rows of tiles.
 			opengl::_VertexBufferDisplayer* m_Displayer = nullptr;
 
 
-			// True if the chunk is loaded, false otherwise.
-			bool m_IsLoaded;
+			// The loading stage of the chunk.
+			std::atomic<ChunkState> m_State{ CHUNK_UNLOADED };
+
+			// True while a task to parse the chunk is queued or running on a worker thread.
+			bool m_TaskQueued = false;
+
+			// Guards changes to the loading stage.
+			std::mutex m_StateMutex;
+
+			// Signalled when the chunk finishes parsing, or a queued task finishes.
+			std::condition_variable m_StateChanged;
+
+			// The vertex data built by the parsing stage, waiting to be uploaded.
+			opengl::_VertexBufferData* m_PendingData = nullptr;
+
+			// The cooked file mapped by the parsing stage, kept open until its vertex data is uploaded.
+			MappedFile* m_PendingFile = nullptr;
+
+			// The compiled vertex data within the pending cooked file.
+			char* m_PendingVertices = nullptr;
+
+			// The size of the compiled vertex data within the pending cooked file, in bytes.
+			std::size_t m_PendingBytes = 0;
+
+			// While cooking, collects the objects in the data file instead of generating them.
+			std::vector<std::pair<String, StringData>>* m_CookedObjects = nullptr;
+
+			// The approximate number of bytes of vertex data used by the chunk while it is loaded.
+			Uint m_MemoryUsage = 0;
 
 		protected:
 			/// <summary>Retrieves the tile shader.</summary>
@@ -67,12 +142,29 @@ namespace onion
 			void unset_tile_image();
 
 
+			// The sprite displayed on a tile.
+			struct Tile
+			{
+				// The index of the sprite in the tile image, or -1 if the tile has no sprite.
+				Int sprite = -1;
+
+				// The number of quarter turns the sprite is rotated from its default orientation.
+				Int rotation = 0;
+			};
+
+			// The sprite of each tile, in the order of their indices.
+			std::vector<Tile> m_Tiles;
+
+
 			// The size of each tile.
 			static int m_TileSize;
 
 			// The number of tiles on each axis.
 			vec2i m_Dimensions;
 
+			// The world coordinates of the bottom-left corner of the chunk.
+			vec2i m_Origin;
+
 
 			// A visible row of tiles.
 			struct TileRow
@@ -94,12 +186,92 @@ namespace onion
 
 
 			// The path to the chunk's data, from the res/data/world/ folder.
-			const char* m_Path;
+			std::string m_Path;
 
-			/// <summary>Loads the chunk from file.</summary>
+			// The number of actors loaded from the data file so far.
+			Uint m_ActorCount = 0;
+
+			// The number of objects loaded from the data file so far.
+			Uint m_ObjectCount = 0;
+
+			/// <summary>Loads the chunk from file. Must not make any OpenGL calls, since it can run on a worker thread.</summary>
 			/// <returns>The vertex data for the buffer.</returns>
 			virtual opengl::_VertexBufferData* __load() = 0;
 
+			/// <summary>Loads the data of a static object.</summary>
+			/// <param name="id">The ID of the object.</param>
+			/// <param name="line">The data loaded from a line in the file.</param>
+			virtual void __load_obj(String id, const StringData& line) = 0;
+
+			/// <summary>Reads the data file, setting the tile image and reading every static object. The chunk is sized to fit every tile and the tile table is allocated, so that tiles can then be loaded into buffers that never need to grow.</summary>
+			/// <param name="tiles">Appended with the data of every tile, in the order they appear in the file.</param>
+			void __scan_file(std::vector<StringData>& tiles);
+
+			/// <summary>Generates an object read from the data file, positioned relative to the origin of the chunk.
+			/// Actors are given IDs from the origin of the chunk and the order they were read in, so that they are moved in the same order however the chunks were parsed.</summary>
+			/// <param name="id">The ID of the object.</param>
+			/// <param name="line">The data loaded from a line in the file.</param>
+			/// <returns>The generated object, or NULL if no object could be generated.</returns>
+			Object* __generate_obj(String id, const StringData& line);
+
+			/// <summary>Passes a static object read from the data file to __load_obj(), or collects it if the chunk is being cooked.</summary>
+			/// <param name="id">The ID of the object.</param>
+			/// <param name="line">The data loaded from a line in the file.</param>
+			void __read_obj(String id, const StringData& line);
+
+			/// <summary>Retrieves the size of each vertex in the tile buffer.</summary>
+			/// <returns>The size of each vertex, in bytes.</returns>
+			virtual std::size_t __get_vertex_size() const = 0;
+
+			/// <summary>Retrieves the UV coordinates of each corner of a sprite in the tile image.</summary>
+			/// <param name="sprite">The index of the sprite in the tile image.</param>
+			/// <param name="uv">Outputs the UV coordinates of each corner, indexed by tile corner.</param>
+			void __get_sprite_uvs(Int sprite, vec2f* uv) const;
+
+			/// <summary>Rebuilds a rectangle of tiles after they have been edited, and uploads them over their old data. Called from the render thread.</summary>
+			/// <param name="min_i">The x-index of the leftmost tile.</param>
+			/// <param name="min_j">The y-index of the bottom tile.</param>
+			/// <param name="max_i">The x-index of the rightmost tile.</param>
+			/// <param name="max_j">The y-index of the top tile.</param>
+			virtual void __update_tiles(Int min_i, Int min_j, Int max_i, Int max_j) = 0;
+
+			/// <summary>Uploads vertices over part of the tile buffer. Called from the render thread.</summary>
+			/// <param name="first">The index of the first vertex to overwrite.</param>
+			/// <param name="data">The new vertices.</param>
+			void __update_vertices(BUFFER_KEY first, const opengl::_VertexBufferData* data);
+
+			/// <summary>Writes any data specific to the type of chunk to a cooked file.</summary>
+			/// <param name="file">The cooked file.</param>
+			virtual void __write_cooked(SaveFile& file) const;
+
+			/// <summary>Reads any data specific to the type of chunk from a cooked file, as written by __write_cooked().</summary>
+			/// <param name="file">The cooked file.</param>
+			/// <returns>True if the data was read successfully, false otherwise.</returns>
+			virtual bool __read_cooked(MappedFile& file);
+
+			/// <summary>Hashes the contents of the chunk's text data file, so that cooked files made from an older version of it can be detected.</summary>
+			/// <returns>The FNV-1a hash of the text file, or 0 if it cannot be read.</returns>
+			std::uint32_t __hash_source() const;
+
+			/// <summary>Loads the chunk from its cooked file, if there is an up-to-date one. Must not make any OpenGL calls, since it can run on a worker thread.</summary>
+			/// <param name="vertices">Outputs a pointer to the compiled vertex data, within the mapped file.</param>
+			/// <param name="bytes">Outputs the size of the compiled vertex data, in bytes.</param>
+			/// <returns>The mapped file, which must be kept open until the vertex data is uploaded. NULL if the text file should be loaded instead.</returns>
+			MappedFile* __load_cooked(char*& vertices, std::size_t& bytes);
+
+			/// <summary>Builds anything derived from the parsed data, after the chunk has been loaded from either its text or cooked file. Runs on the parsing thread.</summary>
+			virtual void __finish_parse();
+
+			/// <summary>Uploads anything else that the chunk displays with, after its tile buffer. Called from the render thread.</summary>
+			/// <returns>The approximate number of bytes uploaded.</returns>
+			virtual Uint __finish_upload();
+
+			/// <summary>Frees anything built by __finish_parse() or uploaded by __finish_upload(). Subclasses that override this must call unload() in their own deconstructor.</summary>
+			virtual void __finish_unload();
+
+			/// <summary>Runs the parsing stage of loading, then stores the vertex data to be uploaded.</summary>
+			void __parse();
+
 		public:
 			/// <summary>Retrieves the size of tiles in all chunks.</summary>
 			/// <returns>The size of tiles, in pixels.</returns>
@@ -112,7 +284,22 @@ namespace onion
 
 			/// <summary>Constructs a chunk.</summary>
 			/// <param name="path">The path to the data file, from the res/data/world/ folder.</param>
-			Chunk(const char* path);
+			/// <param name="origin">The world coordinates of the bottom-left corner of the chunk.</param>
+			Chunk(const char* path, const vec2i& origin = vec2i(0, 0));
+
+			/// <summary>Unloads the chunk, if it is loaded.</summary>
+			virtual ~Chunk();
+
+
+			/// <summary>Retrieves the path to the cooked version of a data file, which replaces its extension with ".chunk".</summary>
+			/// <param name="path">The path to the data file.</param>
+			/// <returns>The path to the cooked file.</returns>
+			static std::string get_cooked_path(const std::string& path);
+
+			/// <summary>Parses the chunk's text data file, and writes the result to a cooked file that loads without parsing. The chunk must not be loaded. No OpenGL calls are made, so this can run without a window.</summary>
+			/// <param name="path">The path to write the cooked file to, from the res/data/world/ folder.</param>
+			/// <returns>True if the cooked file was written, false otherwise.</returns>
+			bool cook(const char* path);
 
 
 			/// <summary>Retrieves the index of a tile.</summary>
@@ -125,6 +312,14 @@ namespace onion
 			/// <returns>A reference to the dimensions of the chunk.</returns>
 			const vec2i& get_dimensions() const;
 
+			/// <summary>Retrieves the world coordinates of the bottom-left corner of the chunk.</summary>
+			/// <returns>A reference to the origin of the chunk.</returns>
+			const vec2i& get_origin() const;
+
+			/// <summary>Retrieves how much memory the chunk is using.</summary>
+			/// <returns>The approximate number of bytes of vertex data used by the chunk, or 0 if it is not loaded.</returns>
+			Uint get_memory_usage() const;
+
 
 			/// <summary>Retrieves the height of the tile at the given world coordinates.</summary>
 			/// <param name="x">The x-coordinate in the world.</param>
@@ -132,15 +327,34 @@ namespace onion
 			/// <returns>The z-coordinate of the ground at the given world coordinates.</returns>
 			virtual int get_tile_height(int x, int y) const = 0;
 
+			/// <summary>Changes the sprite of a tile, and uploads only the part of the chunk's data that displays it. Must be called from the render thread.</summary>
+			/// <param name="x">The x-index of the tile.</param>
+			/// <param name="y">The y-index of the tile.</param>
+			/// <param name="sprite">The index of the sprite in the tile image, or -1 for no sprite.</param>
+			/// <param name="rotation">The number of quarter turns the sprite is rotated from its default orientation.</param>
+			/// <returns>True if the tile was changed, false if the chunk isn't ready or the tile is outside of it.</returns>
+			bool set_tile(Int x, Int y, Int sprite, Int rotation = 0);
+
 
 			/// <summary>Checks whether the chunk has been loaded.</summary>
 			/// <returns>True if the chunk has been loaded, false otherwise.</returns>
 			bool is_loaded() const;
 
-			/// <summary>Loads the chunk from its data file.</summary>
+			/// <summary>Retrieves the loading stage of the chunk.</summary>
+			/// <returns>The current state of the chunk.</returns>
+			ChunkState get_state() const;
+
+			/// <summary>Loads the chunk from its data file, blocking until it is ready. If the chunk is already being parsed on a worker thread, waits for it to finish.</summary>
 			void load();
 
-			/// <summary>Unloads the chunk, freeing any memory it's using.</summary>
+			/// <summary>Queues the chunk to be parsed on a worker thread. Call finish_loading() from the render thread to complete it.</summary>
+			void load_async();
+
+			/// <summary>Uploads the chunk's buffer and texture, if it has finished parsing. Must be called from the render thread.</summary>
+			/// <returns>True if the chunk is ready, false if it is still loading or not loaded at all.</returns>
+			bool finish_loading();
+
+			/// <summary>Unloads the chunk, freeing any memory it's using. Cancels a queued load, or waits for one in progress.</summary>
 			void unload();
 
 
@@ -148,6 +362,10 @@ namespace onion
 			/// <param name="obj">The object to insert.</param>
 			virtual void add(Object* obj) = 0;
 
+			/// <summary>Retrieves the manager of all objects in the chunk.</summary>
+			/// <returns>A reference to the object manager.</returns>
+			virtual ObjectManager& get_object_manager() = 0;
+
 
 			/// <summary>Resets what is visible, in response to the view changing.</summary>
 			virtual void reset_visible(const WorldCamera* view) = 0;
@@ -158,9 +376,13 @@ namespace onion
 			/// <summary>Displays tiles in the chunk.</summary>
 			void display_tiles() const;
 
-			/// <summary>Displays objects in the chunk.</summary>
+			/// <summary>Displays opaque and alpha-tested objects in the chunk.</summary>
 			/// <param name="normal">A vector pointing towards the camera.</param>
-			virtual void display_objects(const vec3i& normal) const = 0;
+			virtual void display_opaque_objects(const vec3i& normal) const = 0;
+
+			/// <summary>Displays translucent objects in the chunk. Called once the opaque objects of every chunk have been displayed.</summary>
+			/// <param name="normal">A vector pointing towards the camera.</param>
+			virtual void display_translucent_objects(const vec3i& normal) const = 0;
 		};
 
 
@@ -170,8 +392,8 @@ namespace onion
 		protected:
 			using buffer_t = VertexBufferData<FLOAT_VEC2, FLOAT_VEC2>;
 
-			// The shader used for flat chunks.
-			static Shader<FLOAT_MAT4, Int, Int>* m_BasicFlatTileShader;
+			// The variants of the shader used for flat chunks, for each combination of lights.
+			static ShaderPermutations<FLOAT_MAT4, Int, Int, Int, INT_VEC2, Int>* m_BasicFlatTileShaders;
 
 			/// <summary>Retrieves the tile shader.</summary>
 			/// <returns>A pointer to the tile shader.</returns>
@@ -185,25 +407,74 @@ namespace onion
 			ObjectManager m_Manager;
 
 
+			// The cube lights loaded with the chunk, which are baked into the lightmap if they never change and only light this chunk.
+			std::vector<CubeLight*> m_StaticLights;
+
+			// The width and height of the lightmap, in texels.
+			vec2i m_LightmapSize;
+
+			// The width and height of the square of pixels that each texel of the lightmap covers. At least the size of a tile.
+			Int m_LightmapStep = 1;
+
+			// The light from baked lights that reaches the center of each texel, as three floats per texel. Emptied once it is uploaded.
+			std::vector<float> m_LightmapData;
+
+			// The texture storing the light from baked lights.
+			opengl::_FloatTexture* m_Lightmap = nullptr;
+
+
 			/// <summary>Loads the chunk from file.</summary>
 			/// <returns>The vertex data for the buffer.</returns>
 			virtual opengl::_VertexBufferData* __load();
 
-			/// <summary>Loads the data of a tile.</summary>
+			/// <summary>Reads the tiles, objects, and tile image from the data file.</summary>
+			void __load_file();
+
+			/// <summary>Loads the sprite of a tile.</summary>
 			/// <param name="line">The data loaded from a line in the file.</param>
+			void __load_tile(const StringData& line);
+
+			/// <summary>Sets the position and UV coordinates of each vertex of a tile.</summary>
+			/// <param name="i">The x-index of the tile.</param>
+			/// <param name="j">The y-index of the tile.</param>
 			/// <param name="data">The buffer of data.</param>
-			virtual void __load_tile(const StringData& line, buffer_t* data);
+			/// <param name="index">The index of the tile's first vertex in the buffer.</param>
+			void __set_tile_vertices(Int i, Int j, buffer_t* data, int index) const;
+
+			/// <summary>Rebuilds the vertices of a rectangle of tiles, and uploads them one row at a time.</summary>
+			/// <param name="min_i">The x-index of the leftmost tile.</param>
+			/// <param name="min_j">The y-index of the bottom tile.</param>
+			/// <param name="max_i">The x-index of the rightmost tile.</param>
+			/// <param name="max_j">The y-index of the top tile.</param>
+			virtual void __update_tiles(Int min_i, Int min_j, Int max_i, Int max_j);
 
 			/// <summary>Loads the data of a static object.</summary>
 			/// <param name="id">The ID of the object.</param>
 			/// <param name="line">The data loaded from a line in the file.</param>
-			/// <param name="data">The buffer of data.</param>
 			virtual void __load_obj(String id, const StringData& line);
 
+			/// <summary>Retrieves the size of each vertex in the tile buffer.</summary>
+			/// <returns>The size of each vertex, in bytes.</returns>
+			virtual std::size_t __get_vertex_size() const;
+
+			/// <summary>Bakes the light from static lights into the lightmap.</summary>
+			virtual void __finish_parse();
+
+			/// <summary>Uploads the lightmap and the merged graphics of static objects.</summary>
+			/// <returns>The approximate number of bytes uploaded.</returns>
+			virtual Uint __finish_upload();
+
+			/// <summary>Frees the lightmap and the merged graphics of static objects.</summary>
+			virtual void __finish_unload();
+
 		public:
 			/// <summary>Constructs a chunk.</summary>
 			/// <param name="path">The path to the data file, from the res/data/world/ folder.</param>
-			FlatChunk(const char* path);
+			/// <param name="origin">The world coordinates of the bottom-left corner of the chunk.</param>
+			FlatChunk(const char* path, const vec2i& origin = vec2i(0, 0));
+
+			/// <summary>Unloads the chunk, if it is loaded.</summary>
+			virtual ~FlatChunk();
 
 
 			/// <summary>Retrieves the height of the tile at the given world coordinates.</summary>
@@ -217,6 +488,10 @@ namespace onion
 			/// <param name="obj">The object to insert.</param>
 			void add(Object* obj);
 
+			/// <summary>Retrieves the manager of all objects in the chunk.</summary>
+			/// <returns>A reference to the object manager.</returns>
+			ObjectManager& get_object_manager();
+
 
 			/// <summary>Resets what is visible, in response to the view changing.</summary>
 			void reset_visible(const WorldCamera* view);
@@ -224,9 +499,71 @@ namespace onion
 			/// <summary>Updates what is visible, in response to the passage of time.</summary>
 			void update_visible(const WorldCamera* view, int frames_passed);
 
-			/// <summary>Displays objects in the chunk.</summary>
+			/// <summary>Displays opaque and alpha-tested objects in the chunk.</summary>
 			/// <param name="normal">A vector pointing towards the camera.</param>
-			void display_objects(const vec3i& normal) const;
+			void display_opaque_objects(const vec3i& normal) const;
+
+			/// <summary>Displays translucent objects in the chunk.</summary>
+			/// <param name="normal">A vector pointing towards the camera.</param>
+			void display_translucent_objects(const vec3i& normal) const;
+		};
+
+
+		// A flat chunk that stores only the sprite and rotation of each tile in a texture. The tile shader builds each tile's square from the index of its vertices, so the chunk has no vertex data.
+		class TileMapChunk : public FlatChunk
+		{
+		protected:
+			// The variants of the shader used for tile map chunks, for each combination of lights.
+			static ShaderPermutations<FLOAT_MAT4, Int, Int, Int, INT_VEC2, Int, Int, Int>* m_TileMapShaders;
+
+			/// <summary>Retrieves the tile shader.</summary>
+			/// <returns>A pointer to the tile shader.</returns>
+			virtual const opengl::_Shader* get_tile_shader() const;
+
+			/// <summary>Activates and sets the uniforms for the tile shader.</summary>
+			virtual void activate_tile_shader() const;
+
+
+			// The sprite and rotation of each tile, packed to be uploaded to the tile map.
+			std::vector<std::int16_t> m_TileRecords;
+
+			// The texture storing the sprite and rotation of each tile.
+			opengl::_IntegerTexture* m_TileMap = nullptr;
+
+
+			/// <summary>Loads the chunk from file.</summary>
+			/// <returns>NULL, since the tiles have no vertex data.</returns>
+			virtual opengl::_VertexBufferData* __load();
+
+			/// <summary>Retrieves the size of each vertex in the tile buffer.</summary>
+			/// <returns>0, since the tiles have no vertex data.</returns>
+			virtual std::size_t __get_vertex_size() const;
+
+			/// <summary>Bakes the lightmap and packs the sprite and rotation of each tile.</summary>
+			virtual void __finish_parse();
+
+			/// <summary>Uploads the tile map, the lightmap, and the merged graphics of static objects.</summary>
+			/// <returns>The approximate number of bytes uploaded.</returns>
+			virtual Uint __finish_upload();
+
+			/// <summary>Frees the tile map, the lightmap, and the merged graphics of static objects.</summary>
+			virtual void __finish_unload();
+
+			/// <summary>Uploads the sprite and rotation of a rectangle of tiles over their old texels in the tile map.</summary>
+			/// <param name="min_i">The x-index of the leftmost tile.</param>
+			/// <param name="min_j">The y-index of the bottom tile.</param>
+			/// <param name="max_i">The x-index of the rightmost tile.</param>
+			/// <param name="max_j">The y-index of the top tile.</param>
+			virtual void __update_tiles(Int min_i, Int min_j, Int max_i, Int max_j);
+
+		public:
+			/// <summary>Constructs a chunk.</summary>
+			/// <param name="path">The path to the data file, from the res/data/world/ folder.</param>
+			/// <param name="origin">The world coordinates of the bottom-left corner of the chunk.</param>
+			TileMapChunk(const char* path, const vec2i& origin = vec2i(0, 0));
+
+			/// <summary>Unloads the chunk, if it is loaded.</summary>
+			virtual ~TileMapChunk();
 		};
 
 
@@ -247,30 +584,114 @@ namespace onion
 			// The heights of the ground at each corner of a tile.
 			std::vector<Int> m_TileCornerHeights;
 
+			// The minimum and maximum height of the ground in each row of tiles.
+			std::vector<vec2i> m_RowHeights;
+
+			// The minimum and maximum height of the ground in each block of tiles along a row, in the order of the rows.
+			std::vector<vec2i> m_BlockHeights;
+
+			/// <summary>Retrieves the minimum and maximum height of the ground on a tile.</summary>
+			/// <param name="i">The x-index of the tile.</param>
+			/// <param name="j">The y-index of the tile.</param>
+			/// <returns>The minimum and maximum height of the corners of the tile.</returns>
+			vec2i __get_tile_heights(Int i, Int j) const;
+
+			/// <summary>Checks whether any of a range of tiles in a row could be visible.</summary>
+			/// <param name="view">The geometry of what is visible.</param>
+			/// <param name="min_i">The x-index of the first tile in the range.</param>
+			/// <param name="max_i">The x-index of the last tile in the range.</param>
+			/// <param name="j">The y-index of the row.</param>
+			/// <param name="heights">The minimum and maximum height of the ground across the range.</param>
+			/// <returns>True if any of the tiles could be visible, false if none are.</returns>
+			bool __is_visible(const WorldCamera* view, Int min_i, Int max_i, Int j, const vec2i& heights) const;
+
+			/// <summary>Rebuilds the minimum and maximum heights of a row of tiles and each block along it.</summary>
+			/// <param name="j">The y-index of the row.</param>
+			void __update_row_heights(Int j);
+
+			/// <summary>Builds the minimum and maximum heights of each row and block of tiles.</summary>
+			void __finish_parse();
+
 
 			// Manages all objects for the chunk.
 			ObjectManager m_Manager;
 
 
+			/// <summary>Retrieves the height of the tile at the given coordinates relative to the origin of the chunk.</summary>
+			/// <param name="x">The x-coordinate relative to the origin.</param>
+			/// <param name="y">The y-coordinate relative to the origin.</param>
+			/// <returns>The z-coordinate of the ground at the given coordinates.</returns>
+			int __get_tile_height(int x, int y) const;
+
+			/// <summary>Writes the height of each tile corner to a cooked file.</summary>
+			/// <param name="file">The cooked file.</param>
+			virtual void __write_cooked(SaveFile& file) const;
+
+			/// <summary>Reads the height of each tile corner from a cooked file.</summary>
+			/// <param name="file">The cooked file.</param>
+			/// <returns>True if the heights were read successfully, false otherwise.</returns>
+			virtual bool __read_cooked(MappedFile& file);
+
+
 			/// <summary>Loads the chunk from file.</summary>
 			/// <returns>The vertex data for the buffer.</returns>
 			virtual opengl::_VertexBufferData* __load();
 
-			/// <summary>Loads the data of a tile.</summary>
+			/// <summary>Loads the corner heights and sprite of a tile.</summary>
 			/// <param name="line">The data loaded from a line in the file.</param>
+			void __load_tile(const StringData& line);
+
+			/// <summary>Calculates the normal vector of each face of a tile.</summary>
+			/// <param name="i">The x-index of the tile.</param>
+			/// <param name="j">The y-index of the tile.</param>
+			/// <param name="normals">Outputs the unit normal vector of both faces.</param>
+			void __get_face_normals(Int i, Int j, vec3f* normals) const;
+
+			/// <summary>Calculates the normal vector of a tile corner, by averaging the faces of the tiles around it.</summary>
+			/// <param name="x">The x-index of the corner.</param>
+			/// <param name="y">The y-index of the corner.</param>
+			/// <returns>The normal vector of the corner.</returns>
+			vec3f __get_vertex_normal(Int x, Int y) const;
+
+			/// <summary>Sets the position, normal vector, and UV coordinates of each vertex of a tile.</summary>
+			/// <param name="i">The x-index of the tile.</param>
+			/// <param name="j">The y-index of the tile.</param>
+			/// <param name="normals">The normal vector of each corner of the tile, indexed by tile corner.</param>
 			/// <param name="data">The buffer of data.</param>
-			virtual void __load_tile(const StringData& line, buffer_t* data);
+			/// <param name="index">The index of the tile's first vertex in the buffer.</param>
+			void __set_tile_vertices(Int i, Int j, const vec3f* normals, buffer_t* data, int index) const;
+
+			/// <summary>Rebuilds the vertices of a rectangle of tiles from the corner heights, and uploads them one row at a time.</summary>
+			/// <param name="min_i">The x-index of the leftmost tile.</param>
+			/// <param name="min_j">The y-index of the bottom tile.</param>
+			/// <param name="max_i">The x-index of the rightmost tile.</param>
+			/// <param name="max_j">The y-index of the top tile.</param>
+			virtual void __update_tiles(Int min_i, Int min_j, Int max_i, Int max_j);
 
 			/// <summary>Loads the data of a static object.</summary>
 			/// <param name="id">The ID of the object.</param>
 			/// <param name="line">The data loaded from a line in the file.</param>
-			/// <param name="data">The buffer of data.</param>
 			virtual void __load_obj(String id, const StringData& line);
 
+			/// <summary>Retrieves the size of each vertex in the tile buffer.</summary>
+			/// <returns>The size of each vertex, in bytes.</returns>
+			virtual std::size_t __get_vertex_size() const;
+
+			/// <summary>Uploads the merged graphics of static objects.</summary>
+			/// <returns>The approximate number of bytes uploaded.</returns>
+			virtual Uint __finish_upload();
+
+			/// <summary>Frees the merged graphics of static objects.</summary>
+			virtual void __finish_unload();
+
 		public:
 			/// <summary>Constructs a chunk.</summary>
 			/// <param name="path">The path to the data file, from the res/data/world/ folder.</param>
-			SmoothChunk(const char* path);
+			/// <param name="origin">The world coordinates of the bottom-left corner of the chunk.</param>
+			SmoothChunk(const char* path, const vec2i& origin = vec2i(0, 0));
+
+			/// <summary>Unloads the chunk, if it is loaded.</summary>
+			virtual ~SmoothChunk();
 
 
 			/// <summary>Retrieves the height of the tile at the given world coordinates.</summary>
@@ -279,11 +700,22 @@ namespace onion
 			/// <returns>The z-coordinate of the ground at the given world coordinates.</returns>
 			int get_tile_height(int x, int y) const;
 
+			/// <summary>Changes the height of the ground at a tile corner. Only the tiles whose normals depend on the corner are rebuilt and uploaded. Must be called from the render thread.</summary>
+			/// <param name="x">The x-index of the corner.</param>
+			/// <param name="y">The y-index of the corner.</param>
+			/// <param name="height">The new height of the corner.</param>
+			/// <returns>True if the corner was changed, false if the chunk isn't ready or the corner is outside of it.</returns>
+			bool set_corner_height(Int x, Int y, Int height);
+
 
 			/// <summary>Inserts an object into the chunk.</summary>
 			/// <param name="obj">The object to insert.</param>
 			void add(Object* obj);
 
+			/// <summary>Retrieves the manager of all objects in the chunk.</summary>
+			/// <returns>A reference to the object manager.</returns>
+			ObjectManager& get_object_manager();
+
 
 			/// <summary>Resets what is visible, in response to the view changing.</summary>
 			void reset_visible(const WorldCamera* view);
@@ -291,9 +723,13 @@ namespace onion
 			/// <summary>Updates what is visible, in response to the passage of time.</summary>
 			void update_visible(const WorldCamera* view, int frames_passed);
 
-			/// <summary>Displays objects in the chunk.</summary>
+			/// <summary>Displays opaque and alpha-tested objects in the chunk.</summary>
+			/// <param name="normal">A vector pointing towards the camera.</param>
+			void display_opaque_objects(const vec3i& normal) const;
+
+			/// <summary>Displays translucent objects in the chunk.</summary>
 			/// <param name="normal">A vector pointing towards the camera.</param>
-			void display_objects(const vec3i& normal) const;
+			void display_translucent_objects(const vec3i& normal) const;
 		};
 
 
@@ -12,10 +12,15 @@ namespace onion
 		typedef std::vector<vec3f> Simplex;
 
 
+		class SweptShape;
+
+
 		// A three-dimensional shape.
 		class Shape
 		{
 		protected:
+			friend class SweptShape;
+
 			/// <summary>A support function for the GJK algorithm.</summary>
 			/// <param name="dir">A direction vector.</param>
 			/// <param name="point">Outputs the point on the shape that produces the largest dot product with dir.</param>
@@ -28,6 +33,17 @@ namespace onion
 			/// <returns>The distance from this shape to the given shape.</returns>
 			Int __get_distance(const Shape* other, Simplex& s, vec3f& d) const;
 
+
+			// The cached axis-aligned bounding box of the shape. The first column represents minimum values, and the second column represents maximum values.
+			mutable mat2x3i m_BoundingBox;
+
+			// True if the cached bounding box no longer matches the shape, false otherwise.
+			mutable bool m_BoundingBoxOutdated = true;
+
+			/// <summary>Calculates the axis-aligned bounding box of the shape. By default, queries the support function along each axis.</summary>
+			/// <param name="box">Outputs the bounding box. The first column represents minimum values, and the second column represents maximum values.</param>
+			virtual void __get_bounding_box(mat2x3i& box) const;
+
 		public:
 			/// <summary>Retrieves the position of the shape.</summary>
 			/// <returns>A reference to the position of the shape.</returns>
@@ -46,6 +62,16 @@ namespace onion
 			/// <param name="other">The shape to calculate the distance from.</param>
 			/// <returns>The distance from this shape to the given shape.</returns>
 			virtual Int get_distance(const Shape* other) const;
+
+
+			/// <summary>Retrieves the axis-aligned bounding box of the shape, recalculating it only if the shape has changed since it was last retrieved.</summary>
+			/// <returns>A const reference to the bounding box. The first column represents minimum values, and the second column represents maximum values.</returns>
+			const mat2x3i& get_bounding_box() const;
+
+			/// <summary>Checks whether the bounding boxes of this shape and the given shape overlap. If they do not, the distance between the shapes cannot be 0.</summary>
+			/// <param name="other">The shape to test against.</param>
+			/// <returns>True if the bounding boxes overlap or touch, false otherwise.</returns>
+			bool overlaps(const Shape* other) const;
 		};
 
 
@@ -63,6 +89,10 @@ namespace onion
 			/// <param name="point">Outputs the point on the shape that produces the largest dot product with dir.</param>
 			virtual vec3f support(const vec3f& dir) const;
 
+			/// <summary>Calculates the axis-aligned bounding box of the shape.</summary>
+			/// <param name="box">Outputs the bounding box. The first column represents minimum values, and the second column represents maximum values.</param>
+			virtual void __get_bounding_box(mat2x3i& box) const;
+
 		public:
 			/// <summary>Constructs a single point in three-dimensional space.</summary>
 			/// <param name="pos">The point.</param>
@@ -95,6 +125,10 @@ namespace onion
 			/// <param name="point">Outputs the point on the shape that produces the largest dot product with dir.</param>
 			virtual vec3f support(const vec3f& dir) const;
 
+			/// <summary>Calculates the axis-aligned bounding box of the shape.</summary>
+			/// <param name="box">Outputs the bounding box. The first column represents minimum values, and the second column represents maximum values.</param>
+			virtual void __get_bounding_box(mat2x3i& box) const;
+
 		public:
 			/// <summary>Constructs a line segment.</summary>
 			/// <param name="origin">The origin of the line segment.</param>
@@ -108,6 +142,40 @@ namespace onion
 		};
 
 
+		// The volume covered by a shape as it is translated along a vector. This is the Minkowski sum of the shape and a line segment.
+		class SweptShape : public Segment
+		{
+		protected:
+			// The shape being swept.
+			const Shape* m_Shape;
+
+
+			/// <summary>A support function for the GJK algorithm.</summary>
+			/// <param name="dir">A direction vector.</param>
+			/// <param name="point">Outputs the point on the shape that produces the largest dot product with dir.</param>
+			vec3f support(const vec3f& dir) const;
+
+			/// <summary>Calculates the axis-aligned bounding box of the shape.</summary>
+			/// <param name="box">Outputs the bounding box. The first column represents minimum values, and the second column represents maximum values.</param>
+			void __get_bounding_box(mat2x3i& box) const;
+
+		public:
+			/// <summary>Constructs the volume covered by a shape as it is translated.</summary>
+			/// <param name="shape">The shape being swept. Must outlive the swept shape.</param>
+			/// <param name="trans">The vector of translation.</param>
+			SweptShape(const Shape* shape, const vec3i& trans);
+
+
+			/// <summary>Retrieves the position of the shape.</summary>
+			/// <returns>The position of the swept shape before it is translated.</returns>
+			vec3i get_position() const;
+
+			/// <summary>Sets the position of the shape.</summary>
+			/// <param name="pos">The new position of the swept shape before it is translated.</param>
+			void set_position(const vec3i& pos);
+		};
+
+
 		// A rectangular prism whose faces are aligned with the Cartesian planes.
 		class OrthogonalPrism : public Point
 		{
@@ -121,6 +189,10 @@ namespace onion
 			/// <param name="point">Outputs the point on the shape that produces the largest dot product with dir.</param>
 			vec3f support(const vec3f& dir) const;
 
+			/// <summary>Calculates the axis-aligned bounding box of the shape.</summary>
+			/// <param name="box">Outputs the bounding box. The first column represents minimum values, and the second column represents maximum values.</param>
+			void __get_bounding_box(mat2x3i& box) const;
+
 		public:
 			/// <summary>Constructs a rectangular prism.</summary>
 			/// <param name="pos">The corner of the prism with minimum values.</param>
@@ -142,6 +214,10 @@ namespace onion
 			/// <param name="point">Outputs the point on the shape that produces the largest dot product with dir.</param>
 			vec3f support(const vec3f& dir) const;
 
+			/// <summary>Calculates the axis-aligned bounding box of the shape.</summary>
+			/// <param name="box">Outputs the bounding box. The first column represents minimum values, and the second column represents maximum values.</param>
+			void __get_bounding_box(mat2x3i& box) const;
+
 		public:
 			/// <summary>Constructs an upright rectangle.</summary>
 			/// <param name="pos">The corner of the rectangle with minimum values.</param>
@@ -162,6 +238,10 @@ namespace onion
 			/// <param name="point">Outputs the point on the shape that produces the largest dot product with dir.</param>
 			vec3f support(const vec3f& dir) const;
 
+			/// <summary>Calculates the axis-aligned bounding box of the shape.</summary>
+			/// <param name="box">Outputs the bounding box. The first column represents minimum values, and the second column represents maximum values.</param>
+			void __get_bounding_box(mat2x3i& box) const;
+
 		public:
 			/// <summary>Constructs a parallelogram.</summary>
 			/// <param name="pos">The corner of the rectangle with minimum values.</param>
@@ -191,6 +271,10 @@ namespace onion
 			/// <param name="shape">The shape to handle subpixel translations for.</param>
 			SubpixelHandler(Shape* shape);
 
+			/// <summary>Retrieves the current subpixel position within the current pixel.</summary>
+			/// <returns>A const reference to the subpixel position. Each coordinate lies between 0 and num_subpixels - 1.</returns>
+			const vec3i& get_subpixels() const;
+
 			/// <summary>Translates the shape by a given vector, in subpixel units.</summary>
 			/// <param name="trans">A vector of translation, in subpixel units.</param>
 			void translate(const vec3i& trans);
@@ -7,6 +7,8 @@ namespace onion
 	namespace world
 	{
 
+		class StaticGraphicBatch;
+
 		// A three-dimensional graphic displayed to the screen.
 		class Graphic3D
 		{
@@ -14,15 +16,43 @@ namespace onion
 			/// <summary>Displays the graphic.</summary>
 			/// <param name="normal">A vector pointing towards the camera.</param>
 			virtual void display(const vec3i& normal) const = 0;
+
+			/// <summary>Merges the graphic into a batch of static geometry, if it never changes. Graphics are not batched unless a subclass supports it.</summary>
+			/// <param name="batch">The batch to merge the graphic into.</param>
+			/// <param name="pos">The position of the object that the graphic belongs to.</param>
+			/// <returns>True if the graphic was merged into the batch, false if it must be displayed by itself.</returns>
+			virtual bool batch(StaticGraphicBatch& batch, const vec3i& pos) const;
+
+			/// <summary>Checks whether the graphic has partially transparent pixels, and must be blended with whatever is behind it.</summary>
+			/// <returns>True if the graphic must be displayed back to front with blending, false if it can be displayed in any order without blending.</returns>
+			virtual bool is_translucent() const;
 		};
 
 
 		// A sprite sheet that uses dither shading with a normal vector interpolated from each vertex.
 		class Flat3DPixelSpriteSheet : public PixelSpriteSheet<Int, Int>
 		{
+		public:
+			using buffer_t = VertexBufferData<FLOAT_VEC3, FLOAT_VEC3, FLOAT_VEC2>;
+
 		protected:
-			// The shader program for the sprite sheet.
-			static _SpriteShader* m_Flat3DPixelShader;
+			// The variants of the shader program for the sprite sheet, for each combination of lights.
+			static ShaderPermutations<FLOAT_MAT4, Int, Int>* m_Flat3DPixelShaders;
+
+			// A copy of the vertices of every sprite, kept so that static graphics can be transformed ahead of time.
+			buffer_t m_Vertices;
+
+			// The image that the sprites are on. Owned by the sprite sheet's buffer.
+			opengl::_Image* m_Image = nullptr;
+
+			/// <summary>Retrieves the variant of the shader that fits the lights in view.</summary>
+			/// <returns>The shader to activate when displaying a sprite.</returns>
+			_SpriteShader* __get_display_shader() const;
+
+			/// <summary>Generates a pixel-perfect image, and keeps a pointer to it.</summary>
+			/// <param name="path">The path to the image file, from the res/img/ folder.</param>
+			/// <returns>The loaded image.</returns>
+			opengl::_Image* load_image(const char* path);
 
 			/// <summary>Loads vertex attribute data from a line in a meta file.</summary>
 			/// <param name="id">The ID associated with the line of data.</param>
@@ -37,6 +67,10 @@ namespace onion
 			/// <returns>A shader that only takes two image keys as arguments.</returns>
 			static _SpriteShader* get_shader();
 
+			/// <summary>Gets the variant of the shader that fits the lights in view, compiling it if it has not been used before.</summary>
+			/// <returns>The variant of the shader to display sprites with.</returns>
+			static _SpriteShader* get_lit_shader();
+
 			/// <summary>Loads a sprite sheet from file.</summary>
 			/// <param name="path">The path to the image file, from the res/img/world/ folder.</param>
 			Flat3DPixelSpriteSheet(const char* path);
@@ -47,18 +81,91 @@ namespace onion
 			/// <summary>Displays a sprite from the sprite sheet.</summary>
 			/// <param name="sprite">The sprite to display.</param>
 			virtual void display(const Sprite* sprite) const;
+
+			/// <summary>Appends the vertices of a sprite to a buffer, transformed ahead of time.</summary>
+			/// <param name="sprite">The sprite to append.</param>
+			/// <param name="transform">The transformation to apply to the position and normal vector of each vertex.</param>
+			/// <param name="data">The buffer to append the vertices to.</param>
+			void transform(const Sprite* sprite, const TransformMatrix& transform, buffer_t* data) const;
+
+			/// <summary>Displays a buffer of sprites that were transformed ahead of time.</summary>
+			/// <param name="displayer">Displays the buffer of transformed sprites.</param>
+			/// <param name="count">The number of sprites in the buffer.</param>
+			void display_batch(const opengl::_VertexBufferDisplayer* displayer, Int count) const;
+		};
+
+
+		// Static geometry from many graphics, transformed ahead of time and merged into a single buffer for each sprite sheet.
+		class StaticGraphicBatch
+		{
+		private:
+			// The merged sprites from a single sprite sheet.
+			struct Batch
+			{
+				// The sprite sheet that the sprites are on.
+				const Flat3DPixelSpriteSheet* sprite_sheet;
+
+				// The transformed vertices waiting to be uploaded. NULL once they have been.
+				Flat3DPixelSpriteSheet::buffer_t* data;
+
+				// Used to display the uploaded vertices. NULL until they have been uploaded.
+				opengl::_VertexBufferDisplayer* displayer = nullptr;
+
+				// The number of sprites in the batch.
+				Int count = 0;
+
+				/// <summary>Constructs an empty batch.</summary>
+				/// <param name="sprite_sheet">The sprite sheet that the sprites are on.</param>
+				Batch(const Flat3DPixelSpriteSheet* sprite_sheet);
+			};
+
+			// A batch for each sprite sheet used.
+			std::vector<Batch> m_Batches;
+
+			// True once the batches have been uploaded, after which nothing else can be merged into them.
+			bool m_Uploaded = false;
+
+		public:
+			/// <summary>Frees all batches.</summary>
+			~StaticGraphicBatch();
+
+			/// <summary>Merges a sprite into the batch for its sprite sheet. Makes no OpenGL calls, so it can run on a worker thread.
+			/// Translucent sprites are never merged, since the batches are displayed without blending.</summary>
+			/// <param name="sprite_sheet">The sprite sheet that the sprite is on.</param>
+			/// <param name="sprite">The sprite to merge.</param>
+			/// <param name="transform">The transformation from the sprite to world coordinates.</param>
+			/// <returns>True if the sprite was merged, false if the sprite is translucent or the batches have already been uploaded.</returns>
+			bool add(const Flat3DPixelSpriteSheet* sprite_sheet, const Sprite* sprite, const TransformMatrix& transform);
+
+			/// <summary>Checks whether the batches have been uploaded.</summary>
+			/// <returns>True if the batches have been uploaded, false otherwise.</returns>
+			bool is_uploaded() const;
+
+			/// <summary>Uploads every batch. Must be called from the render thread.</summary>
+			/// <returns>The approximate number of bytes uploaded.</returns>
+			Uint upload();
+
+			/// <summary>Frees every batch, so that sprites can be merged again.</summary>
+			void clear();
+
+			/// <summary>Displays every uploaded batch, with one draw call for each sprite sheet.</summary>
+			void display() const;
 		};
 
 		// A sprite shader that does NOT use dither shading, that samples a normal vector from an image.
 		class Textured3DPixelSpriteSheet : public PixelSpriteSheet<FLOAT_MAT4X2, FLOAT_MAT4, Int>
 		{
 		protected:
-			// The shader program for the sprite sheet.
-			static _SpriteShader* m_Textured3DPixelShader;
+			// The variants of the shader program for the sprite sheet, for each combination of lights.
+			static ShaderPermutations<FLOAT_MAT4, FLOAT_MAT4X2, FLOAT_MAT4, Int>* m_Textured3DPixelShaders;
 
 			// Manages the textures on the sprite sheet.
 			_TextureManager m_TextureManager;
 
+			/// <summary>Retrieves the variant of the shader that fits the lights in view.</summary>
+			/// <returns>The shader to activate when displaying a sprite.</returns>
+			_SpriteShader* __get_display_shader() const;
+
 			/// <summary>Loads vertex attribute data from a line in a meta file.</summary>
 			/// <param name="id">The ID associated with the line of data.</param>
 			/// <param name="line">The line of data from the meta file.</param>
@@ -72,6 +179,10 @@ namespace onion
 			/// <returns>A shader that only takes two image keys as arguments.</returns>
 			static _SpriteShader* get_shader();
 
+			/// <summary>Gets the variant of the shader that fits the lights in view, compiling it if it has not been used before.</summary>
+			/// <returns>The variant of the shader to display sprites with.</returns>
+			static _SpriteShader* get_lit_shader();
+
 			/// <summary>Loads a sprite sheet from file.</summary>
 			/// <param name="path">The path to the image file, from the res/img/world/ folder.</param>
 			Textured3DPixelSpriteSheet(const char* path);
@@ -132,6 +243,16 @@ namespace onion
 			/// <summary>Displays the wall.</summary>
 			/// <param name="normal">A vector pointing towards the camera.</param>
 			virtual void display(const vec3i& normal) const;
+
+			/// <summary>Merges the wall into a batch of static geometry.</summary>
+			/// <param name="batch">The batch to merge the wall into.</param>
+			/// <param name="pos">The position of the object that the wall belongs to.</param>
+			/// <returns>True if the wall was merged into the batch, false otherwise.</returns>
+			virtual bool batch(StaticGraphicBatch& batch, const vec3i& pos) const;
+
+			/// <summary>Checks whether the sprite of the wall has partially transparent pixels.</summary>
+			/// <returns>True if the sprite is translucent, false otherwise.</returns>
+			virtual bool is_translucent() const;
 		};
 
 		// A wall sprite with an arbitrary two-dimensional normal vector.
@@ -158,6 +279,12 @@ namespace onion
 			/// <summary>Displays the wall.</summary>
 			/// <param name="normal">A vector pointing towards the camera.</param>
 			virtual void display(const vec3i& normal) const;
+
+			/// <summary>Merges the wall into a batch of static geometry.</summary>
+			/// <param name="batch">The batch to merge the wall into.</param>
+			/// <param name="pos">The position of the object that the wall belongs to.</param>
+			/// <returns>True if the wall was merged into the batch, false otherwise.</returns>
+			virtual bool batch(StaticGraphicBatch& batch, const vec3i& pos) const;
 		};
 
 
@@ -192,6 +319,10 @@ namespace onion
 			/// <summary>Displays the sprite using the current index.</summary>
 			/// <param name="normal">A vector pointing towards the camera.</param>
 			virtual void display(const vec3i& normal) const;
+
+			/// <summary>Checks whether the current sprite, the texture, or the colors of the palette have partially transparent pixels.</summary>
+			/// <returns>True if the graphic is translucent, false otherwise.</returns>
+			virtual bool is_translucent() const;
 		};
 
 
@@ -231,6 +362,15 @@ namespace onion
 				// Clean up
 				Transform::model.pop();
 			}
+
+			/// <summary>Keeps the graphic out of batches of static geometry, since it turns to face the camera, by falling back to the default for graphics that cannot be batched.</summary>
+			/// <param name="batch">The batch of static geometry.</param>
+			/// <param name="pos">The position of the object that the graphic belongs to.</param>
+			/// <returns>False.</returns>
+			virtual bool batch(StaticGraphicBatch& batch, const vec3i& pos) const
+			{
+				return Graphic3D::batch(batch, pos);
+			}
 		};
 
 		typedef _BillboardedGraphic3D<FlatWallGraphic3D> BillboardedFlatWallGraphic3D;
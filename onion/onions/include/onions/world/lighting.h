@@ -8,7 +8,14 @@
 namespace onion
 {
 
-#define MAX_NUMBER_CUBE_LIGHTS 8
+// The width and height of each cell in the grid that lights are sorted into, in pixel coordinates.
+#define ONION_LIGHT_CLUSTER_SIZE 32
+
+// The maximum number of cells in the grid that lights are sorted into. If the lights span more cells than this, the cells are made larger.
+#define ONION_MAX_LIGHT_CLUSTERS 4096
+
+// The number of shader permutations for each light array. Each array picks the smallest of 0, 2, 4, or 8 lights per cell that fits its busiest cell, or an unbounded loop if none do.
+#define ONION_LIGHT_PERMUTATIONS 5
 	
 
 	class Lighting
@@ -17,11 +24,14 @@ namespace onion
 		// The uniform buffer that stores data used to calculate lights.
 		static opengl::_UniformBuffer* m_Buffer;
 
+		// An array of lights sorted into a grid.
+		struct _LightArray;
+
 	public:
 		struct Light
 		{
-			// The prefix for the name of the light in the buffer.
-			std::string prefix;
+			// The array that the light is in, or NULL if the light is not being used.
+			_LightArray* array = nullptr;
 
 
 			// The diffuse color of the light.
@@ -34,33 +44,63 @@ namespace onion
 			Int radius;
 
 
-			/// <summary>Sets a single uniform in the buffer.</summary>
-			/// <param name="name">The name of the uniform.</param>
-			/// <param name="value">The value of the uniform.</param>
-			template <typename T>
-			void set(const char* name, const T& value) const
-			{
-				if (!prefix.empty())
-				{
-					m_Buffer->set<T>(prefix + name, value);
-				}
-			}
+			// The difference between the intensity and the minimum intensity that the light flickers down to. Zero if the light does not flicker.
+			Float flicker_differential = 0.f;
+
+			// The probability that, on any frame, the light will have intensity less than or equal to the median intensity.
+			Float flicker_probability = 0.5f;
+
+			// The seed that the shaders hash with the frame, so that lights flicker independently of each other.
+			Int flicker_seed = 0;
+
+
+			/// <summary>Marks the light as changed, so that its data is uploaded again before the next frame.</summary>
+			void reset() const;
 
-			/// <summary>Resets all uniforms in the buffer.</summary>
-			virtual void reset() const;
+			/// <summary>Appends the data for the light to the texels of a buffer. The first texel stores the minimum intensity, the flicker differential, the flicker probability, and the seed.</summary>
+			/// <param name="texels">Four floats for each texel in the buffer.</param>
+			virtual void write(std::vector<float>& texels) const;
+
+			/// <summary>Retrieves the horizontal bounds of the area that the light can illuminate.</summary>
+			/// <param name="mins">Outputs the corner with minimum values, in pixel coordinates.</param>
+			/// <param name="maxs">Outputs the corner with maximum values, in pixel coordinates.</param>
+			virtual void get_bounds(vec2f& mins, vec2f& maxs) const = 0;
 		};
 
 	private:
-		// An array of lights in the lighting buffer.
+		// An array of lights, uploaded as a buffer of light data and a grid of cells listing the lights that reach each cell.
 		struct _LightArray
 		{
-			// The maximum number of lights that can be stored in the array.
-			const Int max_size;
+			// The buffer storing the data for each light.
+			opengl::_TextureBuffer* const records;
+
+			// The buffer storing the grid. It starts with the origin and number of cells in each direction and the size of each cell, followed by the index where each cell's list starts, followed by the lists of light indices.
+			opengl::_TextureBuffer* const clusters;
+
+			// The lights currently in the array.
+			std::vector<Light*> elements;
+
+			// True if the lights have changed since the array was last uploaded.
+			bool changed;
+
+			// The name of the preprocessor definition that tells shaders the most lights in any cell of the grid.
+			const std::string define_name;
+
+			// The permutation picked for the most lights in any cell of the grid, the last time the array was uploaded.
+			Int permutation;
 
+			// The size of each cell of the grid, in pixels, the last time the array was uploaded.
+			int cell_size;
 
-			/// <summary>Constructs a light array with the given maximum size.</summary>
-			/// <param name="max_size">The maximum number of lights that can be in the array.</param>
-			_LightArray(Int max_size) : max_size(max_size) {}
+			// The cells of the grid, counted from the origin of the world, that listed a flickering light the last time the array was uploaded.
+			std::vector<vec2i> flickering_cells;
+
+
+			/// <summary>Constructs an empty light array.</summary>
+			/// <param name="array_name">The name of the sampler storing the data for the lights.</param>
+			/// <param name="cluster_name">The name of the sampler storing the grid of lights.</param>
+			/// <param name="define_name">The name of the preprocessor definition for the most lights in any cell.</param>
+			_LightArray(std::string array_name, std::string cluster_name, std::string define_name);
 
 
 			/// <summary>Adds the light to the array.</summary>
@@ -69,52 +109,27 @@ namespace onion
 
 			/// <summary>Removes the light from the array.</summary>
 			/// <param name="light">The light to remove.</param>
-			virtual bool remove(Light* light) = 0;
+			bool remove(Light* light);
+
+			/// <summary>Sorts the lights into the grid and uploads the data for the lights and the grid.</summary>
+			void upload();
+
+			/// <summary>Checks whether any flickering light reaches a cell of the grid that overlaps an area.</summary>
+			/// <param name="mins">The corner of the area with minimum values, in pixel coordinates.</param>
+			/// <param name="maxs">The corner of the area with maximum values, in pixel coordinates.</param>
+			/// <returns>True if a cell overlapping the area listed a flickering light the last time the array was uploaded, false otherwise.</returns>
+			bool flickers_within(const vec2f& mins, const vec2f& maxs) const;
 		};
 		
-		// An array of lights in the lighting buffer.
+		// An array of lights of a single type.
 		template <typename T>
 		struct LightArray : public _LightArray
 		{
-			// The name of the array in the buffer.
-			const std::string array_name;
-
-			// The name of the array size in the buffer.
-			const std::string count_name;
-
-
-			// The lights currently set to the buffer.
-			std::vector<T*> elements;
-
-
-			/// <summary>Constructs a light array with the given maximum size.</summary>
-			/// <param name="array_name">The name for the uniform storing the data for the lights.</param>
-			/// <param name="count_name">The name for the uniform storing the size of the array.</param>
-			/// <param name="max_size">The maximum number of lights that can be in the array.</param>
-			LightArray(std::string array_name, std::string count_name, Int max_size) : array_name(array_name), count_name(count_name), _LightArray(max_size)
-			{
-				elements.reserve(max_size);
-			}
-
-			/// <summary>Sets the light at the specified index.</summary>
-			/// <param name="index">The index of the light.</param>
-			/// <param name="light">The data for the light.</param>
-			void set(Int index, T* light)
-			{
-				if (index >= elements.size())
-				{
-					elements.resize(index + 1);
-					m_Buffer->set<Int>(count_name, elements.size());
-				}
-				else
-				{
-					elements[index]->prefix = "";
-				}
-
-				elements[index] = light;
-				light->prefix = array_name + "[" + std::to_string(index) + "].";
-				light->reset();
-			}
+			/// <summary>Constructs an empty light array.</summary>
+			/// <param name="array_name">The name of the sampler storing the data for the lights.</param>
+			/// <param name="cluster_name">The name of the sampler storing the grid of lights.</param>
+			/// <param name="define_name">The name of the preprocessor definition for the most lights in any cell.</param>
+			LightArray(std::string array_name, std::string cluster_name, std::string define_name) : _LightArray(array_name, cluster_name, define_name) {}
 
 			/// <summary>Adds the light to the array.</summary>
 			/// <param name="light">The light to add.</param>
@@ -122,54 +137,15 @@ namespace onion
 			{
 				if (T* ptr = dynamic_cast<T*>(light)) // Check that the light is the correct type
 				{
-					for (int k = 0; k <= elements.size(); ++k)
-					{
-						if (k >= max_size)
-						{
-							// Don't add the light if it would cause the array to exceed the maximum size
-							return false;
-						}
-						else if (k == elements.size())
-						{
-							// Push the light to the back of the array
-							set(k, ptr);
-							return true;
-						}
-						else if (elements[k] == ptr)
-						{
-							// Reset the data for the light
-							ptr->reset();
-							return true;
-						}
-					}
-				}
-
-				return false;
-			}
-
-			/// <summary>Removes the light from the array.</summary>
-			/// <param name="light">The light to remove.</param>
-			bool remove(Light* light)
-			{
-				if (T* ptr = dynamic_cast<T*>(light)) // Check that the light is the correct type
-				{
-					for (int k = elements.size() - 1; k >= 0; --k)
+					if (ptr->array != this)
 					{
-						if (elements[k] == ptr)
-						{
-							// If the light being removed isn't at the back, move the light that is at the back to replace the light being removed
-							if (k < elements.size() - 1)
-								set(k, elements.back());
-
-							// Resize the array
-							elements.pop_back();
-							m_Buffer->set<Int>(count_name, elements.size());
-
-							return true;
-						}
+						// Push the light to the back of the array
+						ptr->array = this;
+						elements.push_back(ptr);
 					}
 
-					return false;
+					changed = true;
+					return true;
 				}
 
 				return false;
@@ -179,20 +155,101 @@ namespace onion
 		// All light arrays.
 		static std::vector<_LightArray*> m_LightArrays;
 
+		// The key of the shader permutation that fits the lights uploaded for the current frame.
+		static Int m_Permutation;
+
+		// The preprocessor definitions of the shader permutation that fits the lights uploaded for the current frame.
+		static std::string m_PermutationDefines;
+
+		// The number of shader permutations for every combination of light arrays. Used as the key of the variant that writes to the geometry buffer.
+		static Int m_PermutationCount;
+
+		// The most lights that can reach any cell of the grid. The dimmest lights are dropped from cells with more. Negative if there is no limit.
+		static Int m_MaxClusterLights;
+
+		// The number of frames that flickering lights hold each intensity for.
+		static Int m_FlickerInterval;
+
+		// The frame that flickering lights were last animated with.
+		static Int m_FlickerFrame;
+
+		// The corner with minimum values of the area that the camera can see, in pixel coordinates.
+		static vec2f m_VisibleMins;
+
+		// The corner with maximum values of the area that the camera can see, in pixel coordinates.
+		static vec2f m_VisibleMaxs;
+
+
+		// True if the world is lit with a deferred pass, instead of while each surface is drawn.
+		static bool m_Deferred;
+
+		// True while surfaces are being drawn into the geometry buffer.
+		static bool m_GeometryPass;
+
+		// The buffer that surfaces are drawn into during the deferred path, storing the diffuse color, the normal, and the position of the front surface of every pixel.
+		static opengl::_FrameBuffer* m_FrameBuffer;
+
+		// The variants of the shader that lights every pixel of the geometry buffer.
+		static ShaderPermutations<Int, Int, Int, Int>* m_DeferredShaders;
+
 	public:
 		/// <summary>Initializes the lighting.</summary>
 		static void init();
 
-		/// <summary>Constructs a light array with the given maximum size.</summary>
-		/// <param name="array_name">The name for the uniform storing the data for the lights.</param>
-		/// <param name="count_name">The name for the uniform storing the size of the array.</param>
-		/// <param name="max_size">The maximum number of lights that can be in the array.</param>
+		/// <summary>Constructs a light array.</summary>
+		/// <param name="array_name">The name of the sampler storing the data for the lights.</param>
+		/// <param name="cluster_name">The name of the sampler storing the grid of lights.</param>
+		/// <param name="define_name">The name of the preprocessor definition that shader permutations use for the most lights in any cell.</param>
 		template <typename T>
-		static void add_light_array(std::string array_name, std::string count_name, Int max_size)
+		static void add_light_array(std::string array_name, std::string cluster_name, std::string define_name)
+		{
+			m_LightArrays.push_back(new LightArray<T>(array_name, cluster_name, define_name));
+			m_PermutationCount *= ONION_LIGHT_PERMUTATIONS;
+		}
+
+		/// <summary>Retrieves the variant of a shader that fits the lights uploaded for the current frame, compiling it if it has not been used before.</summary>
+		/// <param name="permutations">The cache of variants of the shader.</param>
+		/// <returns>The variant of the shader to draw with.</returns>
+		template <typename... _Uniforms>
+		static Shader<_Uniforms...>* get_shader(ShaderPermutations<_Uniforms...>* permutations)
 		{
-			m_LightArrays.push_back(new LightArray<T>(array_name, count_name, max_size));
+			if (m_GeometryPass)
+				return permutations->get(m_PermutationCount, "#define ONION_DEFERRED\n");
+			return permutations->get(m_Permutation, m_PermutationDefines);
 		}
 
+		/// <summary>Sets whether the world is lit with a deferred pass. If so, opaque surfaces only store their color, normal, and position, and lighting runs once per pixel after everything has been drawn.</summary>
+		/// <param name="deferred">True to use the deferred path, false to light each surface while it is drawn.</param>
+		static void set_deferred(bool deferred);
+
+		/// <summary>Checks whether the world is lit with a deferred pass.</summary>
+		/// <returns>True if the deferred path is used, false otherwise.</returns>
+		static bool is_deferred();
+
+		/// <summary>Checks whether surfaces are currently being drawn into the geometry buffer.</summary>
+		/// <returns>True between starting and stopping the geometry pass of the deferred path, false otherwise.</returns>
+		static bool is_geometry_pass();
+
+		/// <summary>If the deferred path is used, starts drawing surfaces into the geometry buffer instead of the screen. Must be called from the thread that owns the OpenGL context.</summary>
+		static void begin_geometry_pass();
+
+		/// <summary>If the deferred path is used, stops drawing into the geometry buffer and lights every pixel of it onto the screen. Must be called from the thread that owns the OpenGL context.</summary>
+		static void end_geometry_pass();
+
+
+		/// <summary>Limits how many lights can reach any cell of the grid. The dimmest lights are dropped from cells with more.</summary>
+		/// <param name="max_lights">The most lights in any cell, or a negative number for no limit.</param>
+		static void set_max_cluster_lights(Int max_lights);
+
+		/// <summary>Sets how often flickering lights change intensity.</summary>
+		/// <param name="frames">The number of frames that flickering lights hold each intensity for.</param>
+		static void set_flicker_interval(Int frames);
+
+		/// <summary>Sets the area that the camera can see, so that flickering lights outside of it do not redraw the screen. Everything is visible until this is called.</summary>
+		/// <param name="mins">The corner of the area with minimum values, in pixel coordinates.</param>
+		/// <param name="maxs">The corner of the area with maximum values, in pixel coordinates.</param>
+		static void set_visible_area(const vec2f& mins, const vec2f& maxs);
+
 
 		/// <summary>Sets the ambient lighting.</summary>
 		/// <param name="ambient">The ambient color.</param>
@@ -206,6 +263,9 @@ namespace onion
 		/// <summary>Removes the given light from the scene.</summary>
 		/// <param name="light">A pointer to the light.</param>
 		static void remove(Lighting::Light* light);
+
+		/// <summary>Uploads the current frame, which animates flickering lights, and every light array that has changed since the last frame, then picks the shader permutation that fits the lights. The screen is redrawn if an array changed, or if a flickering light that reaches the visible area changed intensity. Must be called from the thread that owns the OpenGL context.</summary>
+		static void upload();
 	};
 
 
@@ -215,8 +275,14 @@ namespace onion
 		vec3f pos;
 
 
-		/// <summary>Resets all uniforms in the buffer.</summary>
-		virtual void reset() const;
+		/// <summary>Appends the data for the light to the texels of a buffer.</summary>
+		/// <param name="texels">Four floats for each texel in the buffer.</param>
+		virtual void write(std::vector<float>& texels) const;
+
+		/// <summary>Retrieves the horizontal bounds of the area that the light can illuminate.</summary>
+		/// <param name="mins">Outputs the corner with minimum values, in pixel coordinates.</param>
+		/// <param name="maxs">Outputs the corner with maximum values, in pixel coordinates.</param>
+		virtual void get_bounds(vec2f& mins, vec2f& maxs) const;
 	};
 	
 	struct CubeLight : public Lighting::Light
@@ -227,9 +293,24 @@ namespace onion
 		// The corner of the light with maximum values, in pixel coordinates.
 		vec3f maxs;
 
+		// True if the light has been baked into the lightmap of the chunk it lies in, so that flat tiles no longer calculate it.
+		bool baked = false;
+
 
-		/// <summary>Resets all uniforms in the buffer.</summary>
-		virtual void reset() const;
+		/// <summary>Appends the data for the light to the texels of a buffer.</summary>
+		/// <param name="texels">Four floats for each texel in the buffer.</param>
+		virtual void write(std::vector<float>& texels) const;
+
+		/// <summary>Retrieves the horizontal bounds of the area that the light can illuminate.</summary>
+		/// <param name="mins">Outputs the corner with minimum values, in pixel coordinates.</param>
+		/// <param name="maxs">Outputs the corner with maximum values, in pixel coordinates.</param>
+		virtual void get_bounds(vec2f& mins, vec2f& maxs) const;
+
+		/// <summary>Calculates the strength of the light on a point of the ground plane z = 0, the same way that flat tiles are shaded, without dithering.</summary>
+		/// <param name="x">The x-coordinate of the point, in pixel coordinates.</param>
+		/// <param name="y">The y-coordinate of the point, in pixel coordinates.</param>
+		/// <returns>The strength that the color of the light is multiplied by.</returns>
+		Float get_ground_strength(Float x, Float y) const;
 	};
 
 	struct ConeLight : public Lighting::Light
@@ -244,8 +325,14 @@ namespace onion
 		Float angle;
 
 
-		/// <summary>Resets all uniforms in the buffer.</summary>
-		virtual void reset() const;
+		/// <summary>Appends the data for the light to the texels of a buffer.</summary>
+		/// <param name="texels">Four floats for each texel in the buffer.</param>
+		virtual void write(std::vector<float>& texels) const;
+
+		/// <summary>Retrieves the horizontal bounds of the area that the light can illuminate.</summary>
+		/// <param name="mins">Outputs the corner with minimum values, in pixel coordinates.</param>
+		/// <param name="maxs">Outputs the corner with maximum values, in pixel coordinates.</param>
+		virtual void get_bounds(vec2f& mins, vec2f& maxs) const;
 	};
 
 
@@ -271,6 +358,10 @@ namespace onion
 			/// <returns>A pointer to the data about the light.</returns>
 			virtual Lighting::Light* get_light() = 0;
 
+			/// <summary>Moves the light object, along with the data about the light.</summary>
+			/// <param name="trans">The translation, in pixel coordinates.</param>
+			virtual void translate(const vec3i& trans);
+
 			/// <summary>Toggles whether the light is being used or not.<summary>
 			/// <param name="on">True if the light should be activated, false if it should be turned off.</param>
 			virtual void toggle(bool on);
@@ -296,6 +387,10 @@ namespace onion
 			/// <summary>Retrieves a pointer to the data about the light.</summary>
 			/// <returns>A pointer to the data about the light.</returns>
 			Lighting::Light* get_light();
+
+			/// <summary>Moves the light object, along with the corners of the light.</summary>
+			/// <param name="trans">The translation, in pixel coordinates.</param>
+			virtual void translate(const vec3i& trans);
 		};
 
 		// A generator for a cube light.
@@ -346,6 +441,10 @@ namespace onion
 			/// <summary>Retrieves a pointer to the data about the light.</summary>
 			/// <returns>A pointer to the data about the light.</returns>
 			Lighting::Light* get_light();
+
+			/// <summary>Moves the light object, along with the apex of the cone.</summary>
+			/// <param name="trans">The translation, in pixel coordinates.</param>
+			virtual void translate(const vec3i& trans);
 		};
 
 		// A generator for a cone light.
@@ -377,43 +476,18 @@ namespace onion
 
 
 		template <typename T>
-		class _FlickeringLightObject : public T, public UpdateListener
+		class _FlickeringLightObject : public T
 		{
-		protected:
-			// The minimum possible intensity for the light.
-			Float m_IntensityMinimum;
-
-			// The difference between the maximum and minimum intensity for the light.
-			Float m_IntensityDifferential;
-
-			// The probability that, on any frame, the light will have intensity less than or equal to the median intensity.
-			Float m_Probability;
-
-			/// <summary>Sets the intensity of the light to a random value between the minimum and maximum.</summary>
-			/// <param name="frames_passed">The number of frames since the last update call.</param>
-			virtual void update(int frames_passed)
-			{
-				Float r = (rand() % 100) * 0.01f;
-				m_Light.intensity = m_IntensityMinimum + (m_IntensityDifferential *
-					(cbrt(r - m_Probability) + cbrt(m_Probability)) / (cbrt(1 - m_Probability) + cbrt(m_Probability))
-				);
-				m_Light.set<Float>("intensity", m_Light.intensity);
-			}
-
 		public:
-			/// <summary>Constructs a light object that flickers between intensities.</summary>
+			/// <summary>Constructs a light object that flickers between intensities. The flicker is calculated by the shaders from the light's data, so it is never updated from the CPU. Chunks seed the flicker when they load the light.</summary>
 			/// <param name="minimum_intensity">The minimum intensity of the light.</param>
 			/// <param name="probability">The probability that, on any frame, the light will have intensity less than or equal to the median intensity of the light.</param>
 			/// <param name="args">The other arguments passed to the light.</param>
 			template <typename... _Args>
 			_FlickeringLightObject(Float minimum_intensity, Float probability, const _Args&... args) : T(args...)
 			{
-				m_IntensityMinimum = minimum_intensity;
-				m_IntensityDifferential = m_Light.intensity - minimum_intensity;
-				m_Probability = probability;
-
-				// TODO make it so that only unfreezes when visible??
-				unfreeze(INT_MIN);
+				this->m_Light.flicker_differential = this->m_Light.intensity - minimum_intensity;
+				this->m_Light.flicker_probability = probability;
 			}
 		};
 
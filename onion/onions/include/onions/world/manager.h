@@ -1,7 +1,15 @@
 #pragma once
 #include <set>
+#include <vector>
 #include "lighting.h"
 #include "agent.h"
+#include "tree.h"
+
+// The maximum number of times a moving actor slides along a surface it hit in a single update.
+#define ONION_WORLD_MAX_SLIDE_ITERATIONS	3
+
+// The number of consecutive actors whose agents are updated together on one worker thread.
+#define ONION_WORLD_ACTOR_UPDATE_BATCH		8
 
 namespace onion
 {
@@ -10,33 +18,67 @@ namespace onion
 
 		class ObjectManager
 		{
+		public:
+			// Counts how many candidate pairs were considered and rejected at each stage of collision detection.
+			struct CollisionCounters
+			{
+				// The number of non-empty blocks whose bounds overlapped the bounding box of a tested object.
+				Uint blocks_visited = 0;
+
+				// The number of static objects tested against a moving object.
+				Uint pairs_tested = 0;
+
+				// The number of other actors whose fattened boxes overlapped the volume swept by a moving actor.
+				Uint actor_pairs_tested = 0;
+
+				// The number of pairs rejected because their bounding boxes did not overlap, without running GJK.
+				Uint pairs_rejected_by_bounds = 0;
+
+				// The number of pairs whose bounding boxes overlapped, but were rejected by GJK.
+				Uint pairs_rejected_by_gjk = 0;
+
+				// The number of pairs that collided.
+				Uint collisions = 0;
+			};
+
+			// The result of sweeping an actor along a translation.
+			struct SweepResult
+			{
+				// The fraction of the translation completed before the first contact. Equal to 1 if nothing was hit.
+				Frac time;
+
+				// The part of the translation that can be completed without touching anything, in subpixel units.
+				vec3i translation;
+
+				// The normal of the surface that was hit first, pointing back towards the actor. Zero if nothing was hit. If the actor already overlapped the object it hit, the normal is along the axis that it overlapped the least along.
+				vec3i normal;
+			};
+
 		private:
 			// A cube that stores all lights that should be turned on when the cube is displayed.
 			struct Block
 			{
+				// The index of the block.
+				vec3i index;
+
 				// The cubic shape of the block.
 				OrthogonalPrism cube;
 
-				// All static objects within the block.
-				std::unordered_set<Object*> objects;
+				// The position of the first static object within the block, in the array of block objects.
+				Uint objects_begin = 0;
 
-				// All lights that illuminate a point within the block.
-				std::unordered_set<LightObject*> lights;
+				// The number of static objects within the block.
+				Uint objects_count = 0;
 
-				/// <summary>Constructs a block and inserts a light object into it.</summary>
-				/// <param name="pos">The position of the block.</param>
-				/// <param name="obj">The first light object to insert.</param>
-				Block(const vec3i& pos, Object* obj);
+				// The position of the first light that illuminates a point within the block, in the array of block lights.
+				Uint lights_begin = 0;
 
-				/// <summary>Constructs a block and inserts a light object into it.</summary>
-				/// <param name="pos">The position of the block.</param>
-				/// <param name="obj">The first light object to insert.</param>
-				Block(const vec3i& pos, LightObject* obj);
+				// The number of lights that illuminate a point within the block.
+				Uint lights_count = 0;
 
-				/// <summary>Tests whether the given object has any collisions with an object inside the block.</summary>
-				/// <param name="obj">The object to test.</param>
-				/// <returns>True if there is a collision and the object needs to be reset to its original position, false otherwise.</returns>
-				bool collision(Object* obj);
+				/// <summary>Constructs an empty block.</summary>
+				/// <param name="index">The index of the block.</param>
+				Block(const vec3i& index);
 			};
 
 			// The dimensions of each block.
@@ -45,13 +87,53 @@ namespace onion
 			// The maximum z-coordinate inspected.
 			static Int m_UpperBound;
 
-			// A map of all stored blocks.
-			std::unordered_map<vec3i, Block*, std::hash<INT_VEC3>> m_Blocks;
+			// All stored blocks, packed contiguously in the order they were created.
+			std::vector<Block> m_Blocks;
+
+			// An open-addressing hash table from block indices to positions in m_Blocks, with -1 marking an empty slot. The size is always zero or a power of two.
+			std::vector<Int> m_BlockTable;
+
+			// All static objects within each block, grouped by block. Each block owns a contiguous range.
+			std::vector<Object*> m_BlockObjects;
+
+			// All lights that illuminate each block, grouped by block. Each block owns a contiguous range.
+			std::vector<LightObject*> m_BlockLights;
+
+			// Pairs of block positions and static objects that have been inserted since the block ranges were last built.
+			std::vector<std::pair<Int, Object*>> m_PendingObjects;
+
+			// Pairs of block positions and lights that have been inserted since the block ranges were last built.
+			std::vector<std::pair<Int, LightObject*>> m_PendingLights;
+
+			// Lights that have been added since the block ranges were last built, and have not been assigned to any blocks yet.
+			std::vector<LightObject*> m_UnassignedLights;
+
+			/// <summary>Retrieves the slot in the hash table where the block with the given index is, or should be, stored.</summary>
+			/// <param name="index">The index of the block.</param>
+			/// <returns>The slot in the hash table.</returns>
+			Uint __find_slot(const vec3i& index) const;
 
 			/// <summary>Retrieves the block with the specified index.</summary>
 			/// <param name="index">The index of the block to retrieve.</param>
-			/// <returns>A pointer to the block.</returns>
-			Block* get_block(const vec3i& index);
+			/// <returns>The position of the block in m_Blocks, or -1 if there is no block with that index.</returns>
+			Int get_block(const vec3i& index) const;
+
+			/// <summary>Retrieves the block with the specified index, constructing it if it does not exist yet.</summary>
+			/// <param name="index">The index of the block to retrieve.</param>
+			/// <returns>The position of the block in m_Blocks.</returns>
+			Int get_or_create_block(const vec3i& index);
+
+			/// <summary>Merges pending block memberships into the contiguous ranges owned by each block.</summary>
+			/// <param name="pending">The pending pairs of block positions and members. Emptied by this function.</param>
+			/// <param name="members">The contiguous array of members, grouped by block.</param>
+			/// <param name="begin">The field of each block storing where its range begins.</param>
+			/// <param name="count">The field of each block storing the length of its range.</param>
+			template <typename T>
+			void __build(std::vector<std::pair<Int, T*>>& pending, std::vector<T*>& members, Uint Block::* begin, Uint Block::* count);
+
+			/// <summary>Assigns every unassigned light to all blocks it illuminates, in one sweep.
+			/// The range of blocks is found from the light's bounding box grown by its radius, then each block in range is kept if its squared distance from the bounding box is less than the squared radius, using integer math.</summary>
+			void __assign_lights();
 
 			/// <summary>Tests whether the object intersects with the block with the specified index.</summary>
 			/// <param name="index">The index of the block to be tested.</param>
@@ -59,6 +141,40 @@ namespace onion
 			/// <returns>True if the object intersects the block, false if it does not.</returns>
 			bool contains(const vec3i& index, Object* obj) const;
 
+			/// <summary>Tests whether the given object has any collisions with a static object inside a block.</summary>
+			/// <param name="block">The block to test against.</param>
+			/// <param name="obj">The object to test.</param>
+			/// <returns>True if there is a collision and the object needs to be reset to its original position, false otherwise.</returns>
+			bool collision(const Block& block, Object* obj);
+
+			// Counters for the collision tests run during the last update pass.
+			CollisionCounters m_Counters;
+
+			// The earliest impact found while sweeping an actor.
+			struct Impact
+			{
+				// True if anything has been hit.
+				bool hit = false;
+
+				// The numerator of the time of impact.
+				long long numerator = 1;
+
+				// The denominator of the time of impact.
+				long long denominator = 1;
+
+				// The axis of the surface that was hit. If the actor already overlapped what it hit, the axis that it overlapped the least along.
+				int axis = -1;
+			};
+
+			/// <summary>Tests an object against the volume swept by an actor, replacing the impact if the object is hit earlier.</summary>
+			/// <param name="actor">The actor being moved.</param>
+			/// <param name="trans">The desired translation of the actor, in subpixel units.</param>
+			/// <param name="start">The minimum corner of the actor, in subpixel units.</param>
+			/// <param name="swept">The volume that the actor sweeps through.</param>
+			/// <param name="other">The object to test.</param>
+			/// <param name="impact">The earliest impact found so far.</param>
+			void __sweep(Actor* actor, const vec3i& trans, const long long* start, const SweptShape& swept, Object* other, Impact& impact);
+
 			/// <summary>Tests whether the object has any collisions with another object being managed.</summary>
 			/// <param name="obj">The object being tested.</param>
 			/// <returns>True if there is a collision and the object needs to be reset to its original position, false otherwise.</returns>
@@ -73,8 +189,17 @@ namespace onion
 			bool __insert(const vec3i& base_index, T* obj);
 
 
-			// The objects that move around.
-			std::unordered_set<Actor*> m_Actors;
+			// The objects that move around, sorted by ID.
+			std::vector<Actor*> m_Actors;
+
+			// The desired translation of each actor during the current update pass, in the same order as the actors.
+			std::vector<vec3i> m_Translations;
+
+			// The fattened bounding boxes of every actor, used to find actors near a moving object.
+			BoundingBoxTree m_ActorTree;
+
+			// Managers of neighbouring areas, whose objects are also tested when sweeping an actor.
+			std::vector<ObjectManager*> m_Neighbours;
 
 
 			// Struct that compares two objects and determines which should be displayed in front of the other.
@@ -97,11 +222,14 @@ namespace onion
 			// A set of all lights that were activated the last time an update pass was run.
 			std::unordered_set<LightObject*> m_ActiveLights;
 
+			// The graphics of static objects that never change, merged into one buffer for each sprite sheet.
+			StaticGraphicBatch m_Batch;
+
 		public:
 			/// <summary>Constructs an empty object manager.</summary>
 			ObjectManager();
 			
-			/// <summary>Deletes all blocks constructed for this manager.</summary>
+			/// <summary>Deletes all objects being managed.</summary>
 			~ObjectManager();
 
 
@@ -110,18 +238,63 @@ namespace onion
 			template <typename T>
 			void add(T* obj);
 
+			/// <summary>Stops managing an actor, without deleting it.</summary>
+			/// <param name="actor">The actor to remove.</param>
+			void remove(Actor* actor);
+
+			/// <summary>Retrieves every actor being managed.</summary>
+			/// <returns>A const reference to the actors, sorted by ID.</returns>
+			const std::vector<Actor*>& get_actors() const;
+
+			/// <summary>Sets the managers of neighbouring areas. Actors moved by this manager will also collide with the objects and actors in those managers.</summary>
+			/// <param name="neighbours">The neighbouring managers.</param>
+			void set_neighbours(const std::vector<ObjectManager*>& neighbours);
+
+			/// <summary>Rebuilds the contiguous object and light ranges of every block from anything added since the last build. Should be called once all objects in a chunk have been loaded.</summary>
+			void build();
+
+			/// <summary>Uploads the merged graphics of every static object added so far. Static objects added afterwards are displayed individually. Must be called from the render thread.</summary>
+			/// <returns>The approximate number of bytes uploaded.</returns>
+			Uint upload_batch();
+
+			/// <summary>Frees the merged graphics of static objects.</summary>
+			void clear_batch();
+
 
 			/// <summary>Resets what is visible, in response to a change in the camera view.</summary>
 			/// <param name="view">The geometry of what is visible.</param>
 			void reset_visible(const WorldCamera* view);
 
-			/// <summary>Updates which dynamic objects are visible, in response to the passage of time.</summary>
+			/// <summary>Updates which dynamic objects are visible, in response to the passage of time.
+			/// The agents of all actors are updated in parallel, then actors are moved one at a time in order of their IDs, so the result does not depend on how many threads are used.</summary>
 			/// <param name="view">The geometry of what is visible.</param>
 			void update_visible(const WorldCamera* view, int frames_passed);
 
-			/// <summary>Displays all visible managed objects.</summary>
+			/// <summary>Sweeps an actor along a translation, finding the first static object or other actor that it would collide with, in this manager or a neighbouring one.
+			/// The time of impact and contact normal are found from the bounding boxes, so they are exact for shapes aligned with the Cartesian planes and conservative otherwise.
+			/// Contacts are confirmed with GJK against the volume that the actor sweeps.</summary>
+			/// <param name="actor">The actor being moved.</param>
+			/// <param name="trans">The desired translation of the actor, in subpixel units.</param>
+			/// <param name="result">Outputs the time of impact, the translation that can be completed, and the contact normal.</param>
+			/// <returns>True if the actor would collide with something before completing the translation, false otherwise.</returns>
+			bool sweep(Actor* actor, const vec3i& trans, SweepResult& result);
+
+			/// <summary>Finds every actor that intersects a shape, such as the bounds of a trigger or of another actor.</summary>
+			/// <param name="shape">The shape to test against. An actor whose bounds are this shape is skipped.</param>
+			/// <param name="actors">Appended with every actor that intersects the shape.</param>
+			void get_actors(const Shape* shape, std::vector<Actor*>& actors) const;
+
+			/// <summary>Retrieves how many collision pairs were rejected at each stage during the last update pass.</summary>
+			/// <returns>A const reference to the collision counters.</returns>
+			const CollisionCounters& get_collision_counters() const;
+
+			/// <summary>Displays all visible opaque and alpha-tested objects front to back without blending. Displays every object during the geometry pass.</summary>
+			/// <param name="normal">The direction facing towards the camera.</param>
+			void display_opaque(const vec3i& normal) const;
+
+			/// <summary>Displays all visible translucent objects back to front, without writing depth. Must be called after the opaque objects of every chunk have been displayed.</summary>
 			/// <param name="normal">The direction facing towards the camera.</param>
-			void display(const vec3i& normal) const;
+			void display_translucent(const vec3i& normal) const;
 		};
 
 	}
@@ -1,4 +1,5 @@
 #pragma once
+#include <mutex>
 #include "../graphics/graphic.h"
 #include "graphic.h"
 #include "camera.h"
@@ -18,6 +19,9 @@ namespace onion
 			// The graphic used to display the object.
 			Graphic3D* m_Graphic;
 
+			// True if the graphic has been merged into a batch of static geometry, and should not be displayed by itself.
+			bool m_Batched = false;
+
 			/// <summary>Responds to another object colliding with this one.</summary>
 			/// <param name="obj">The object that collided with this one.</param>
 			/// <returns>True if the object should be pushed back, false otherwise.</returns>
@@ -47,6 +51,25 @@ namespace onion
 			/// <returns>True if the object needs to be pushed back.</returns>
 			bool collision(Object* obj);
 
+			/// <summary>Checks if an object would intersect with this one, if its bounds were replaced with the given shape.</summary>
+			/// <param name="obj">The object to check.</param>
+			/// <param name="bounds">The shape to test in place of the object's bounds, such as the volume it sweeps while moving.</param>
+			/// <returns>True if the object needs to be pushed back.</returns>
+			bool collision(Object* obj, const Shape* bounds);
+
+
+			/// <summary>Merges the object's graphic into a batch of static geometry, if the graphic never changes.</summary>
+			/// <param name="batch">The batch to merge the graphic into.</param>
+			/// <returns>True if the graphic was merged into the batch, false otherwise.</returns>
+			bool batch(StaticGraphicBatch& batch);
+
+			/// <summary>Checks whether the object's graphic has been merged into a batch of static geometry.</summary>
+			/// <returns>True if the graphic is displayed as part of a batch, false if the object must be displayed by itself.</returns>
+			bool is_batched() const;
+
+			/// <summary>Checks whether the object's graphic has partially transparent pixels, and must be displayed back to front with blending.</summary>
+			/// <returns>True if the object is translucent, false if it can be displayed front to back without blending.</returns>
+			virtual bool is_translucent() const;
 
 			/// <summary>Displays the object.</summary>
 			/// <param name="normal">A vector pointing towards the camera.</param>
@@ -87,6 +110,12 @@ namespace onion
 			// Map from a type name to a generator for an object generator.
 			static std::unordered_map<std::string, Generator*> m_GeneratorFinder;
 
+			// Ensures that objects are loaded from file only once, since chunks generate objects from several worker threads.
+			static std::once_flag m_InitFlag;
+
+			/// <summary>Loads all objects from file. Only called through init().</summary>
+			static void __init();
+
 		protected:
 			/// <summary>Constructs a generator with the given ID.</summary>
 			/// <param name="id">The ID of the generator.</param>
@@ -105,7 +134,7 @@ namespace onion
 				}
 			}
 
-			/// <summary>Loads all objects from file.</summary>
+			/// <summary>Loads all objects from file, if they have not been loaded yet. Generators can load sprite sheets, so the first call must be made from the render thread. Later calls are safe from any thread.</summary>
 			static void init();
 
 			/// <summary>Uses the generator with the given ID to generate an object.</summary>
@@ -0,0 +1,142 @@
+#pragma once
+#include <unordered_map>
+#include <vector>
+#include "object.h"
+
+// The distance that boxes stored in a bounding box tree are fattened by on every side, so that small movements do not restructure the tree.
+#define ONION_WORLD_TREE_MARGIN		8
+
+namespace onion
+{
+	namespace world
+	{
+
+		// A dynamic tree of fattened axis-aligned bounding boxes, used to quickly find moving objects that might overlap.
+		class BoundingBoxTree
+		{
+		private:
+			// A node in the tree.
+			struct Node
+			{
+				// The bounding box of the node, fattened by the margin if the node is a leaf. The first column represents minimum values, and the second column represents maximum values.
+				mat2x3i box;
+
+				// The object stored in a leaf. NULL for internal nodes.
+				Object* obj = nullptr;
+
+				// The parent of the node, or the next unused node if this node is unused. -1 if there is none.
+				Int parent = -1;
+
+				// The children of the node. -1 for leaves.
+				Int children[2] = { -1, -1 };
+
+				// The height of the subtree rooted at the node. Leaves have a height of 0, and unused nodes have a height of -1.
+				Int height = -1;
+
+				/// <summary>Checks whether the node is a leaf.</summary>
+				/// <returns>True if the node stores an object, false otherwise.</returns>
+				bool is_leaf() const;
+			};
+
+			// All nodes, including unused ones.
+			std::vector<Node> m_Nodes;
+
+			// The root of the tree. -1 if the tree is empty.
+			Int m_Root = -1;
+
+			// The first of a linked list of unused nodes. -1 if there are none.
+			Int m_FreeNodes = -1;
+
+			// The leaf storing each object in the tree.
+			std::unordered_map<Object*, Int> m_Leaves;
+
+			// The distance that the bounding box of each object is fattened by.
+			Int m_Margin;
+
+
+			/// <summary>Retrieves an unused node, creating one if necessary.</summary>
+			/// <returns>The index of the node.</returns>
+			Int __allocate();
+
+			/// <summary>Returns a node to the list of unused nodes.</summary>
+			/// <param name="node">The index of the node.</param>
+			void __free(Int node);
+
+			/// <summary>Inserts a leaf into the tree, next to the sibling that increases the total surface area the least.</summary>
+			/// <param name="leaf">The index of the leaf.</param>
+			void __insert_leaf(Int leaf);
+
+			/// <summary>Removes a leaf from the tree, without freeing it.</summary>
+			/// <param name="leaf">The index of the leaf.</param>
+			void __remove_leaf(Int leaf);
+
+			/// <summary>Recalculates the boxes and heights of every ancestor of a node, rebalancing along the way.</summary>
+			/// <param name="node">The index of the first ancestor to refit.</param>
+			void __refit(Int node);
+
+			/// <summary>Performs a rotation if the subtree rooted at the node is imbalanced.</summary>
+			/// <param name="node">The index of the root of the subtree.</param>
+			/// <returns>The index of the new root of the subtree.</returns>
+			Int __balance(Int node);
+
+			/// <summary>Fattens the bounding box of an object by the margin.</summary>
+			/// <param name="obj">The object.</param>
+			/// <param name="box">Outputs the fattened box.</param>
+			void __fatten(const Object* obj, mat2x3i& box) const;
+
+		public:
+			/// <summary>Constructs an empty tree.</summary>
+			/// <param name="margin">The distance that the bounding box of each object is fattened by.</param>
+			BoundingBoxTree(Int margin = ONION_WORLD_TREE_MARGIN);
+
+
+			/// <summary>Combines two boxes into the smallest box that contains both.</summary>
+			/// <param name="lhs">One box.</param>
+			/// <param name="rhs">The other box.</param>
+			/// <param name="res">Outputs the combined box.</param>
+			static void combine(const mat2x3i& lhs, const mat2x3i& rhs, mat2x3i& res);
+
+			/// <summary>Checks whether one box contains another.</summary>
+			/// <param name="outer">The containing box.</param>
+			/// <param name="inner">The contained box.</param>
+			/// <returns>True if every point of the inner box lies within the outer box, false otherwise.</returns>
+			static bool contains(const mat2x3i& outer, const mat2x3i& inner);
+
+			/// <summary>Checks whether two boxes overlap.</summary>
+			/// <param name="lhs">One box.</param>
+			/// <param name="rhs">The other box.</param>
+			/// <returns>True if the boxes overlap or touch, false otherwise.</returns>
+			static bool overlaps(const mat2x3i& lhs, const mat2x3i& rhs);
+
+
+			/// <summary>Retrieves the number of objects in the tree.</summary>
+			/// <returns>The number of objects in the tree.</returns>
+			Int size() const;
+
+			/// <summary>Retrieves the height of the tree.</summary>
+			/// <returns>The height of the root, or -1 if the tree is empty.</returns>
+			Int get_height() const;
+
+
+			/// <summary>Inserts an object into the tree.</summary>
+			/// <param name="obj">The object to insert.</param>
+			void insert(Object* obj);
+
+			/// <summary>Removes an object from the tree.</summary>
+			/// <param name="obj">The object to remove.</param>
+			void remove(Object* obj);
+
+			/// <summary>Responds to an object moving. The tree is only restructured if the object has left its fattened box.</summary>
+			/// <param name="obj">The object that moved.</param>
+			/// <returns>True if the object was reinserted, false if it is still inside its fattened box.</returns>
+			bool update(Object* obj);
+
+
+			/// <summary>Finds every object whose fattened box overlaps the given box.</summary>
+			/// <param name="box">The box to test against. The first column represents minimum values, and the second column represents maximum values.</param>
+			/// <param name="objects">Appended with every object whose fattened box overlaps the given box.</param>
+			void query(const mat2x3i& box, std::vector<Object*>& objects) const;
+		};
+
+	}
+}
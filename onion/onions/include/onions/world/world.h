@@ -1,4 +1,7 @@
 #pragma once
+#include <cstdio>
+#include <fstream>
+#include <unordered_map>
 #include "../graphics/frame.h"
 #include "../state.h"
 #include "chunk.h"
@@ -81,6 +84,138 @@ namespace onion
 		};
 
 
+		// A world made of a grid of equally-sized chunks, where only the chunks around the camera are kept in memory.
+		class StreamingWorld : public World
+		{
+		protected:
+			// The size of each cell of the grid, in pixels.
+			vec2i m_CellSize;
+
+			// The number of cells around the cell containing the camera that should be loaded.
+			Int m_Radius;
+
+			// The maximum number of bytes that resident chunks may use before the farthest ones are evicted.
+			Uint m_MemoryBudget;
+
+			// Every resident chunk, by cell, including chunks that are still loading. Cells without a data file are stored as NULL, so they aren't checked again.
+			std::unordered_map<INT_VEC2, Chunk*> m_Chunks;
+
+			// The cell containing the camera.
+			vec2i m_CenterCell;
+
+			// The number of bytes used by all chunks that have finished loading.
+			Uint m_MemoryUsage;
+
+
+			/// <summary>Constructs the chunk for a cell of the grid, without loading it.</summary>
+			/// <param name="cell">The cell of the grid.</param>
+			/// <param name="origin">The world coordinates of the bottom-left corner of the cell.</param>
+			/// <returns>The new chunk, or NULL if there is no chunk in that cell.</returns>
+			virtual Chunk* __create_chunk(const vec2i& cell, const vec2i& origin) = 0;
+
+			/// <summary>Retrieves the cell containing a position in the world.</summary>
+			/// <param name="pos">The position in the world.</param>
+			/// <returns>The cell of the grid containing the position.</returns>
+			vec2i __get_cell(const vec3i& pos) const;
+
+			/// <summary>Retrieves the chunk in a cell that has finished loading.</summary>
+			/// <param name="cell">The cell of the grid.</param>
+			/// <returns>The chunk, or NULL if the cell is empty or not loaded yet.</returns>
+			Chunk* __get_chunk(const vec2i& cell) const;
+
+			/// <summary>Constructs the chunk in a cell, if the cell hasn't been checked yet.</summary>
+			/// <param name="cell">The cell of the grid.</param>
+			/// <returns>The chunk in the cell, whether or not it has been loaded, or NULL if there is no chunk there.</returns>
+			Chunk* __create_cell(const vec2i& cell);
+
+			/// <summary>Queues every missing cell around the camera to be parsed on worker threads, nearest first.</summary>
+			void __queue_cells();
+
+			/// <summary>Uploads the next chunk that has finished parsing, if there is one.</summary>
+			/// <returns>True if a chunk became ready, false otherwise.</returns>
+			bool __finish_next();
+
+			/// <summary>Checks whether a resident chunk can be evicted without losing anything that reloading it would not bring back.</summary>
+			/// <param name="cell">The cell of the grid that the chunk is in.</param>
+			/// <param name="chunk">The loaded chunk.</param>
+			/// <returns>True if the chunk is outside the loading radius and holds exactly the actors loaded from it, false otherwise.</returns>
+			bool __can_evict(const vec2i& cell, Chunk* chunk) const;
+
+			/// <summary>Evicts the chunks farthest from the camera until the resident chunks fit within the memory budget. Chunks that cannot be evicted are kept, even over the budget.</summary>
+			void __evict();
+
+			/// <summary>Connects the object manager of every resident chunk to those of its neighbouring chunks.</summary>
+			void __link_neighbours();
+
+			/// <summary>Moves each actor into the chunk containing its position, if that chunk is resident.</summary>
+			void __transfer_actors();
+
+			/// <summary>Updates what is visible in response to a camera update.</summary>
+			void reset_camera();
+
+			/// <summary>Updates the world.</summary>
+			/// <param name="frames_passed">The number of frames passed since the last update.</param>
+			virtual void update(int frames_passed);
+
+			/// <summary>Displays the world.</summary>
+			void __display() const;
+
+		public:
+			/// <summary>Constructs a streaming world. The cell containing the camera is loaded immediately, and its neighbours are parsed in the background and uploaded over the following updates.</summary>
+			/// <param name="cell_size">The size of each cell of the grid, in pixels.</param>
+			/// <param name="radius">The number of cells around the camera's cell that should be loaded.</param>
+			/// <param name="memory_budget">The maximum number of bytes that resident chunks may use.</param>
+			StreamingWorld(const vec2i& cell_size, Int radius, Uint memory_budget);
+
+			/// <summary>Deletes every resident chunk.</summary>
+			virtual ~StreamingWorld();
+
+			/// <summary>Inserts an object into the chunk containing it, loading that chunk if necessary.</summary>
+			/// <param name="obj">The object to insert.</param>
+			void add(Object* obj);
+
+			/// <summary>Retrieves the number of bytes used by all resident chunks.</summary>
+			/// <returns>The memory usage of the resident chunks.</returns>
+			Uint get_memory_usage() const;
+		};
+
+		// A streaming world where every chunk is of the same type, loaded from files named after their cells.
+		template <typename T>
+		class _StreamingWorld : public StreamingWorld
+		{
+		protected:
+			// The path to each chunk's data, from the res/data/world/ folder, with two %d placeholders for the x and y indices of the cell.
+			std::string m_PathFormat;
+
+			/// <summary>Constructs the chunk for a cell of the grid, without loading it.</summary>
+			/// <param name="cell">The cell of the grid.</param>
+			/// <param name="origin">The world coordinates of the bottom-left corner of the cell.</param>
+			/// <returns>The new chunk, or NULL if there is no data file for that cell.</returns>
+			Chunk* __create_chunk(const vec2i& cell, const vec2i& origin)
+			{
+				char path[256];
+				snprintf(path, sizeof(path), m_PathFormat.c_str(), (int)cell.get(0), (int)cell.get(1));
+
+				if (!std::ifstream(std::string("res/data/world/") + path).good())
+					return nullptr;
+				return new T(path, origin);
+			}
+
+		public:
+			/// <summary>Constructs a streaming world.</summary>
+			/// <param name="path_format">The path to each chunk's data, from the res/data/world/ folder, with two %d placeholders for the x and y indices of the cell.</param>
+			/// <param name="cell_size">The size of each cell of the grid, in pixels.</param>
+			/// <param name="radius">The number of cells around the camera's cell that should be loaded.</param>
+			/// <param name="memory_budget">The maximum number of bytes that resident chunks may use.</param>
+			_StreamingWorld(const char* path_format, const vec2i& cell_size, Int radius, Uint memory_budget) :
+				StreamingWorld(cell_size, radius, memory_budget), m_PathFormat(path_format) {}
+		};
+
+		typedef _StreamingWorld<FlatChunk> FlatStreamingWorld;
+		typedef _StreamingWorld<TileMapChunk> TileMapStreamingWorld;
+		typedef _StreamingWorld<SmoothChunk> SmoothStreamingWorld;
+
+
 		// A world where the camera follows an actor around.
 		template <typename T>
 		class _ActorFollowingWorld : public T
@@ -177,6 +312,8 @@ namespace onion
 		};
 
 		typedef _ActorFollowingWorld<BasicWorld> ActorFollowingBasicWorld;
+		typedef _ActorFollowingWorld<FlatStreamingWorld> ActorFollowingFlatStreamingWorld;
+		typedef _ActorFollowingWorld<SmoothStreamingWorld> ActorFollowingSmoothStreamingWorld;
 
 	}
 }
\ No newline at end of file
@@ -1,4 +1,13 @@
 #include <regex>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include "../include/onions/fileio.h"
 
 using namespace std;
@@ -144,13 +153,30 @@ namespace onion
 	}
 
 
-	SaveFile::SaveFile(string path) : m_File(path) {}
+	SaveFile::SaveFile(string path, bool binary) : m_File(path, binary ? ios::out | ios::binary : ios::out) {}
 
 	SaveFile::~SaveFile()
 	{
 		m_File.close();
 	}
 
+	bool SaveFile::good()
+	{
+		return m_File.good();
+	}
+
+	void SaveFile::align(std::size_t alignment)
+	{
+		if (!m_File.good()) return;
+
+		std::size_t position = m_File.tellp();
+		while (position % alignment != 0)
+		{
+			m_File.put('\0');
+			++position;
+		}
+	}
+
 	void SaveFile::save_int_binary(int16_t value)
 	{
 		if (!m_File.good()) return;
@@ -168,6 +194,35 @@ namespace onion
 		m_File.write(value.c_str(), value.size());
 	}
 
+	void SaveFile::save_int32_binary(int32_t value)
+	{
+		if (!m_File.good()) return;
+
+		char buffer[4];
+		for (int k = 0; k < 4; ++k)
+			buffer[k] = (char)(((uint32_t)value >> (8 * k)) & 0xFF);
+
+		m_File.write(buffer, 4);
+	}
+
+	void SaveFile::save_bytes_binary(const char* bytes, std::size_t size)
+	{
+		if (!m_File.good()) return;
+
+		m_File.write(bytes, size);
+	}
+
+	void SaveFile::save_data_binary(String id, const StringData& data)
+	{
+		save_string_binary(id);
+		save_int_binary(data.m_Data.size());
+		for (auto iter = data.m_Data.begin(); iter != data.m_Data.end(); ++iter)
+		{
+			save_string_binary(iter->first);
+			save_string_binary(iter->second);
+		}
+	}
+
 	void SaveFile::save_data(String id, const StringData& data)
 	{
 		if (data.m_Data.size() == 1)
@@ -285,5 +340,127 @@ namespace onion
 
 		return line;
 	}
-}
 
+
+	MappedFile::MappedFile(string path)
+	{
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return;
+		m_Handles[0] = file;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+			return;
+
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+		if (!mapping)
+			return;
+		m_Handles[1] = mapping;
+
+		m_Data = (char*)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+		if (m_Data)
+			m_Size = size.QuadPart;
+#else
+		int file = open(path.c_str(), O_RDONLY);
+		if (file < 0)
+			return;
+
+		struct stat info;
+		if (fstat(file, &info) == 0 && info.st_size > 0)
+		{
+			void* ptr = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+			if (ptr != MAP_FAILED)
+			{
+				m_Data = (char*)ptr;
+				m_Size = info.st_size;
+			}
+		}
+
+		// The mapping stays valid after the file is closed
+		close(file);
+#endif
+	}
+
+	MappedFile::~MappedFile()
+	{
+#ifdef _WIN32
+		if (m_Data)
+			UnmapViewOfFile(m_Data);
+		if (m_Handles[1])
+			CloseHandle(m_Handles[1]);
+		if (m_Handles[0])
+			CloseHandle(m_Handles[0]);
+#else
+		if (m_Data)
+			munmap(m_Data, m_Size);
+#endif
+	}
+
+	bool MappedFile::good() const
+	{
+		return m_Data && m_Position <= m_Size;
+	}
+
+	void MappedFile::align(std::size_t alignment)
+	{
+		m_Position = ((m_Position + alignment - 1) / alignment) * alignment;
+	}
+
+	int16_t MappedFile::load_int_binary()
+	{
+		unsigned char* bytes = (unsigned char*)load_bytes_binary(2);
+		if (!bytes) return 0;
+
+		return (int16_t)(bytes[0] | (bytes[1] << 8));
+	}
+
+	int32_t MappedFile::load_int32_binary()
+	{
+		unsigned char* bytes = (unsigned char*)load_bytes_binary(4);
+		if (!bytes) return 0;
+
+		uint32_t value = 0;
+		for (int k = 3; k >= 0; --k)
+			value = (value << 8) | bytes[k];
+		return (int32_t)value;
+	}
+
+	string MappedFile::load_string_binary()
+	{
+		int len = (uint16_t)load_int_binary();
+		if (char* bytes = load_bytes_binary(len))
+			return string(bytes, len);
+		return string();
+	}
+
+	char* MappedFile::load_bytes_binary(std::size_t size)
+	{
+		if (!good() || size > m_Size - m_Position)
+		{
+			// Mark the file as bad
+			m_Position = m_Size + 1;
+			return nullptr;
+		}
+
+		char* bytes = m_Data + m_Position;
+		m_Position += size;
+		return bytes;
+	}
+
+	String MappedFile::load_data_binary(StringData& data)
+	{
+		String id = load_string_binary();
+
+		int count = load_int_binary();
+		for (int k = 0; k < count && good(); ++k)
+		{
+			String key = load_string_binary();
+			String value = load_string_binary();
+			data.set(key, value);
+		}
+
+		return id;
+	}
+}
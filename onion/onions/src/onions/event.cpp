@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <regex>
@@ -5,6 +6,8 @@
 #include <unordered_set>
 #include <thread>
 #include <ctime>
+#include <climits>
+#include <cmath>
 #include <memory>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -160,6 +163,19 @@ namespace onion
 
 	StackUpdateListener g_UpdateManager;
 
+	// The earliest frame that the screen needs to be drawn again on, or INT_MAX if nothing has changed since it was last drawn.
+	int g_DirtyFrame{ 0 };
+
+	void invalidate_display()
+	{
+		g_DirtyFrame = std::min(g_DirtyFrame, UpdateEvent::frame);
+	}
+
+	void invalidate_display(int frame)
+	{
+		g_DirtyFrame = std::min(g_DirtyFrame, frame);
+	}
+
 
 
 	UpdateListener::~UpdateListener()
@@ -495,6 +511,89 @@ namespace onion
 	// The application window.
 	GLFWwindow* g_Window = NULL;
 
+	// The image that the application is drawn into before being scaled up to fit the window. NULL until the application is first drawn with a render size.
+	opengl::_FrameBuffer* g_RenderTarget = NULL;
+
+	// The whole number that each pixel of the render target is scaled up by.
+	int g_RenderScale = 1;
+
+	// The position of the bottom-left corner of the scaled render target in the window, in pixels.
+	int g_RenderOffsetX = 0, g_RenderOffsetY = 0;
+
+
+	// The settings of each quality tier, from lowest to highest.
+	const QualityTier g_QualityTiers[ONION_QUALITY_TIERS] = {
+		{ 0.5f, 2, 1, 4 },
+		{ 0.75f, 4, 1, 2 },
+		{ 1.f, 8, 2, 1 },
+		{ 1.f, -1, -1, 1 }
+	};
+
+	// Measures how long each update takes, and moves the quality tier up or down to keep updates within the frame budget.
+	class QualityController
+	{
+	private:
+		// The average time that recent updates took, in milliseconds.
+		double m_Average = 0.0;
+
+		// The number of updates measured since the quality tier last changed.
+		int m_Frames = 0;
+
+	public:
+		/// <summary>Records how long an update took, and changes the quality tier if updates have settled over the budget, or well under it.</summary>
+		/// <param name="milliseconds">The wall time that the update took, including drawing if anything on the screen changed.</param>
+		/// <returns>True if the quality tier changed, false otherwise.</returns>
+		bool measure(double milliseconds)
+		{
+			if (g_Application->frame_budget <= 0)
+				return false;
+
+			// Keep a running average, so that a single slow frame does not change the tier
+			m_Average = m_Frames == 0 ? milliseconds : (0.9 * m_Average) + (0.1 * milliseconds);
+			if (++m_Frames < ONION_QUALITY_SETTLE_FRAMES)
+				return false;
+
+			int tier = g_Application->quality;
+			if (m_Average > g_Application->frame_budget)
+				tier = std::max(tier - 1, g_Application->min_quality);
+			else if (m_Average < ONION_QUALITY_HEADROOM * g_Application->frame_budget)
+				tier = std::min(tier + 1, g_Application->max_quality);
+
+			if (tier == g_Application->quality)
+				return false;
+
+			g_Application->quality = tier;
+			m_Frames = 0;
+			return true;
+		}
+	};
+
+	// The controller that scales the quality tier to the frame budget.
+	QualityController g_QualityController;
+
+	/// <summary>Snaps the fraction of the logical resolution that a quality tier draws at to one over a whole number, so that the render target is still scaled up by whole numbers.</summary>
+	/// <param name="render_scale">The fraction of the logical resolution that the quality tier draws at.</param>
+	/// <param name="logical_width">The width that the application is drawn at.</param>
+	/// <param name="logical_height">The height that the application is drawn at.</param>
+	/// <returns>One over the fraction rounded up, or the largest whole number below it that divides both the logical width and height.</returns>
+	int get_render_divisor(float render_scale, int logical_width, int logical_height)
+	{
+		// Round up, so that the quality tier never draws at a higher resolution than it asks for, unless the resolution cannot be divided that finely
+		int divisor = std::max(1, (int)std::ceil((1.f / render_scale) - 0.001f));
+		while (divisor > 1 && (logical_width % divisor != 0 || logical_height % divisor != 0))
+			--divisor;
+		return divisor;
+	}
+
+	/// <summary>Passes the settings of the current quality tier to the systems that use them.</summary>
+	void apply_quality_tier()
+	{
+		const QualityTier& tier = g_Application->get_quality_tier();
+		Lighting::set_max_cluster_lights(tier.max_cluster_lights);
+		Lighting::set_flicker_interval(tier.flicker_interval);
+		invalidate_display();
+	}
+
 
 	void load_settings()
 	{
@@ -528,11 +627,40 @@ namespace onion
 					{
 						g_Application->fullscreen = (m[2].compare("true") == 0);
 					}
+					else if (m[1].compare("render_width") == 0)
+					{
+						g_Application->render_width = stoi(m[2].str());
+					}
+					else if (m[1].compare("render_height") == 0)
+					{
+						g_Application->render_height = stoi(m[2].str());
+					}
+					else if (m[1].compare("frame_budget") == 0)
+					{
+						g_Application->frame_budget = stoi(m[2].str());
+					}
+					else if (m[1].compare("quality") == 0)
+					{
+						g_Application->quality = stoi(m[2].str());
+					}
+					else if (m[1].compare("min_quality") == 0)
+					{
+						g_Application->min_quality = stoi(m[2].str());
+					}
+					else if (m[1].compare("max_quality") == 0)
+					{
+						g_Application->max_quality = stoi(m[2].str());
+					}
 				}
 			}
 
 			settings.close();
 		}
+
+		// Keep the quality tiers within the range of tiers that exist, and start from a tier within the allowed range
+		g_Application->min_quality = std::max(0, std::min(g_Application->min_quality, ONION_QUALITY_TIERS - 1));
+		g_Application->max_quality = std::max(g_Application->min_quality, std::min(g_Application->max_quality, ONION_QUALITY_TIERS - 1));
+		g_Application->quality = std::max(g_Application->min_quality, std::min(g_Application->quality, g_Application->max_quality));
 	}
 
 	void save_settings()
@@ -545,6 +673,15 @@ namespace onion
 			settings << "\nwidth = " << g_Application->width;
 			settings << "\nheight = " << g_Application->height;
 			settings << "\nfullscreen = " << (g_Application->fullscreen ? "true" : "false");
+			if (g_Application->is_render_scaled())
+			{
+				settings << "\nrender_width = " << g_Application->render_width;
+				settings << "\nrender_height = " << g_Application->render_height;
+			}
+			settings << "\nframe_budget = " << g_Application->frame_budget;
+			settings << "\nquality = " << g_Application->quality;
+			settings << "\nmin_quality = " << g_Application->min_quality;
+			settings << "\nmax_quality = " << g_Application->max_quality;
 
 			settings.close();
 		}
@@ -574,6 +711,12 @@ namespace onion
 		width = 640;
 		height = 400;
 		fullscreen = false;
+		render_width = 0;
+		render_height = 0;
+		frame_budget = 0;
+		min_quality = 0;
+		max_quality = ONION_QUALITY_TIERS - 1;
+		quality = ONION_QUALITY_TIERS - 1;
 	}
 
 	Application::Application(Application* other) : title(other->title)
@@ -581,6 +724,32 @@ namespace onion
 		width = other->width;
 		height = other->height;
 		fullscreen = other->fullscreen;
+		render_width = other->render_width;
+		render_height = other->render_height;
+		frame_budget = other->frame_budget;
+		min_quality = other->min_quality;
+		max_quality = other->max_quality;
+		quality = other->quality;
+	}
+
+	bool Application::is_render_scaled() const
+	{
+		return render_width > 0 && render_height > 0;
+	}
+
+	int Application::get_logical_width() const
+	{
+		return is_render_scaled() ? render_width : width;
+	}
+
+	int Application::get_logical_height() const
+	{
+		return is_render_scaled() ? render_height : height;
+	}
+
+	const QualityTier& Application::get_quality_tier() const
+	{
+		return g_QualityTiers[std::max(0, std::min(quality, ONION_QUALITY_TIERS - 1))];
 	}
 
 	int Application::display()
@@ -613,10 +782,11 @@ namespace onion
 
 		// Resize the state, if it exists
 		if (State* state = get_state())
-			state->set_bounds(width, height);
+			state->set_bounds(get_logical_width(), get_logical_height());
 
-		// Set the viewport
-		glViewport(0, 0, width, height);
+		// Set the viewport to the size that the application is drawn at
+		glViewport(0, 0, get_logical_width(), get_logical_height());
+		invalidate_display();
 		return 0;
 	}
 
@@ -632,6 +802,7 @@ namespace onion
 
 		// Trigger the global listener
 		g_KeyboardManager.trigger(event_data);
+		invalidate_display();
 	}
 
 	/// <summary>The callback function for when a physical key is pressed, released, or repeated.</summary>
@@ -656,6 +827,7 @@ namespace onion
 		{
 			KeyEvent event_data = { control, action == GLFW_PRESS };
 			g_KeyboardManager.trigger(event_data);
+			invalidate_display();
 		}
 
 		// Call unicode callback
@@ -679,10 +851,28 @@ namespace onion
 	void onion_mouse_move_callback(GLFWwindow* window, double xpos, double ypos)
 	{
 		// Construct the data object
-		MouseMoveEvent event_data = { round(xpos), g_Application->height - (int)round(ypos) };
+		// Convert the cursor position to a pixel of the render target, if the application is scaled up
+		if (g_Application->is_render_scaled())
+		{
+			// The cursor is in screen coordinates, while the render target is placed in framebuffer pixels, which differ on high-DPI displays
+			int framebuffer_width, framebuffer_height, window_width, window_height;
+			glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
+			glfwGetWindowSize(window, &window_width, &window_height);
+			if (window_width > 0 && window_height > 0)
+			{
+				xpos *= (double)framebuffer_width / window_width;
+				ypos *= (double)framebuffer_height / window_height;
+			}
+
+			xpos = (xpos - g_RenderOffsetX) / g_RenderScale;
+			ypos = (ypos - (framebuffer_height - g_RenderOffsetY - (g_RenderScale * g_Application->render_height))) / g_RenderScale;
+		}
+
+		MouseMoveEvent event_data = { round(xpos), g_Application->get_logical_height() - (int)round(ypos) };
 
 		// Trigger the global listener
 		g_MouseManager.trigger(event_data);
+		invalidate_display();
 	}
 
 	/// <summary>The callback function for when a mouse button is pressed or released.</summary>
@@ -708,6 +898,15 @@ namespace onion
 			// Trigger the global listener
 			g_MouseManager.trigger(event_data);
 		}
+
+		invalidate_display();
+	}
+
+	/// <summary>The callback function for when the contents of the window need to be drawn again, such as after it was covered or resized.</summary>
+	/// <param name="window">The window that the event triggered from.</param>
+	void onion_refresh_callback(GLFWwindow* window)
+	{
+		invalidate_display();
 	}
 
 
@@ -744,6 +943,7 @@ namespace onion
 		glfwSetCharCallback(g_Window, onion_unicode_callback);
 		glfwSetCursorPosCallback(g_Window, onion_mouse_move_callback);
 		glfwSetMouseButtonCallback(g_Window, onion_mouse_click_callback);
+		glfwSetWindowRefreshCallback(g_Window, onion_refresh_callback);
 
 		glewExperimental = true;
 		if (glewInit() != GLEW_OK)
@@ -756,6 +956,7 @@ namespace onion
 		// Set up the transformation matrices
 		Transform::init();
 		Lighting::init();
+		apply_quality_tier();
 
 		return 0;
 	}
@@ -782,22 +983,86 @@ namespace onion
 			if (new_frame != UpdateEvent::frame)
 			{
 				// Update everything
+				double start = glfwGetTime();
 				UpdateEvent::frame = new_frame;
 				g_UpdateManager.trigger();
 
-				// Clear the screen
-				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				// Upload any lights that changed during the update
+				Lighting::upload();
 
-				// Draw everything
-				display_callback();
+				// Skip drawing if nothing on the screen has changed since it was last drawn
+				bool drawn = g_DirtyFrame <= UpdateEvent::frame;
+				if (drawn)
+				{
+					g_DirtyFrame = INT_MAX;
+
+					// Clear the screen
+					glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+					// Draw into the render target instead, if the application is scaled up or drawn at a fraction of its resolution
+					int logical_width = g_Application->get_logical_width();
+					int logical_height = g_Application->get_logical_height();
+					float render_scale = g_Application->get_quality_tier().render_scale;
+					bool scaled = g_Application->is_render_scaled() || render_scale < 1.f;
+					if (scaled)
+					{
+						if (!g_RenderTarget)
+							g_RenderTarget = new opengl::_FrameBuffer({ GL_RGBA8 });
+
+						// When scaling up by whole numbers, draw at a whole fraction of the logical resolution so that every pixel stays the same size
+						int render_width = std::max(1, (int)(render_scale * logical_width));
+						int render_height = std::max(1, (int)(render_scale * logical_height));
+						if (g_Application->is_render_scaled() && render_scale < 1.f)
+						{
+							int divisor = get_render_divisor(render_scale, logical_width, logical_height);
+							render_width = logical_width / divisor;
+							render_height = logical_height / divisor;
+						}
+
+						// The render target is sized to the viewport
+						glViewport(0, 0, render_width, render_height);
+						g_RenderTarget->bind(vec4f(0.f, 0.f, 0.f, 1.f));
+					}
+
+					// Draw everything
+					display_callback();
+
+					if (scaled)
+					{
+						// Scale the render target up by the largest whole number that fits the window, centered with black bars around it
+						int window_width, window_height;
+						glfwGetFramebufferSize(g_Window, &window_width, &window_height);
+
+						if (g_Application->is_render_scaled())
+						{
+							g_RenderScale = std::max(1, std::min(window_width / logical_width, window_height / logical_height));
+							g_RenderOffsetX = (window_width - (g_RenderScale * logical_width)) / 2;
+							g_RenderOffsetY = (window_height - (g_RenderScale * logical_height)) / 2;
+						}
+						else
+						{
+							g_RenderScale = 1;
+							g_RenderOffsetX = 0;
+							g_RenderOffsetY = 0;
+						}
+
+						g_RenderTarget->blit(g_RenderOffsetX, g_RenderOffsetY, g_RenderScale * logical_width, g_RenderScale * logical_height);
+						glViewport(0, 0, logical_width, logical_height);
+					}
+
+					// Synchronize the CPU with the GPU
+					GLsync synchro = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+					glClientWaitSync(synchro, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+					glDeleteSync(synchro);
+				}
 
-				// Synchronize the CPU with the GPU
-				GLsync synchro = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
-				glClientWaitSync(synchro, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
-				glDeleteSync(synchro);
+				// Move between quality tiers to keep updates within the budget, including those that did not need to draw
+				if (g_QualityController.measure(1000.0 * (glfwGetTime() - start)))
+					apply_quality_tier();
 
 				// Swap buffers
-				glfwSwapBuffers(g_Window);
+				if (drawn)
+					glfwSwapBuffers(g_Window);
 			}
 
 			// TODO wait until frame interval has passed
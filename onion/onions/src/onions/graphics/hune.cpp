@@ -2,6 +2,7 @@
 #include <regex>
 #include <algorithm>
 #include <set>
+#include <climits>
 #include "../../../include/onions/graphics/hune.h"
 #include "../../../include/onions/application.h"
 #include "../../../include/onions/fileio.h"
@@ -492,6 +493,18 @@ public:
 	{
 		return m_BaseIndex + (((UpdateEvent::frame - m_StartingFrame) * 5 / UpdateEvent::frames_per_second) % m_Size);
 	}
+
+	/// <summary>Retrieves the update frame on which the frame of animation next changes.</summary>
+	/// <returns>The update frame that the animation next changes on, or INT_MAX if it never changes.</returns>
+	int get_next_change() const
+	{
+		if (m_Size <= 1)
+			return INT_MAX;
+
+		// The first update frame where the step of the animation is one more than the current step
+		int step = (UpdateEvent::frame - m_StartingFrame) * 5 / UpdateEvent::frames_per_second;
+		return m_StartingFrame + (((step + 1) * UpdateEvent::frames_per_second) + 4) / 5;
+	}
 };
 
 HuneAnimation* onion::generate_hune_standing_animation()
@@ -1120,6 +1133,7 @@ void HuneGraphic::set_animation(HuneAnimation* animation)
 	}
 
 	m_Animation = animation;
+	invalidate_display();
 }
 
 int HuneGraphic::get_width() const
@@ -1138,6 +1152,9 @@ void HuneGraphic::display() const
 {
 	int frame = m_Animation->get_frame();
 
+	// Draw the screen again when the animation changes to its next frame
+	invalidate_display(m_Animation->get_next_change());
+
 	Transform::model.push();
 
 	int trans = m_BaseLowerBody.display(facing, frame) - 4;
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <regex>
 #include <filesystem>
 #include <GL/glew.h>
@@ -153,6 +154,7 @@ namespace onion
 			GL_INT_VEC3,
 			GL_INT_VEC4,
 			GL_SAMPLER_2D,
+			GL_INT_SAMPLER_2D,
 			GL_UNSIGNED_INT,
 			GL_UNSIGNED_INT_VEC2,
 			GL_UNSIGNED_INT_VEC3,
@@ -191,6 +193,7 @@ namespace onion
 			INT_VEC3,
 			INT_VEC4,
 			Int,
+			Int,
 			Uint,
 			UINT_VEC2,
 			UINT_VEC3,
@@ -774,10 +777,27 @@ namespace onion
 
 
 
-		_Shader::_Shader(const char* path, const std::vector<String>& uniform_names)
+		/// <summary>Collects the text of a shader file in a string, inserting preprocessor definitions after the #version directive.</summary>
+		/// <param name="file">The shader file.</param>
+		/// <param name="defines">The lines of preprocessor definitions to insert.</param>
+		/// <returns>The text of the shader.</returns>
+		std::string load_shader_text(LoadFile& file, const std::string& defines)
 		{
-			std::string vertex_shader, fragment_shader;
+			std::string text;
+			while (file.good())
+			{
+				std::string line = file.load_line();
+				text += line + "\n";
+
+				// The #version directive must come first, so definitions go directly after it
+				if (line.compare(0, 8, "#version") == 0)
+					text += defines;
+			}
+			return text;
+		}
 
+		_Shader::_Shader(const char* path, const std::vector<String>& uniform_names, const std::string& defines)
+		{
 			// Load the files of the shaders
 			std::string fpath("res/shaders/");
 			fpath += path;
@@ -787,17 +807,12 @@ namespace onion
 			LoadFile fragment(fpath + ".fragment");
 
 			// Collect the text of each shader in a string
-			while (vertex.good())
-				vertex_shader += vertex.load_line() + "\n";
-
-			while (fragment.good())
-				fragment_shader += fragment.load_line() + "\n";
+			std::string vertex_shader = load_shader_text(vertex, defines);
+			std::string fragment_shader = load_shader_text(fragment, defines);
 
 			if (geometry.good()) // A geometry shader
 			{
-				std::string geometry_shader;
-				while (geometry.good())
-					geometry_shader += geometry.load_line() + "\n";
+				std::string geometry_shader = load_shader_text(geometry, defines);
 
 				// Compile the shaders
 				compile(vertex_shader.c_str(), geometry_shader.c_str(), fragment_shader.c_str(), uniform_names);
@@ -1144,6 +1159,17 @@ namespace onion
 						glGetActiveUniformsiv(id, 1, &uniform_index, GL_UNIFORM_TYPE, &type);
 						errcheck("Error retrieving the type of uniform \"" + uniform_name + "\".");
 
+						// Link buffer samplers to the texture buffer with the same name, the same way uniform blocks are linked to uniform buffers
+						if (type == GL_SAMPLER_BUFFER || type == GL_INT_SAMPLER_BUFFER)
+						{
+							_TextureBuffer* buf = _TextureBuffer::get_buffer(uniform_name);
+
+							__activate();
+							glUniform1i(uniform_location, buf->get_slot());
+							errcheck("Error linking the sampler \"" + uniform_name + "\" of the shader to its texture buffer.");
+							continue;
+						}
+
 						// Construct a uniform object
 						for (int n = 0; n < array_size; ++n)
 						{
@@ -1282,6 +1308,23 @@ namespace onion
 
 
 		_VertexBuffer::_VertexBuffer(const _VertexBufferData* data, const VertexAttribs& attribs)
+		{
+			// Generate the array of data for the buffer
+			std::size_t bytes;
+			char* ptr = data->compile(bytes);
+
+			__create(ptr, bytes, attribs);
+
+			// Clean up the array of data for the buffer
+			delete[] ptr;
+		}
+
+		_VertexBuffer::_VertexBuffer(const char* bytes, std::size_t size, const VertexAttribs& attribs)
+		{
+			__create(bytes, size, attribs);
+		}
+
+		void _VertexBuffer::__create(const char* bytes, std::size_t size, const VertexAttribs& attribs)
 		{
 			// Generate a vertex array object
 			errcheck("ONION: Error generated at some point before creating the vertex buffer.");
@@ -1290,20 +1333,13 @@ namespace onion
 			glBindVertexArray(arr);
 			errcheck("ONION: Error generated when generating and binding the VAO.");
 
-			// Generate the array of data for the buffer
-			std::size_t bytes;
-			char* ptr = data->compile(bytes);
-
 			// Bind the data to a buffer
 			GLuint buf;
 			glGenBuffers(1, &buf);
 			glBindBuffer(GL_ARRAY_BUFFER, buf);
-			glBufferData(GL_ARRAY_BUFFER, bytes, ptr, GL_STATIC_DRAW);
+			glBufferData(GL_ARRAY_BUFFER, size, bytes, GL_STATIC_DRAW);
 			errcheck("ONION: Error generated when generating and binding the VBO.");
 
-			// Clean up the array of data for the buffer
-			delete[] ptr;
-
 			// Set vertex attributes
 			attribs.enable();
 			errcheck("ONION: Error generated when enabling vertex attribs.");
@@ -1354,6 +1390,14 @@ namespace onion
 			}
 		}
 
+		void _VertexBuffer::update(std::size_t offset, const char* bytes, std::size_t size)
+		{
+			// Binding the buffer directly doesn't change the VAO, so the active buffer stays the same
+			glBindBuffer(GL_ARRAY_BUFFER, m_Buffer->id);
+			glBufferSubData(GL_ARRAY_BUFFER, offset, size, bytes);
+			errcheck("ONION: Error generated when updating part of the VBO.");
+		}
+
 
 
 		_Image::_Image()
@@ -1369,7 +1413,10 @@ namespace onion
 
 		_Image::~_Image()
 		{
-			free();
+			if (m_IsLoaded)
+				free();
+			if (m_Pixels)
+				SOIL_free_image_data(m_Pixels);
 		}
 
 		void _Image::free()
@@ -1395,10 +1442,16 @@ namespace onion
 
 		bool _Image::load(const char* path, bool pixel_perfect)
 		{
-			// Free the previous image, if there was one.
-			if (m_IsLoaded)
+			return decode(path) && upload(pixel_perfect);
+		}
+
+		bool _Image::decode(const char* path)
+		{
+			// Discard any pixels that were decoded but never uploaded
+			if (m_Pixels)
 			{
-				free();
+				SOIL_free_image_data(m_Pixels);
+				m_Pixels = nullptr;
 			}
 
 			// Generate the actual path.
@@ -1416,16 +1469,32 @@ namespace onion
 			}
 
 			// Load data from file using SOIL.
-			unsigned char* data;
 			int channels;
+			m_Pixels = SOIL_load_image(fpath.c_str(), &m_Width, &m_Height, &channels, SOIL_LOAD_RGBA);
+
+			return m_Pixels != nullptr;
+		}
+
+		bool _Image::upload(bool pixel_perfect)
+		{
+			if (!m_Pixels)
+				return false;
 
-			data = SOIL_load_image(fpath.c_str(), &m_Width, &m_Height, &channels, SOIL_LOAD_RGBA);
+			// Free the previous image, if there was one.
+			if (m_IsLoaded)
+			{
+				free();
+			}
 
 			// Bind data to texture.
 			GLuint tex;
 			glGenTextures(1, &tex);
 			glBindTexture(GL_TEXTURE_2D, tex);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_Width, m_Height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_Width, m_Height, 0, GL_RGBA, GL_UNSIGNED_BYTE, m_Pixels);
+
+			// The pixels are no longer needed once they are in the texture
+			SOIL_free_image_data(m_Pixels);
+			m_Pixels = nullptr;
 
 			// Set the magnification and minimization filters
 			if (pixel_perfect)
@@ -1461,6 +1530,33 @@ namespace onion
 			return m_Height;
 		}
 
+		bool _Image::get_transparency(int left, int top, int width, int height, bool& transparent, bool& translucent) const
+		{
+			transparent = false;
+			translucent = false;
+			if (!m_Pixels)
+				return false;
+
+			// Clip the rectangle to the image
+			int right = std::min(left + width, m_Width);
+			int bottom = std::min(top + height, m_Height);
+
+			for (int y = std::max(top, 0); y < bottom; ++y)
+			{
+				for (int x = std::max(left, 0); x < right; ++x)
+				{
+					// The alpha channel is the last of the four channels of each pixel
+					unsigned char alpha = m_Pixels[(4 * ((y * m_Width) + x)) + 3];
+					if (alpha == 0)
+						transparent = true;
+					else if (alpha < 255)
+						translucent = true;
+				}
+			}
+
+			return true;
+		}
+
 		bool _Image::is_active() const
 		{
 			return m_ActiveImage == m_Image;
@@ -1481,6 +1577,324 @@ namespace onion
 
 
 
+		_IntegerTexture::_IntegerTexture(const std::int16_t* data, int width, int height) : m_Width(width), m_Height(height)
+		{
+			// Bind data to texture. Each texel is four bytes, so rows are always aligned.
+			GLuint tex;
+			glGenTextures(1, &tex);
+			glBindTexture(GL_TEXTURE_2D, tex);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16I, width, height, 0, GL_RG_INTEGER, GL_SHORT, data);
+
+			// Integer textures cannot be filtered
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			errcheck("Error generated when uploading an integer texture.");
+
+			// Generate an ID object for the texture
+			m_Texture = new _ID(tex);
+		}
+
+		_IntegerTexture::~_IntegerTexture()
+		{
+			glDeleteTextures(1, &m_Texture->id);
+			delete m_Texture;
+		}
+
+		int _IntegerTexture::get_width() const
+		{
+			return m_Width;
+		}
+
+		int _IntegerTexture::get_height() const
+		{
+			return m_Height;
+		}
+
+		void _IntegerTexture::activate(int slot) const
+		{
+			if (slot >= 0 && slot < 16) // Make sure the slot is valid
+			{
+				glActiveTexture(GL_TEXTURE0 + slot);
+				glBindTexture(GL_TEXTURE_2D, m_Texture->id);
+			}
+		}
+
+		void _IntegerTexture::update(int x, int y, int width, int height, const std::int16_t* data)
+		{
+			glBindTexture(GL_TEXTURE_2D, m_Texture->id);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RG_INTEGER, GL_SHORT, data);
+			errcheck("Error generated when updating an integer texture.");
+		}
+
+
+
+		_FloatTexture::_FloatTexture(const float* data, int width, int height)
+		{
+			// Bind data to texture. Rows of three floats are always aligned to four bytes.
+			GLuint tex;
+			glGenTextures(1, &tex);
+			glBindTexture(GL_TEXTURE_2D, tex);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, data);
+
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			errcheck("Error generated when uploading a float texture.");
+
+			// Generate an ID object for the texture
+			m_Texture = new _ID(tex);
+		}
+
+		_FloatTexture::~_FloatTexture()
+		{
+			glDeleteTextures(1, &m_Texture->id);
+			delete m_Texture;
+		}
+
+		void _FloatTexture::activate(int slot) const
+		{
+			if (slot >= 0 && slot < 16) // Make sure the slot is valid
+			{
+				glActiveTexture(GL_TEXTURE0 + slot);
+				glBindTexture(GL_TEXTURE_2D, m_Texture->id);
+			}
+		}
+
+
+
+		_FrameBuffer::_FrameBuffer(const std::vector<Uint>& formats) : m_Formats(formats) {}
+
+		_FrameBuffer::~_FrameBuffer()
+		{
+			__destroy();
+			if (m_VAO)
+			{
+				glDeleteVertexArrays(1, &m_VAO->id);
+				delete m_VAO;
+			}
+		}
+
+		void _FrameBuffer::__destroy()
+		{
+			for (auto iter = m_Targets.begin(); iter != m_Targets.end(); ++iter)
+			{
+				glDeleteTextures(1, &(*iter)->id);
+				delete *iter;
+			}
+			m_Targets.clear();
+
+			if (m_Depth)
+			{
+				glDeleteRenderbuffers(1, &m_Depth->id);
+				delete m_Depth;
+				m_Depth = nullptr;
+			}
+			if (m_Framebuffer)
+			{
+				glDeleteFramebuffers(1, &m_Framebuffer->id);
+				delete m_Framebuffer;
+				m_Framebuffer = nullptr;
+			}
+		}
+
+		void _FrameBuffer::bind(const vec4f& clear)
+		{
+			// Remember the framebuffer being drawn into, so that it can be bound again
+			GLint previous;
+			glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+			m_Previous = previous;
+
+			// Recreate the targets if the viewport has changed size
+			GLint viewport[4];
+			glGetIntegerv(GL_VIEWPORT, viewport);
+			if (!m_Framebuffer || viewport[2] != m_Width || viewport[3] != m_Height)
+			{
+				__destroy();
+				m_Width = viewport[2];
+				m_Height = viewport[3];
+
+				GLuint fbo;
+				glGenFramebuffers(1, &fbo);
+				glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+				m_Framebuffer = new _ID(fbo);
+
+				// Create a texture for each color target
+				std::vector<GLenum> attachments;
+				for (std::size_t k = 0; k < m_Formats.size(); ++k)
+				{
+					GLenum attachment = GL_COLOR_ATTACHMENT0 + (GLenum)k;
+
+					GLuint tex;
+					glGenTextures(1, &tex);
+					glBindTexture(GL_TEXTURE_2D, tex);
+					glTexImage2D(GL_TEXTURE_2D, 0, m_Formats[k], m_Width, m_Height, 0, GL_RGBA, GL_FLOAT, NULL);
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+					glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, tex, 0);
+
+					m_Targets.push_back(new _ID(tex));
+					attachments.push_back(attachment);
+				}
+				glDrawBuffers((GLsizei)attachments.size(), attachments.data());
+
+				// Create a depth buffer in the same format as the default framebuffer, so that it can be copied back
+				GLuint depth;
+				glGenRenderbuffers(1, &depth);
+				glBindRenderbuffer(GL_RENDERBUFFER, depth);
+				glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, m_Width, m_Height);
+				glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+				m_Depth = new _ID(depth);
+
+				if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+					errlog("ONION: Geometry buffer is incomplete.\n");
+				errcheck("Error generated when creating a geometry buffer.");
+			}
+			else
+			{
+				glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer->id);
+			}
+
+			// Clear every target
+			GLfloat values[4] = { clear.get(0), clear.get(1), clear.get(2), clear.get(3) };
+			for (int k = (int)m_Targets.size() - 1; k >= 0; --k)
+				glClearBufferfv(GL_COLOR, k, values);
+			glClear(GL_DEPTH_BUFFER_BIT);
+		}
+
+		void _FrameBuffer::unbind() const
+		{
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, m_Framebuffer->id);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_Previous);
+			glBlitFramebuffer(0, 0, m_Width, m_Height, 0, 0, m_Width, m_Height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+			glBindFramebuffer(GL_FRAMEBUFFER, m_Previous);
+		}
+
+		void _FrameBuffer::blit(int x, int y, int width, int height) const
+		{
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, m_Framebuffer->id);
+			glReadBuffer(GL_COLOR_ATTACHMENT0);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_Previous);
+			glBlitFramebuffer(0, 0, m_Width, m_Height, x, y, x + width, y + height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+			glBindFramebuffer(GL_FRAMEBUFFER, m_Previous);
+		}
+
+		void _FrameBuffer::activate(int target, int slot) const
+		{
+			if (slot >= 0 && slot < 16 && target >= 0 && (std::size_t)target < m_Targets.size()) // Make sure the slot and target are valid
+			{
+				glActiveTexture(GL_TEXTURE0 + slot);
+				glBindTexture(GL_TEXTURE_2D, m_Targets[target]->id);
+			}
+		}
+
+		void _FrameBuffer::display()
+		{
+			if (!m_VAO)
+			{
+				GLuint arr;
+				glGenVertexArrays(1, &arr);
+				m_VAO = new _ID(arr);
+			}
+
+			glBindVertexArray(m_VAO->id);
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+		}
+
+
+
+		std::unordered_map<std::string, _TextureBuffer*> _TextureBuffer::m_Buffers{};
+
+		int _TextureBuffer::m_NextAvailableSlot{ 15 };
+
+		_TextureBuffer::_TextureBuffer(std::string name) : m_Name(name), m_Buffer(nullptr), m_Texture(nullptr), m_Slot(m_NextAvailableSlot--)
+		{
+			m_Buffers.emplace(name, this);
+		}
+
+		_TextureBuffer::~_TextureBuffer()
+		{
+			if (m_Texture)
+			{
+				glDeleteTextures(1, &m_Texture->id);
+				delete m_Texture;
+			}
+			if (m_Buffer)
+			{
+				glDeleteBuffers(1, &m_Buffer->id);
+				delete m_Buffer;
+			}
+
+			m_Buffers.erase(m_Name);
+		}
+
+		_TextureBuffer* _TextureBuffer::get_buffer(std::string name)
+		{
+			auto iter = m_Buffers.find(name);
+			if (iter != m_Buffers.end())
+				return iter->second;
+			return new _TextureBuffer(name);
+		}
+
+		int _TextureBuffer::get_slot() const
+		{
+			return m_Slot;
+		}
+
+		void _TextureBuffer::update(const float* data, std::size_t texels)
+		{
+			__update(data, 4 * sizeof(float) * texels, false);
+		}
+
+		void _TextureBuffer::update(const std::int32_t* data, std::size_t texels)
+		{
+			__update(data, sizeof(std::int32_t) * texels, true);
+		}
+
+		void _TextureBuffer::__update(const void* data, std::size_t bytes, bool integer)
+		{
+			if (!m_Buffer)
+			{
+				// Generate the buffer and the texture that reads from it
+				GLuint buf, tex;
+				glGenBuffers(1, &buf);
+				glGenTextures(1, &tex);
+				errcheck("Error when generating the texture buffer " + m_Name + ".");
+
+				m_Buffer = new _ID(buf);
+				m_Texture = new _ID(tex);
+			}
+
+			// Orphan the old contents so that frames still using them are not stalled
+			glBindBuffer(GL_TEXTURE_BUFFER, m_Buffer->id);
+			glBufferData(GL_TEXTURE_BUFFER, bytes, data, GL_STREAM_DRAW);
+			errcheck("Error when uploading data to the texture buffer " + m_Name + ".");
+
+			// Bind the buffer to its slot, then restore the default slot for other textures
+			if (m_Slot >= 0)
+			{
+				glActiveTexture(GL_TEXTURE0 + m_Slot);
+				glBindTexture(GL_TEXTURE_BUFFER, m_Texture->id);
+				glTexBuffer(GL_TEXTURE_BUFFER, integer ? GL_R32I : GL_RGBA32F, m_Buffer->id);
+				errcheck("Error when binding the texture buffer " + m_Name + " to slot " + std::to_string(m_Slot) + ".");
+				glActiveTexture(GL_TEXTURE0);
+			}
+		}
+
+
+
+
+		void _VertexBufferDisplayer::display(const BUFFER_KEY* starts, const Int* counts, Int num) const
+		{
+			for (Int k = 0; k < num; ++k)
+				display(starts[k], counts[k]);
+		}
+
+		_VertexBuffer* _VertexBufferDisplayer::get_buffer() const
+		{
+			return m_Buffer;
+		}
+
 		void _VertexBufferDisplayer::set_buffer(_VertexBuffer* buffer)
 		{
 			// Free the previous buffer being used, if there was one
@@ -1504,6 +1918,27 @@ namespace onion
 			glDrawArrays(GL_TRIANGLES, start, 6 * count);
 		}
 
+		void _SquareBufferDisplayer::display(const BUFFER_KEY* starts, const Int* counts, Int num) const
+		{
+			// Bind the buffer
+			m_Buffer->activate();
+
+			// Convert each range of squares to a range of vertices
+			std::vector<GLint> first(num);
+			std::vector<GLsizei> vertices(num);
+			for (Int k = num - 1; k >= 0; --k)
+			{
+				first[k] = starts[k];
+				vertices[k] = 6 * counts[k];
+			}
+
+			// Ensure prior commands sent to the GPU are completed
+			synchronize();
+
+			// Display every range with a single call
+			glMultiDrawArrays(GL_TRIANGLES, first.data(), vertices.data(), num);
+		}
+
 	}
 
 
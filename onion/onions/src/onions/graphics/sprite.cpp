@@ -7,16 +7,16 @@ using namespace onion::opengl;
 namespace onion
 {
 
-	Sprite::Sprite(SPRITE_KEY key, int width, int height) : key(key), width(width), height(height) {}
+	Sprite::Sprite(SPRITE_KEY key, int width, int height, SpriteAlpha alpha) : key(key), width(width), height(height), alpha(alpha) {}
 
-	Texture::Texture(const TEXTURE_MATRIX& tex, int width, int height) : tex(tex), width(width), height(height) {}
+	Texture::Texture(const TEXTURE_MATRIX& tex, int width, int height, SpriteAlpha alpha) : tex(tex), width(width), height(height), alpha(alpha) {}
 
-	Texture::Texture(int left, int top, int width, int height, float image_width, float image_height)
+	Texture::Texture(int left, int top, int width, int height, float image_width, float image_height, SpriteAlpha alpha)
 		: tex(
 			-(0.5f * width) / image_width, (0.5f * width) / image_width, 0.f, (left + (0.5f * width)) / image_width,
 			0.f, 0.f, height / image_height, top / image_height
 		),
-		width(width), height(height) {}
+		width(width), height(height), alpha(alpha) {}
 
 
 
@@ -241,6 +241,14 @@ namespace onion
 	}
 	
 	
+	SpriteAlpha _SpriteSheet::__get_alpha(const opengl::_Image* image, int left, int top, int width, int height)
+	{
+		bool transparent, translucent;
+		if (!image->get_transparency(left, top, width, height, transparent, translucent) || translucent)
+			return SPRITE_TRANSLUCENT;
+		return transparent ? SPRITE_ALPHA_TESTED : SPRITE_OPAQUE;
+	}
+
 	Sprite* _SpriteSheet::get_sprite(SPRITE_ID id)
 	{
 		return m_SpriteManager.get(id);
@@ -346,6 +354,7 @@ namespace onion
 
 		// Load the image
 		_Image* image = load_image(path);
+		image->upload();
 
 		// Create the data vector
 		VertexBufferData<FLOAT_VEC2, FLOAT_VEC2> data;
@@ -55,7 +55,8 @@ namespace onion
 	void OrthogonalCamera::__activate()
 	{
 		Application* app = get_application_settings();
-		Transform::projection.ortho(0.f, app->width, 0.f, app->height, app->width, -app->width);
+		int width = app->get_logical_width();
+		Transform::projection.ortho(0.f, width, 0.f, app->get_logical_height(), width, -width);
 	}
 
 }
\ No newline at end of file
@@ -130,4 +130,13 @@ namespace onion
 		);
 	}
 
+
+	Int floor_div(Int n, Int d)
+	{
+		// Division truncates towards zero, so the quotient is one too large when the remainder and the denominator have different signs
+		Int q = n / d;
+		Int r = n % d;
+		return (r != 0 && (r < 0) != (d < 0)) ? q - 1 : q;
+	}
+
 }
\ No newline at end of file
@@ -22,7 +22,8 @@ namespace onion
 		g_State = state;
 
 		Application* app = get_application_settings();
-		g_State->set_bounds(app->width, app->height);
+		g_State->set_bounds(app->get_logical_width(), app->get_logical_height());
+		invalidate_display();
 	}
 
 
@@ -0,0 +1,142 @@
+#include <atomic>
+#include <memory>
+#include "../../include/onions/worker.h"
+
+namespace onion
+{
+
+	WorkerPool::WorkerPool(Uint num_threads)
+	{
+		if (num_threads == 0)
+		{
+			// Leave one hardware thread for the main loop
+			Uint hardware_threads = std::thread::hardware_concurrency();
+			num_threads = hardware_threads > 1 ? hardware_threads - 1 : 1;
+		}
+
+		for (Uint k = 0; k < num_threads; ++k)
+			m_Threads.emplace_back(&WorkerPool::__run, this);
+	}
+
+	WorkerPool::~WorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Stopping = true;
+		}
+		m_TaskQueued.notify_all();
+
+		for (auto iter = m_Threads.begin(); iter != m_Threads.end(); ++iter)
+			iter->join();
+	}
+
+	WorkerPool& WorkerPool::get_shared()
+	{
+		static WorkerPool pool;
+		return pool;
+	}
+
+
+	void WorkerPool::__run()
+	{
+		while (true)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(m_Mutex);
+				m_TaskQueued.wait(lock, [this]() { return m_Stopping || !m_Tasks.empty(); });
+
+				// Only stop once every queued task has been run
+				if (m_Tasks.empty())
+					return;
+
+				task = std::move(m_Tasks.front());
+				m_Tasks.pop_front();
+			}
+
+			task();
+		}
+	}
+
+
+	Uint WorkerPool::get_num_threads() const
+	{
+		return m_Threads.size();
+	}
+
+	void WorkerPool::push(std::function<void()> task)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Tasks.push_back(std::move(task));
+		}
+		m_TaskQueued.notify_one();
+	}
+
+
+	// The progress of a single call to WorkerPool::parallel_for, shared with the tasks it queues.
+	struct ParallelForState
+	{
+		// The next index that has not been handed out.
+		std::atomic<Uint> next{ 0 };
+
+		// The number of indices that have finished.
+		Uint finished = 0;
+
+		// Guards the number of finished indices.
+		std::mutex mutex;
+
+		// Signalled when the last index finishes.
+		std::condition_variable done;
+	};
+
+	/// <summary>Hands out batches of indices until there are none left.</summary>
+	/// <param name="state">The shared progress of the loop.</param>
+	/// <param name="count">The number of indices.</param>
+	/// <param name="batch_size">The number of indices handed out at once.</param>
+	/// <param name="func">The function to call with each index.</param>
+	void run_parallel_for(ParallelForState& state, Uint count, Uint batch_size, const std::function<void(Uint)>& func)
+	{
+		Uint begin;
+		while ((begin = state.next.fetch_add(batch_size)) < count)
+		{
+			Uint end = begin + batch_size < count ? begin + batch_size : count;
+			for (Uint k = begin; k < end; ++k)
+				func(k);
+
+			std::lock_guard<std::mutex> lock(state.mutex);
+			state.finished += end - begin;
+			if (state.finished == count)
+				state.done.notify_all();
+		}
+	}
+
+	void WorkerPool::parallel_for(Uint count, Uint batch_size, const std::function<void(Uint)>& func)
+	{
+		if (batch_size == 0)
+			batch_size = 1;
+
+		// Small ranges aren't worth waking up the workers for
+		if (count <= batch_size || m_Threads.empty())
+		{
+			for (Uint k = 0; k < count; ++k)
+				func(k);
+			return;
+		}
+
+		// Tasks that start after the loop has finished only touch the shared state, never the function
+		std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>();
+
+		Uint num_batches = (count + batch_size - 1) / batch_size;
+		Uint num_tasks = num_batches - 1 < m_Threads.size() ? num_batches - 1 : m_Threads.size();
+		for (Uint k = 0; k < num_tasks; ++k)
+			push([state, count, batch_size, &func]() { run_parallel_for(*state, count, batch_size, func); });
+
+		// Work on the range from this thread as well, then wait for any batches still running elsewhere
+		run_parallel_for(*state, count, batch_size, func);
+
+		std::unique_lock<std::mutex> lock(state->mutex);
+		state->done.wait(lock, [&state, count]() { return state->finished == count; });
+	}
+
+}
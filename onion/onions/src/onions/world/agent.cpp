@@ -1,3 +1,4 @@
+#include <climits>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include "../../../include/onions/world/agent.h"
@@ -7,8 +8,22 @@ namespace onion
 	namespace world
 	{
 		
+		bool ActorID::operator<(const ActorID& other) const
+		{
+			if (origin.get(0) != other.origin.get(0))
+				return origin.get(0) < other.origin.get(0);
+			if (origin.get(1) != other.origin.get(1))
+				return origin.get(1) < other.origin.get(1);
+			return index < other.index;
+		}
+
+
+		std::atomic<Uint> Actor::m_NextID{ 0 };
+
 		Actor::Actor(Shape* bounds, Agent* agent, Graphic3D* graphic) : Object(bounds, graphic), m_SubpixelHandler(bounds)
 		{
+			m_ID.origin = vec2i(INT_MAX, INT_MAX);
+			m_ID.index = m_NextID++;
 			m_Agent = agent;
 		}
 
@@ -18,9 +33,34 @@ namespace onion
 				delete m_Agent;
 		}
 
+		bool Actor::__collision(Object* obj)
+		{
+			return true;
+		}
+
+		const ActorID& Actor::get_id() const
+		{
+			return m_ID;
+		}
+
+		void Actor::set_id(const vec2i& origin, Uint index)
+		{
+			m_ID.origin = origin;
+			m_ID.index = index;
+		}
+
+		const vec3i& Actor::get_subpixels() const
+		{
+			return m_SubpixelHandler.get_subpixels();
+		}
+
 		void Actor::translate(const vec3i& trans)
 		{
 			m_SubpixelHandler.translate(trans);
+
+			// The actor is drawn in its new position on the next frame
+			if (trans.square_sum() > 0)
+				invalidate_display();
 		}
 
 		vec3i Actor::update(const WorldCamera* view, int frames_passed)
@@ -1,5 +1,8 @@
+#include <algorithm>
+#include <limits>
 #include "../../../include/onions/graphics/transform.h"
 #include "../../../include/onions/world/camera.h"
+#include "../../../include/onions/event.h"
 
 namespace onion
 {
@@ -30,9 +33,36 @@ namespace onion
 			{
 				Transform::view.translate(-diff.get(0), -diff.get(1), -diff.get(2));
 				Transform::set_view();
+				invalidate_display();
 			}
 
 			m_Position += trans;
+			m_BoundingBoxOutdated = true;
+		}
+
+		bool WorldCamera::get_visible_span(Int min_y, Int max_y, Int min_z, Int max_z, Int& min_x, Int& max_x) const
+		{
+			const vec3i normal = get_normal();
+			if (normal.get(2) <= 0)
+				return get_ground_span(min_y, max_y, min_x, max_x);
+
+			// A point at height z is seen in the same place as the point on the plane z = 0 that is reached by moving against the normal.
+			// The offset is linear in z, so its extremes are at the minimum and maximum heights. Round them outwards.
+			Int shift[2][2];
+			for (int k = 1; k >= 0; --k)
+			{
+				Int a = normal.get(k) * min_z;
+				Int b = normal.get(k) * max_z;
+				shift[k][0] = floor_div(std::min<Int>(a, b), normal.get(2));
+				shift[k][1] = -floor_div(-std::max<Int>(a, b), normal.get(2));
+			}
+
+			if (!get_ground_span(min_y - shift[1][1], max_y - shift[1][0], min_x, max_x))
+				return false;
+
+			min_x += shift[0][0];
+			max_x += shift[0][1];
+			return true;
 		}
 
 
@@ -52,6 +82,7 @@ namespace onion
 				0
 			);
 			m_ZeroPosition = m_Position - halves - (get_normal() * m_Position.get(2));
+			m_BoundingBoxOutdated = true;
 		}
 
 		void StaticTopDownWorldCamera::translate(const vec3i& trans)
@@ -72,13 +103,24 @@ namespace onion
 			return normal;
 		}
 
+		bool StaticTopDownWorldCamera::get_ground_span(Int min_y, Int max_y, Int& min_x, Int& max_x) const
+		{
+			// The visible part of the plane z = 0 is the frame, placed at the zero position
+			if (max_y < m_ZeroPosition.get(1) || min_y > m_ZeroPosition.get(1) + (m_FrameBounds.get(1, 1) - m_FrameBounds.get(1, 0)))
+				return false;
+
+			min_x = m_ZeroPosition.get(0);
+			max_x = m_ZeroPosition.get(0) + (m_FrameBounds.get(0, 1) - m_FrameBounds.get(0, 0));
+			return true;
+		}
+
 		vec3f StaticTopDownWorldCamera::support(const vec3f& dir) const
 		{
 			const Int near = abs(m_FrameBounds.get(2, 1) - m_FrameBounds.get(2, 0));
 			const vec3i n(0.f, -near, near);
 
 			vec3i res;
-			Float d_max = std::numeric_limits<Float>::min();
+			Float d_max = std::numeric_limits<Float>::lowest();
 
 			for (int c = 7; c >= 0; --c)
 			{
@@ -187,12 +229,77 @@ namespace onion
 			return m_Normal;
 		}
 
+		bool DynamicAxonometricWorldCamera::get_ground_span(Int min_y, Int max_y, Int& min_x, Int& max_x) const
+		{
+			// The visible part of the plane z = 0 is the parallelogram spanned by the radial vectors from the zero position
+			const vec2i corners[4] = {
+				m_ZeroPosition,
+				m_ZeroPosition + m_Radii[0],
+				m_ZeroPosition + m_Radii[0] + m_Radii[1],
+				m_ZeroPosition + m_Radii[1]
+			};
+
+			// The corners wind counterclockwise if the orientation is positive. A flat parallelogram shows nothing.
+			const Int orientation = (m_Radii[0].get(0) * m_Radii[1].get(1)) - (m_Radii[0].get(1) * m_Radii[1].get(0));
+			if (orientation == 0)
+				return false;
+			const Int sign = orientation > 0 ? 1 : -1;
+
+			// Only the rows between the lowest and highest corners can contain visible points
+			Int lowest = corners[0].get(1);
+			Int highest = corners[0].get(1);
+			for (int k = 3; k > 0; --k)
+			{
+				lowest = std::min<Int>(lowest, corners[k].get(1));
+				highest = std::max<Int>(highest, corners[k].get(1));
+			}
+			min_y = std::max<Int>(min_y, lowest);
+			max_y = std::min<Int>(max_y, highest);
+
+			// Find the visible integer points of each row, so that the span covers exactly the points inside the parallelogram
+			bool visible = false;
+			for (Int y = max_y; y >= min_y; --y)
+			{
+				Int row_min = std::numeric_limits<Int>::lowest();
+				Int row_max = std::numeric_limits<Int>::max();
+				bool empty = false;
+
+				for (int k = 3; k >= 0 && !empty; --k)
+				{
+					// A point is inside if it lies on the inner side of every edge, or on the edge itself.
+					// For this row, that limits the x-coordinate to c * x <= d.
+					const vec2i& a = corners[k];
+					const vec2i edge = corners[(k + 1) % 4] - a;
+					Int c = sign * edge.get(1);
+					Int d = sign * ((edge.get(0) * (y - a.get(1))) + (edge.get(1) * a.get(0)));
+
+					if (c > 0)
+						row_max = std::min<Int>(row_max, floor_div(d, c));
+					else if (c < 0)
+						row_min = std::max<Int>(row_min, -floor_div(-d, c));
+					else
+						empty = d < 0;
+				}
+
+				if (!empty && row_min <= row_max)
+				{
+					if (!visible || row_min < min_x)
+						min_x = row_min;
+					if (!visible || row_max > max_x)
+						max_x = row_max;
+					visible = true;
+				}
+			}
+
+			return visible;
+		}
+
 		vec3f DynamicAxonometricWorldCamera::support(const vec3f& dir) const
 		{
 			const vec3f n = m_Normal * (ONION_WORLD_GEOMETRY_SCALE * (m_FrameBounds.get(2, 1) - m_FrameBounds.get(2, 0)) / m_Normal.get(2));
 
 			vec3f res;
-			Float d_max = std::numeric_limits<Float>::min();
+			Float d_max = std::numeric_limits<Float>::lowest();
 
 			for (int c = 7; c >= 0; --c)
 			{
@@ -325,6 +432,8 @@ namespace onion
 				0
 			);
 			m_ZeroPosition = m_Position - halves - (m_Normal * Frac(m_Position.get(2), m_Normal.get(2)));
+			m_BoundingBoxOutdated = true;
+			invalidate_display();
 		}
 
 		void DynamicAxonometricWorldCamera::set_top(float angle)
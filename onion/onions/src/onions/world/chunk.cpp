@@ -1,6 +1,10 @@
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
 #include <regex>
 #include "../../../include/onions/error.h"
+#include "../../../include/onions/worker.h"
 #include "../../../include/onions/world/camera.h"
 #include "../../../include/onions/world/chunk.h"
 #include "../../../include/onions/world/lighting.h"
@@ -14,6 +18,7 @@ namespace onion
 
 
 		std::unordered_map<std::string, Chunk::TileImageManager*> Chunk::m_Images{};
+		std::mutex Chunk::m_ImagesMutex;
 		
 		Chunk::TileImageManager::TileImageManager(opengl::_Image* image, Chunk* chunk) : image(image)
 		{
@@ -37,7 +42,12 @@ namespace onion
 		Chunk::TileRow::TileRow(BUFFER_KEY index, Int count) : index(index), count(count) {}
 
 
-		Chunk::Chunk(const char* path) : m_Path(path) {}
+		Chunk::Chunk(const char* path, const vec2i& origin) : m_Origin(origin), m_Path(path) {}
+
+		Chunk::~Chunk()
+		{
+			unload();
+		}
 
 
 		const opengl::_Image* Chunk::get_tile_image() const
@@ -47,6 +57,9 @@ namespace onion
 
 		void Chunk::set_tile_image(std::string path)
 		{
+			std::lock_guard<std::mutex> lock(m_ImagesMutex);
+
+			m_TileImagePath = path;
 			auto iter = m_Images.find(path);
 			if (iter != m_Images.end())
 			{
@@ -56,14 +69,17 @@ namespace onion
 			}
 			else
 			{
-				// Load an unused image
-				m_TileImage = new opengl::_Image(("world/tiles/" + path).c_str(), true);
+				// Decode an unused image, which is uploaded once the chunk finishes parsing
+				m_TileImage = new opengl::_Image();
+				m_TileImage->decode(("world/tiles/" + path).c_str());
 				m_Images.emplace(path, new TileImageManager(m_TileImage, this));
 			}
 		}
 
 		void Chunk::unset_tile_image()
 		{
+			std::lock_guard<std::mutex> lock(m_ImagesMutex);
+
 			// Unload the tile sprite image, if this was the last chunk using it
 			for (auto iter = m_Images.begin(); iter != m_Images.end(); ++iter)
 			{
@@ -81,9 +97,9 @@ namespace onion
 				}
 			}
 			m_TileImage = nullptr;
+			m_TileImagePath.clear();
 		}
 
-
 		int Chunk::get_index(int x, int y) const
 		{
 			return (m_Dimensions.get(0) * y) + x;
@@ -94,66 +110,565 @@ namespace onion
 			return m_Dimensions;
 		}
 
+		const vec2i& Chunk::get_origin() const
+		{
+			return m_Origin;
+		}
+
+		Uint Chunk::get_memory_usage() const
+		{
+			return m_MemoryUsage;
+		}
+
 		bool Chunk::is_loaded() const
 		{
-			return m_IsLoaded;
+			return m_State == CHUNK_READY;
 		}
 
-		void Chunk::load()
+		ChunkState Chunk::get_state() const
+		{
+			return m_State;
+		}
+
+		std::string Chunk::get_cooked_path(const std::string& path)
+		{
+			std::size_t extension = path.find_last_of('.');
+			if (extension == std::string::npos || path.find_first_of("/\\", extension) != std::string::npos)
+				return path + ".chunk";
+			return path.substr(0, extension) + ".chunk";
+		}
+
+		Object* Chunk::__generate_obj(String id, const StringData& line)
+		{
+			Object* obj = ObjectGenerator::generate(id, line);
+			if (obj)
+			{
+				// Objects are positioned relative to the origin of the chunk. Lights also move the data that is uploaded for them.
+				vec3i offset(m_Origin.get(0), m_Origin.get(1), 0);
+				if (LightObject* light = dynamic_cast<LightObject*>(obj))
+				{
+					light->translate(offset);
+
+					// Seed flickering lights from the chunk and the order they were loaded in, so that they flicker the same way whenever the chunk loads
+					Lighting::Light* data = light->get_light();
+					if (data->flicker_differential != 0.f)
+					{
+						std::uint32_t seed = ((std::uint32_t)m_Origin.get(0) * 73856093u) ^ ((std::uint32_t)m_Origin.get(1) * 19349663u) ^ (m_ObjectCount * 83492791u);
+						data->flicker_seed = seed % 65536;
+					}
+				}
+				else
+					obj->get_bounds()->translate(offset);
+
+				if (Actor* actor = dynamic_cast<Actor*>(obj))
+					actor->set_id(m_Origin, m_ActorCount++);
+			}
+			++m_ObjectCount;
+			return obj;
+		}
+
+		void Chunk::__read_obj(String id, const StringData& line)
+		{
+			if (m_CookedObjects)
+				m_CookedObjects->emplace_back(id, line);
+			else
+				__load_obj(id, line);
+		}
+
+		void Chunk::__scan_file(std::vector<StringData>& tiles)
+		{
+			regex tile_regex("^tile");
+			regex obj_regex("^obj\\s+(.*)");
+
+			vec2i dimensions(0, 0);
+
+			string fpath = string("res/data/world/") + m_Path;
+			LoadFile file(fpath);
+			while (file.good())
+			{
+				StringData line;
+				string id = file.load_data(line);
+
+				smatch match;
+				if (regex_match(id, match, tile_regex))
+				{
+					int x, y;
+					if (line.get("x", x) && line.get("y", y))
+					{
+						int dx, dy;
+						if (!line.get("dx", dx))
+							dx = 1;
+						if (!line.get("dy", dy))
+							dy = 1;
+
+						// Grow the dimensions to fit the tile
+						dimensions(0) = max<Int>(dimensions.get(0), x + dx);
+						dimensions(1) = max<Int>(dimensions.get(1), y + dy);
+
+						tiles.push_back(std::move(line));
+					}
+				}
+				else if (regex_match(id, match, obj_regex))
+				{
+					id = match[1].str();
+					__read_obj(id, line);
+				}
+				else
+				{
+					string img;
+					if (line.get("sprites", img))
+						set_tile_image(img);
+				}
+			}
+
+			// Allocate the tile table once, now that the final dimensions are known
+			m_Dimensions = dimensions;
+			m_Tiles.assign(dimensions.get(0) * dimensions.get(1), Tile());
+		}
+
+		void Chunk::__write_cooked(SaveFile&) const {}
+
+		bool Chunk::__read_cooked(MappedFile&)
+		{
+			return true;
+		}
+
+		bool Chunk::cook(const char* path)
+		{
+			if (m_State != CHUNK_UNLOADED)
+			{
+				errlog("ONION: Cannot cook chunk " + m_Path + " while it is loaded.\n");
+				return false;
+			}
+
+			// Cooked vertices are relative to the origin, and are offset by it when loaded
+			vec2i origin = m_Origin;
+			m_Origin = vec2i(0, 0);
+			m_Dimensions = vec2i(-1, -1);
+			m_Tiles.clear();
+
+			// Parse the text file, collecting the objects rather than generating them
+			std::vector<std::pair<String, StringData>> objects;
+			m_CookedObjects = &objects;
+			opengl::_VertexBufferData* data = __load();
+			m_CookedObjects = nullptr;
+			m_Origin = origin;
+
+			// Chunks without vertex data return NULL
+			std::size_t bytes = 0;
+			char* vertices = data ? data->compile(bytes) : nullptr;
+
+			SaveFile file(string("res/data/world/") + path, true);
+
+			// Write the header
+			file.save_bytes_binary(ONION_CHUNK_COOKED_MAGIC, 4);
+			file.save_int32_binary(ONION_CHUNK_COOKED_VERSION);
+			file.save_int32_binary((int32_t)__hash_source());
+			file.save_int32_binary(m_TileSize);
+			file.save_int32_binary(m_Dimensions.get(0));
+			file.save_int32_binary(m_Dimensions.get(1));
+			file.save_string_binary(m_TileImagePath);
+
+			// Write the tile table
+			for (auto iter = m_Tiles.begin(); iter != m_Tiles.end(); ++iter)
+			{
+				file.save_int_binary(iter->sprite);
+				file.save_int_binary(iter->rotation);
+			}
+			__write_cooked(file);
+
+			// Write the vertex data, aligned so that it can be uploaded straight from the mapped file
+			file.save_int32_binary(__get_vertex_size());
+			file.save_int32_binary(data ? data->buffer_size() : 0);
+			file.align(ONION_CHUNK_COOKED_ALIGNMENT);
+			file.save_bytes_binary(vertices, bytes);
+
+			// Write the objects
+			file.save_int32_binary(objects.size());
+			for (auto iter = objects.begin(); iter != objects.end(); ++iter)
+				file.save_data_binary(iter->first, iter->second);
+
+			bool success = file.good();
+			if (!success)
+				errlog("ONION: Failed to write cooked chunk " + string(path) + ".\n");
+
+			// Discard everything that was loaded
+			delete[] vertices;
+			delete data;
+			unset_tile_image();
+			m_Tiles.clear();
+
+			return success;
+		}
+
+		std::uint32_t Chunk::__hash_source() const
+		{
+			std::ifstream file(string("res/data/world/") + m_Path, std::ios::binary);
+			if (!file.good())
+				return 0;
+
+			// Hash the file in blocks, rather than reading all of it into memory
+			std::uint32_t hash = 2166136261u;
+			char block[4096];
+			while (file.read(block, sizeof(block)) || file.gcount() > 0)
+			{
+				for (std::streamsize k = 0; k < file.gcount(); ++k)
+				{
+					hash ^= (unsigned char)block[k];
+					hash *= 16777619u;
+				}
+			}
+			return hash;
+		}
+
+		MappedFile* Chunk::__load_cooked(char*& vertices, std::size_t& bytes)
+		{
+			string cooked_path = get_cooked_path(m_Path);
+			MappedFile* file = new MappedFile(string("res/data/world/") + cooked_path);
+			if (!file->good())
+			{
+				// There is no cooked file
+				delete file;
+				return nullptr;
+			}
+
+			// Read the header
+			char* magic = file->load_bytes_binary(4);
+			if (!magic || memcmp(magic, ONION_CHUNK_COOKED_MAGIC, 4) != 0 || file->load_int32_binary() != ONION_CHUNK_COOKED_VERSION)
+			{
+				errlog("ONION: Cooked chunk " + cooked_path + " is not in the current format. Loading " + m_Path + " instead.\n");
+				delete file;
+				return nullptr;
+			}
+			if ((std::uint32_t)file->load_int32_binary() != __hash_source())
+			{
+				errlog("ONION: Cooked chunk " + cooked_path + " is older than " + m_Path + ". Loading " + m_Path + " instead.\n");
+				delete file;
+				return nullptr;
+			}
+			if (file->load_int32_binary() != m_TileSize)
+			{
+				errlog("ONION: Cooked chunk " + cooked_path + " was cooked with a different tile size. Loading " + m_Path + " instead.\n");
+				delete file;
+				return nullptr;
+			}
+
+			vec2i dimensions;
+			dimensions(0) = file->load_int32_binary();
+			dimensions(1) = file->load_int32_binary();
+			string img = file->load_string_binary();
+
+			// Read the tile table
+			std::vector<Tile> tiles(std::max<Int>(dimensions.get(0), 0) * std::max<Int>(dimensions.get(1), 0));
+			for (auto iter = tiles.begin(); iter != tiles.end() && file->good(); ++iter)
+			{
+				iter->sprite = file->load_int_binary();
+				iter->rotation = file->load_int_binary();
+			}
+
+			// Read any data specific to the type of chunk
+			bool read_extra = __read_cooked(*file);
+
+			// Read the vertex data
+			std::size_t vertex_size = file->load_int32_binary();
+			std::size_t vertex_count = file->load_int32_binary();
+			file->align(ONION_CHUNK_COOKED_ALIGNMENT);
+			vertices = file->load_bytes_binary(vertex_size * vertex_count);
+
+			// Read the objects
+			std::vector<std::pair<String, StringData>> objects(std::max<Int>(file->load_int32_binary(), 0));
+			for (auto iter = objects.begin(); iter != objects.end() && file->good(); ++iter)
+				iter->first = file->load_data_binary(iter->second);
+
+			if (vertex_size != __get_vertex_size())
+			{
+				errlog("ONION: Cooked chunk " + cooked_path + " was cooked for a different type of chunk. Loading " + m_Path + " instead.\n");
+				delete file;
+				return nullptr;
+			}
+			if (!read_extra || !file->good() || !vertices)
+			{
+				errlog("ONION: Cooked chunk " + cooked_path + " is corrupted. Loading " + m_Path + " instead.\n");
+				delete file;
+				return nullptr;
+			}
+
+			m_Dimensions = dimensions;
+			m_Tiles.swap(tiles);
+			if (!img.empty())
+				set_tile_image(img);
+
+			// Generate the objects, positioned relative to the origin of the chunk
+			for (auto iter = objects.begin(); iter != objects.end(); ++iter)
+				__load_obj(iter->first, iter->second);
+			get_object_manager().build();
+
+			// Offset the position of each vertex by the origin of the chunk, which is always the first attribute. The mapping is copy-on-write, so the file is unchanged.
+			if (m_Origin.get(0) != 0 || m_Origin.get(1) != 0)
+			{
+				for (std::size_t k = 0; k < vertex_count; ++k)
+				{
+					Float pos[2];
+					char* ptr = vertices + (k * vertex_size);
+					memcpy(pos, ptr, sizeof(pos));
+					pos[0] += m_Origin.get(0);
+					pos[1] += m_Origin.get(1);
+					memcpy(ptr, pos, sizeof(pos));
+				}
+			}
+
+			bytes = vertex_size * vertex_count;
+			return file;
+		}
+
+		void Chunk::__finish_parse() {}
+
+		Uint Chunk::__finish_upload()
 		{
-			// Unset the flag saying that the chunk is loaded
-			m_IsLoaded = false;
+			return 0;
+		}
 
+		void Chunk::__finish_unload() {}
+
+		void Chunk::__parse()
+		{
 			// Clear the prior width and height
 			m_Dimensions = vec2i(-1, -1);
+			m_Tiles.clear();
+			m_ActorCount = 0;
+			m_ObjectCount = 0;
+
+			// Map the cooked file if there is one, or otherwise parse the text file, and construct the vertices and objects
+			char* vertices = nullptr;
+			std::size_t bytes = 0;
+			opengl::_VertexBufferData* data = nullptr;
+			MappedFile* file = __load_cooked(vertices, bytes);
+			if (!file)
+				data = __load();
+			__finish_parse();
+
+			std::lock_guard<std::mutex> lock(m_StateMutex);
+			m_PendingData = data;
+			m_PendingFile = file;
+			m_PendingVertices = vertices;
+			m_PendingBytes = bytes;
+			m_State = CHUNK_UPLOADING;
+			m_StateChanged.notify_all();
+		}
 
-			// Load the chunk
+		void Chunk::load()
+		{
+			bool parse_here = false;
+			{
+				std::unique_lock<std::mutex> lock(m_StateMutex);
+				if (m_State == CHUNK_UNLOADED || m_State == CHUNK_QUEUED)
+				{
+					// Parse on this thread rather than waiting for a worker to get to it
+					m_State = CHUNK_PARSING;
+					parse_here = true;
+				}
+				else
+				{
+					m_StateChanged.wait(lock, [this]() { return m_State != CHUNK_PARSING; });
+				}
+			}
+
+			if (parse_here)
+				__parse();
+
+			finish_loading();
+		}
+
+		void Chunk::load_async()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_StateMutex);
+				if (m_State != CHUNK_UNLOADED)
+					return;
+
+				m_State = CHUNK_QUEUED;
+				m_TaskQueued = true;
+			}
+
+			// Object generators load sprite sheets, which must be uploaded from the render thread, so they are loaded before any worker generates an object
+			ObjectGenerator::init();
+
+			WorkerPool::get_shared().push([this]()
+			{
+				bool parse_here = false;
+				{
+					// Skip the load if it was cancelled, or already taken over by load()
+					std::lock_guard<std::mutex> lock(m_StateMutex);
+					if (m_State == CHUNK_QUEUED)
+					{
+						m_State = CHUNK_PARSING;
+						parse_here = true;
+					}
+				}
+
+				if (parse_here)
+					__parse();
+
+				std::lock_guard<std::mutex> lock(m_StateMutex);
+				m_TaskQueued = false;
+				m_StateChanged.notify_all();
+			});
+		}
+
+		bool Chunk::finish_loading()
+		{
+			if (m_State != CHUNK_UPLOADING)
+				return m_State == CHUNK_READY;
+
+			{
+				// Upload the tile image, unless another chunk using it already has
+				std::lock_guard<std::mutex> lock(m_ImagesMutex);
+				if (m_TileImage && !m_TileImage->is_loaded())
+					m_TileImage->upload(true);
+			}
+
+			// Upload the vertex data, straight from the mapped file if the chunk was cooked
 			m_Displayer = new opengl::_SquareBufferDisplayer();
-			m_Displayer->set_buffer(new opengl::_VertexBuffer(__load(), get_tile_shader()->get_attribs()));
+			if (m_PendingFile)
+			{
+				m_MemoryUsage = m_PendingBytes;
+				m_Displayer->set_buffer(new opengl::_VertexBuffer(m_PendingVertices, m_PendingBytes, get_tile_shader()->get_attribs()));
+			}
+			else if (m_PendingData)
+			{
+				m_MemoryUsage = m_PendingData->vertex_size() * m_PendingData->buffer_size();
+				m_Displayer->set_buffer(new opengl::_VertexBuffer(m_PendingData, get_tile_shader()->get_attribs()));
+			}
+			else
+			{
+				// Vertices are still drawn from a buffer, even when the shader builds them without any data
+				m_MemoryUsage = 0;
+				m_Displayer->set_buffer(new opengl::_VertexBuffer(nullptr, 0, get_tile_shader()->get_attribs()));
+			}
+			m_MemoryUsage += __finish_upload();
+
+			// The buffer keeps its own copy of the vertex data
+			delete m_PendingData;
+			m_PendingData = nullptr;
+			delete m_PendingFile;
+			m_PendingFile = nullptr;
+			m_PendingVertices = nullptr;
 
 			// Set the flag saying the chunk is loaded
-			m_IsLoaded = true;
+			m_State = CHUNK_READY;
+			return true;
 		}
 
 		void Chunk::unload()
 		{
-			// Unset the flag saying the chunk is loaded
-			m_IsLoaded = false;
+			{
+				// Cancel a load that hasn't started, and wait for one that has
+				std::unique_lock<std::mutex> lock(m_StateMutex);
+				if (m_State == CHUNK_QUEUED)
+					m_State = CHUNK_UNLOADED;
+				m_StateChanged.wait(lock, [this]() { return !m_TaskQueued; });
+
+				if (m_State == CHUNK_UNLOADED)
+					return;
+				m_State = CHUNK_UNLOADED;
+			}
 
 			// Unset the tile image
 			unset_tile_image();
 
 			// Unset the tile buffer
 			delete m_Displayer;
+			m_Displayer = nullptr;
+			m_MemoryUsage = 0;
+
+			// Discard vertex data that was never uploaded
+			delete m_PendingData;
+			m_PendingData = nullptr;
+			delete m_PendingFile;
+			m_PendingFile = nullptr;
+			m_PendingVertices = nullptr;
+			m_Tiles.clear();
+			__finish_unload();
 		}
 
 		void Chunk::display_tiles() const
 		{
-			if (m_IsLoaded) // Make sure everything is loaded
+			if (is_loaded()) // Make sure everything is loaded
 			{
 				// Activate the tile shader
 				activate_tile_shader();
 
-				// Iterate through all rows of tiles
+				if (m_VisibleTiles.empty())
+					return;
+
+				// Display all visible rows of tiles at once
+				std::vector<BUFFER_KEY> starts;
+				std::vector<Int> counts;
+				starts.reserve(m_VisibleTiles.size());
+				counts.reserve(m_VisibleTiles.size());
 				for (auto iter = m_VisibleTiles.begin(); iter != m_VisibleTiles.end(); ++iter)
-					m_Displayer->display(iter->index, iter->count);
+				{
+					starts.push_back(iter->index);
+					counts.push_back(iter->count);
+				}
+				m_Displayer->display(starts.data(), counts.data(), m_VisibleTiles.size());
 			}
 		}
 
+		void Chunk::__get_sprite_uvs(Int sprite, vec2f* uv) const
+		{
+			const opengl::_Image* img = get_tile_image();
+			int sx = (sprite % (img->get_width() / m_TileSize)) * m_TileSize;
+			int sy = (sprite / (img->get_height() / m_TileSize)) * m_TileSize;
+
+			Float l = (Float)sx / img->get_width();
+			Float r = (Float)(sx + m_TileSize) / img->get_width();
+			Float t = (Float)sy / img->get_height();
+			Float b = (Float)(sy + m_TileSize) / img->get_height();
+
+			uv[TILE_CORNER_BOTTOM_LEFT] = vec2f(l, b);
+			uv[TILE_CORNER_BOTTOM_RIGHT] = vec2f(r, b);
+			uv[TILE_CORNER_TOP_RIGHT] = vec2f(r, t);
+			uv[TILE_CORNER_TOP_LEFT] = vec2f(l, t);
+		}
+
+		void Chunk::__update_vertices(BUFFER_KEY first, const opengl::_VertexBufferData* data)
+		{
+			std::size_t bytes;
+			char* ptr = data->compile(bytes);
+			m_Displayer->get_buffer()->update(first * data->vertex_size(), ptr, bytes);
+			delete[] ptr;
+		}
+
+		bool Chunk::set_tile(Int x, Int y, Int sprite, Int rotation)
+		{
+			if (m_State != CHUNK_READY
+				|| x < 0 || x >= m_Dimensions.get(0)
+				|| y < 0 || y >= m_Dimensions.get(1))
+				return false;
+
+			Tile& tile = m_Tiles[get_index(x, y)];
+			tile.sprite = sprite;
+			tile.rotation = rotation;
+
+			__update_tiles(x, y, x, y);
+			invalidate_display();
+			return true;
+		}
+
+
 
+		ShaderPermutations<FLOAT_MAT4, Int, Int, Int, INT_VEC2, Int>* FlatChunk::m_BasicFlatTileShaders{ nullptr };
 
-		Shader<FLOAT_MAT4, Int, Int>* FlatChunk::m_BasicFlatTileShader{ nullptr };
+		FlatChunk::FlatChunk(const char* path, const vec2i& origin) : Chunk(path, origin) {}
 
-		FlatChunk::FlatChunk(const char* path) : Chunk(path)
+		FlatChunk::~FlatChunk()
 		{
-			if (!m_BasicFlatTileShader)
-				m_BasicFlatTileShader = new Shader<FLOAT_MAT4, Int, Int>(
-					"world/flat_tile_basic",
-					{ "model", "tileTexture", "noiseTexture" }
-				);
+			// The merged graphics must be freed while the chunk is still a flat chunk
+			unload();
 		}
 
-		void FlatChunk::__load_tile(const StringData& line, FlatChunk::buffer_t* data)
+		void FlatChunk::__load_tile(const StringData& line)
 		{
 			int x, y;
 			if (line.get("x", x) && line.get("y", y))
@@ -164,43 +679,6 @@ namespace onion
 				if (!line.get("dy", dy))
 					dy = 1;
 
-				if (x + dx >= m_Dimensions.get(0) || y + dy >= m_Dimensions.get(1))
-				{
-					// Resize the dimensions of the vertex array in the buffer
-
-					int ddx = max(x + dx - m_Dimensions.get(0), 0);
-					int ddy = max(y + dy - m_Dimensions.get(1), 0);
-
-					if (ddx > 0)
-					{
-						if (m_Dimensions.get(0) == 0)
-						{
-							if (m_Dimensions.get(1) > 0)
-							{
-								data->push(6 * ddx * m_Dimensions.get(1));
-							}
-						}
-						else
-						{
-							// Resize the number of vertices per row in the buffer
-							int index = get_index(m_Dimensions.get(0), 1);
-							for (int r = 0; r < m_Dimensions.get(1) - 1; ++r)
-							{
-								data->insert(index, 6 * ddx);
-								index += m_Dimensions.get(0) + ddx;
-							}
-							data->push(6 * ddx);
-						}
-					}
-
-					if (ddy > 0)
-					{
-						data->push(6 * (m_Dimensions.get(0) + ddx) * ddy);
-					}
-
-					m_Dimensions += vec2i(ddx, ddy);
-				}
-
 				int sprite; // The index of the sprite for the tile
 				if (line.get("sprite", sprite))
 				{
@@ -208,34 +686,12 @@ namespace onion
 					if (!line.get("sprite_rot", sprite_rot))
 						sprite_rot = 0;
 
-					const opengl::_Image* img = get_tile_image();
-					int sx = (sprite % (img->get_width() / m_TileSize)) * m_TileSize;
-					int sy = (sprite / (img->get_height() / m_TileSize)) * m_TileSize;
-
-					float l = (float)sx / img->get_width();
-					float r = (float)(sx + m_TileSize) / img->get_width();
-					float t = (float)sy / img->get_height();
-					float b = (float)(sy + m_TileSize) / img->get_height();
-
-					vec2f uv[4];
-					uv[TILE_CORNER_BOTTOM_LEFT] = vec2f(l, b);
-					uv[TILE_CORNER_BOTTOM_RIGHT] = vec2f(r, b);
-					uv[TILE_CORNER_TOP_RIGHT] = vec2f(r, t);
-					uv[TILE_CORNER_TOP_LEFT] = vec2f(l, t);
-
 					for (int i = x; i < x + dx; ++i)
 					{
 						for (int j = y; j < y + dy; ++j)
 						{
-							int index = 6 * get_index(i, j);
-
-							data->set<1>(index + 0, uv[(TILE_CORNER_BOTTOM_LEFT + sprite_rot) % 4]);
-							data->set<1>(index + 1, uv[(TILE_CORNER_BOTTOM_RIGHT + sprite_rot) % 4]);
-							data->set<1>(index + 2, uv[(TILE_CORNER_TOP_RIGHT + sprite_rot) % 4]);
-
-							data->set<1>(index + 3, uv[(TILE_CORNER_BOTTOM_LEFT + sprite_rot) % 4]);
-							data->set<1>(index + 4, uv[(TILE_CORNER_TOP_LEFT + sprite_rot) % 4]);
-							data->set<1>(index + 5, uv[(TILE_CORNER_TOP_RIGHT + sprite_rot) % 4]);
+							m_Tiles[get_index(i, j)].sprite = sprite;
+							m_Tiles[get_index(i, j)].rotation = sprite_rot;
 						}
 					}
 				}
@@ -244,172 +700,376 @@ namespace onion
 
 		void FlatChunk::__load_obj(String id, const StringData& line)
 		{
-			if (Object* obj = ObjectGenerator::generate(id, line))
+			if (Object* obj = __generate_obj(id, line))
 			{
 				m_Manager.add(obj);
+
+				// Keep track of cube lights, which may be baked into the lightmap
+				if (LightObject* light = dynamic_cast<LightObject*>(obj))
+					if (CubeLight* cube = dynamic_cast<CubeLight*>(light->get_light()))
+						m_StaticLights.push_back(cube);
 			}
 		}
 
+		void FlatChunk::__load_file()
+		{
+			// Find the final dimensions first, so that the tile table is allocated once rather than grown as tiles appear
+			std::vector<StringData> tiles;
+			__scan_file(tiles);
+
+			for (auto iter = tiles.begin(); iter != tiles.end(); ++iter)
+				__load_tile(*iter);
+
+			// Lay out the objects in each block now that all of them have been loaded
+			m_Manager.build();
+		}
+
 		opengl::_VertexBufferData* FlatChunk::__load()
 		{
+			__load_file();
+
+			// Set the vertices of each tile, in a buffer that is allocated once
 			buffer_t* data = new buffer_t();
+			data->push(6 * m_Dimensions.get(0) * m_Dimensions.get(1));
+			for (int i = m_Dimensions.get(0) - 1; i >= 0; --i)
+			{
+				for (int j = m_Dimensions.get(1) - 1; j >= 0; --j)
+				{
+					__set_tile_vertices(i, j, data, 6 * get_index(i, j));
+				}
+			}
 
-			regex tile_regex("^tile");
-			regex obj_regex("^obj\\s+(.*)");
+			return data;
+		}
 
-			string fpath = string("res/data/world/") + m_Path;
-			LoadFile file(fpath);
-			while (file.good())
+		void FlatChunk::__set_tile_vertices(Int i, Int j, FlatChunk::buffer_t* data, int index) const
+		{
+			vec2f base_pos = vec2f(m_Origin.get(0) + (m_TileSize * i), m_Origin.get(1) + (m_TileSize * j));
+
+			vec2f pos[4];
+			pos[TILE_CORNER_BOTTOM_LEFT] = base_pos + vec2f(0.f, 0.f);
+			pos[TILE_CORNER_BOTTOM_RIGHT] = base_pos + vec2f(m_TileSize, 0.f);
+			pos[TILE_CORNER_TOP_RIGHT] = base_pos + vec2f(m_TileSize, m_TileSize);
+			pos[TILE_CORNER_TOP_LEFT] = base_pos + vec2f(0.f, m_TileSize);
+
+			data->set<0>(index + 0, pos[TILE_CORNER_BOTTOM_LEFT]);
+			data->set<0>(index + 1, pos[TILE_CORNER_BOTTOM_RIGHT]);
+			data->set<0>(index + 2, pos[TILE_CORNER_TOP_RIGHT]);
+
+			data->set<0>(index + 3, pos[TILE_CORNER_BOTTOM_LEFT]);
+			data->set<0>(index + 4, pos[TILE_CORNER_TOP_LEFT]);
+			data->set<0>(index + 5, pos[TILE_CORNER_TOP_RIGHT]);
+
+			// Tiles without a sprite use the top-left pixel of the image
+			const Tile& tile = m_Tiles[get_index(i, j)];
+			vec2f uv[4];
+			if (tile.sprite >= 0)
+				__get_sprite_uvs(tile.sprite, uv);
+
+			data->set<1>(index + 0, uv[(TILE_CORNER_BOTTOM_LEFT + tile.rotation) % 4]);
+			data->set<1>(index + 1, uv[(TILE_CORNER_BOTTOM_RIGHT + tile.rotation) % 4]);
+			data->set<1>(index + 2, uv[(TILE_CORNER_TOP_RIGHT + tile.rotation) % 4]);
+
+			data->set<1>(index + 3, uv[(TILE_CORNER_BOTTOM_LEFT + tile.rotation) % 4]);
+			data->set<1>(index + 4, uv[(TILE_CORNER_TOP_LEFT + tile.rotation) % 4]);
+			data->set<1>(index + 5, uv[(TILE_CORNER_TOP_RIGHT + tile.rotation) % 4]);
+		}
+
+		void FlatChunk::__update_tiles(Int min_i, Int min_j, Int max_i, Int max_j)
+		{
+			// Each row of tiles is contiguous in the buffer, so each row is uploaded at once
+			for (Int j = min_j; j <= max_j; ++j)
 			{
-				StringData line;
-				string id = file.load_data(line);
+				buffer_t data;
+				data.push(6 * (max_i - min_i + 1));
+				for (Int i = max_i; i >= min_i; --i)
+					__set_tile_vertices(i, j, &data, 6 * (i - min_i));
 
-				smatch match;
-				if (regex_match(id, match, tile_regex))
-				{
-					__load_tile(line, data);
-				}
-				else if (regex_match(id, match, obj_regex))
-				{
-					id = match[1].str();
-					__load_obj(id, line);
-				}
-				else
+				__update_vertices(6 * get_index(min_i, j), &data);
+			}
+		}
+
+		void FlatChunk::__finish_parse()
+		{
+			Int width = m_TileSize * m_Dimensions.get(0);
+			Int height = m_TileSize * m_Dimensions.get(1);
+
+			// Only bake lights that never change, and whose light stays within this chunk, since the lightmap only covers this chunk.
+			// Lights were moved into world space along with their objects when the chunk was loaded.
+			std::vector<CubeLight*> baked;
+			for (auto iter = m_StaticLights.begin(); iter != m_StaticLights.end(); ++iter)
+			{
+				vec2f mins, maxs;
+				(*iter)->get_bounds(mins, maxs);
+				if ((*iter)->flicker_differential == 0.f
+					&& mins.get(0) >= m_Origin.get(0) && maxs.get(0) <= m_Origin.get(0) + width
+					&& mins.get(1) >= m_Origin.get(1) && maxs.get(1) <= m_Origin.get(1) + height)
+					baked.push_back(*iter);
+			}
+
+			// Without any baked lights, a single black texel covers the whole chunk
+			if (baked.empty())
+			{
+				m_LightmapSize = vec2i(1, 1);
+				m_LightmapStep = std::max<Int>(std::max<Int>(width, height), 1);
+				m_LightmapData.assign(3, 0.f);
+				return;
+			}
+
+			// Bake one texel per tile, or coarser if the lightmap would be too large. Shaders filter between the texels.
+			m_LightmapStep = std::max<Int>(m_TileSize, 1);
+			while (width > m_LightmapStep * ONION_CHUNK_LIGHTMAP_MAX || height > m_LightmapStep * ONION_CHUNK_LIGHTMAP_MAX)
+				m_LightmapStep *= 2;
+			Int texels_x = std::max<Int>(1, (width + m_LightmapStep - 1) / m_LightmapStep);
+			Int texels_y = std::max<Int>(1, (height + m_LightmapStep - 1) / m_LightmapStep);
+
+			m_LightmapSize = vec2i(texels_x, texels_y);
+			m_LightmapData.assign(3 * texels_x * texels_y, 0.f);
+
+			// Add the light from each baked light to the texels it can reach, sampling at the center of each texel
+			for (auto iter = baked.begin(); iter != baked.end(); ++iter)
+			{
+				CubeLight* light = *iter;
+				light->baked = true;
+
+				vec2f mins, maxs;
+				light->get_bounds(mins, maxs);
+				int min_x = std::max<int>(floor_div((int)std::floor(mins.get(0)) - m_Origin.get(0), m_LightmapStep), 0);
+				int min_y = std::max<int>(floor_div((int)std::floor(mins.get(1)) - m_Origin.get(1), m_LightmapStep), 0);
+				int max_x = std::min<int>(floor_div((int)std::ceil(maxs.get(0)) - m_Origin.get(0), m_LightmapStep), texels_x - 1);
+				int max_y = std::min<int>(floor_div((int)std::ceil(maxs.get(1)) - m_Origin.get(1), m_LightmapStep), texels_y - 1);
+
+				for (int y = min_y; y <= max_y; ++y)
 				{
-					string img;
-					if (line.get("sprites", img))
-						set_tile_image(img);
+					for (int x = min_x; x <= max_x; ++x)
+					{
+						Float strength = light->get_ground_strength(
+							m_Origin.get(0) + ((x + 0.5f) * m_LightmapStep),
+							m_Origin.get(1) + ((y + 0.5f) * m_LightmapStep)
+						);
+						if (strength != 0.f)
+						{
+							float* texel = &m_LightmapData[3 * (x + (y * texels_x))];
+							for (int k = 2; k >= 0; --k)
+								texel[k] += strength * light->color.get(k);
+						}
+					}
 				}
 			}
+		}
+
+		Uint FlatChunk::__finish_upload()
+		{
+			m_Lightmap = new opengl::_FloatTexture(m_LightmapData.data(), m_LightmapSize.get(0), m_LightmapSize.get(1));
+
+			// The texture keeps its own copy of the lightmap, at half precision
+			Uint bytes = m_LightmapData.size() * 2;
+			m_LightmapData.clear();
+			m_LightmapData.shrink_to_fit();
+
+			return bytes + m_Manager.upload_batch();
+		}
+
+		void FlatChunk::__finish_unload()
+		{
+			m_Manager.clear_batch();
+			delete m_Lightmap;
+			m_Lightmap = nullptr;
+			m_LightmapData.clear();
+			m_StaticLights.clear();
+		}
+
+		int FlatChunk::get_tile_height(int x, int y) const
+		{
+			return 0;
+		}
+
+		const opengl::_Shader* FlatChunk::get_tile_shader() const
+		{
+			// Compiled the first time a chunk is uploaded, so that chunks can be constructed and cooked without a window
+			if (!m_BasicFlatTileShaders)
+				m_BasicFlatTileShaders = new ShaderPermutations<FLOAT_MAT4, Int, Int, Int, INT_VEC2, Int>(
+					"world/flat_tile_basic",
+					{ "model", "tileTexture", "noiseTexture", "lightmap", "lightmapOrigin", "lightmapStep" }
+				);
+			return m_BasicFlatTileShaders->get_default();
+		}
+
+		std::size_t FlatChunk::__get_vertex_size() const
+		{
+			return buffer_t().vertex_size();
+		}
+
+		void FlatChunk::activate_tile_shader() const
+		{
+			Lighting::get_shader(m_BasicFlatTileShaders)->activate(Transform::model.get(), 0, 1, 2, m_Origin, m_LightmapStep);
+			get_tile_image()->activate(0);
+			get_bluenoise_image()->activate(1);
+			if (m_Lightmap)
+				m_Lightmap->activate(2);
+		}
+
+		void FlatChunk::add(Object* obj)
+		{
+			m_Manager.add(obj);
+		}
+
+		ObjectManager& FlatChunk::get_object_manager()
+		{
+			return m_Manager;
+		}
+
+		void FlatChunk::reset_visible(const WorldCamera* view)
+		{
+			// Reset visible tiles
+			m_VisibleTiles.clear();
+
+			// Each row of tiles is visible wherever it overlaps the part of the plane z = 0 that the camera can see
+			for (Int j = 0; j < m_Dimensions.get(1); ++j)
+			{
+				Int min_y = m_Origin.get(1) + (m_TileSize * j);
+
+				Int min_x, max_x;
+				if (!view->get_ground_span(min_y, min_y + m_TileSize - 1, min_x, max_x))
+					continue;
+
+				Int first_i = std::max<Int>(0, floor_div(min_x - m_Origin.get(0), m_TileSize));
+				Int last_i = std::min<Int>(m_Dimensions.get(0) - 1, floor_div(max_x - m_Origin.get(0), m_TileSize));
+
+				// Add the visible row
+				if (first_i <= last_i)
+					m_VisibleTiles.emplace_back(get_index(first_i, j) * 6, last_i - first_i + 1);
+			}
+
+			// Reset visible objects
+			m_Manager.reset_visible(view);
+		}
+
+		void FlatChunk::update_visible(const WorldCamera* view, int frames_passed)
+		{
+			m_Manager.update_visible(view, frames_passed);
+		}
 
-			// Set the position of each vertex
-			for (int i = m_Dimensions.get(0) - 1; i >= 0; --i)
-			{
-				for (int j = m_Dimensions.get(1) - 1; j >= 0; --j)
-				{
-					vec2f base_pos = vec2f(m_TileSize * i, m_TileSize * j);
+		void FlatChunk::display_opaque_objects(const vec3i& normal) const
+		{
+			m_Manager.display_opaque(normal);
+		}
 
-					vec2f pos[4];
-					pos[TILE_CORNER_BOTTOM_LEFT] = base_pos + vec2f(0.f, 0.f);
-					pos[TILE_CORNER_BOTTOM_RIGHT] = base_pos + vec2f(m_TileSize, 0.f);
-					pos[TILE_CORNER_TOP_RIGHT] = base_pos + vec2f(m_TileSize, m_TileSize);
-					pos[TILE_CORNER_TOP_LEFT] = base_pos + vec2f(0.f, m_TileSize);
+		void FlatChunk::display_translucent_objects(const vec3i& normal) const
+		{
+			m_Manager.display_translucent(normal);
+		}
 
-					int index = 6 * get_index(i, j);
 
-					data->set<0>(index + 0, pos[TILE_CORNER_BOTTOM_LEFT]);
-					data->set<0>(index + 1, pos[TILE_CORNER_BOTTOM_RIGHT]);
-					data->set<0>(index + 2, pos[TILE_CORNER_TOP_RIGHT]);
 
-					data->set<0>(index + 3, pos[TILE_CORNER_BOTTOM_LEFT]);
-					data->set<0>(index + 4, pos[TILE_CORNER_TOP_LEFT]);
-					data->set<0>(index + 5, pos[TILE_CORNER_TOP_RIGHT]);
-				}
-			}
+		ShaderPermutations<FLOAT_MAT4, Int, Int, Int, INT_VEC2, Int, Int, Int>* TileMapChunk::m_TileMapShaders{ nullptr };
 
-			return data;
-		}
+		TileMapChunk::TileMapChunk(const char* path, const vec2i& origin) : FlatChunk(path, origin) {}
 
-		int FlatChunk::get_tile_height(int x, int y) const
+		TileMapChunk::~TileMapChunk()
 		{
-			return 0;
+			// The tile map must be freed while the chunk is still a tile map chunk
+			unload();
 		}
 
-		const opengl::_Shader* FlatChunk::get_tile_shader() const
+		opengl::_VertexBufferData* TileMapChunk::__load()
 		{
-			return m_BasicFlatTileShader;
+			__load_file();
+			return nullptr;
 		}
 
-		void FlatChunk::activate_tile_shader() const
+		std::size_t TileMapChunk::__get_vertex_size() const
 		{
-			m_BasicFlatTileShader->activate(Transform::model.get(), 0, 1);
-			get_tile_image()->activate(0);
-			get_bluenoise_image()->activate(1);
+			return 0;
 		}
 
-		void FlatChunk::add(Object* obj)
+		void TileMapChunk::__finish_parse()
 		{
-			m_Manager.add(obj);
+			FlatChunk::__finish_parse();
+
+			m_TileRecords.resize(2 * m_Tiles.size());
+			for (int k = m_Tiles.size() - 1; k >= 0; --k)
+			{
+				m_TileRecords[(2 * k) + 0] = m_Tiles[k].sprite;
+				m_TileRecords[(2 * k) + 1] = m_Tiles[k].rotation;
+			}
 		}
 
-		void FlatChunk::reset_visible(const WorldCamera* view)
+		Uint TileMapChunk::__finish_upload()
 		{
-			// Reset visible tiles
-			// TODO do this more efficiently???
-			m_VisibleTiles.clear();
-
-			const Int max_allowed = type_limits<Int>::max();
+			Uint bytes = FlatChunk::__finish_upload();
+			if (m_Tiles.empty())
+				return bytes;
 
-			UprightRectangle r(vec3i(), vec3i(0, max_allowed, max_allowed));
-			Int min_x = r.get_distance(view);
+			m_TileMap = new opengl::_IntegerTexture(m_TileRecords.data(), m_Dimensions.get(0), m_Dimensions.get(1));
 
-			r.translate(vec3i(max_allowed, 0, 0));
-			Int max_x = max_allowed - r.get_distance(view);
+			// The texture keeps its own copy of the records
+			bytes += m_TileRecords.size() * sizeof(std::int16_t);
+			m_TileRecords.clear();
+			m_TileRecords.shrink_to_fit();
+			return bytes;
+		}
 
-			r = UprightRectangle(vec3i(), vec3i(max_allowed, 0, max_allowed));
-			Int min_y = r.get_distance(view);
+		void TileMapChunk::__finish_unload()
+		{
+			FlatChunk::__finish_unload();
+			delete m_TileMap;
+			m_TileMap = nullptr;
+			m_TileRecords.clear();
+		}
 
-			r.translate(vec3i(0, max_allowed, 0));
-			Int max_y = r.get_distance(view);
+		void TileMapChunk::__update_tiles(Int min_i, Int min_j, Int max_i, Int max_j)
+		{
+			if (!m_TileMap)
+				return;
 
-			Int min_j = std::max<Int>(0, min_y / m_TileSize);
-			Int max_j = std::min<Int>(m_Dimensions.get(1) - 1, max_y / m_TileSize);
+			std::vector<std::int16_t> records;
+			records.reserve(2 * (max_i - min_i + 1) * (max_j - min_j + 1));
 			for (Int j = min_j; j <= max_j; ++j)
 			{
-				Int first_i = std::numeric_limits<Int>::min(), last_i = std::numeric_limits<Int>::max();
-
-				Int min_i = std::max<Int>(0, min_x / m_TileSize);
-				Int max_i = std::min<Int>(m_Dimensions.get(0) - 1, max_x / m_TileSize);
 				for (Int i = min_i; i <= max_i; ++i)
 				{
-					for (int k = 3; k >= 0; --k)
-					{
-						// Calculate the 3D position of the corner
-						Point corner(vec3i(
-							k % 2 == 0 ? m_TileSize * i : (m_TileSize * (i + 1)) - 1,
-							k / 2 == 0 ? m_TileSize * j : (m_TileSize * (j + 1)) - 1,
-							0
-						));
-
-						// Calculate whether the corner is visible
-						if (corner.get_distance(view) == 0)
-						{
-							if (first_i < 0)
-								first_i = i;
-							last_i = i;
-							break;
-						}
-					}
-
-					// Break if at the end of the visible row
-					if (last_i < i)
-						break;
+					const Tile& tile = m_Tiles[get_index(i, j)];
+					records.push_back(tile.sprite);
+					records.push_back(tile.rotation);
 				}
-
-				// Add the visible row
-				if (first_i >= 0)
-					m_VisibleTiles.emplace_back(get_index(first_i, j) * 6, last_i - first_i + 1);
 			}
 
-			// Reset visible objects
-			m_Manager.reset_visible(view);
+			m_TileMap->update(min_i, min_j, max_i - min_i + 1, max_j - min_j + 1, records.data());
 		}
 
-		void FlatChunk::update_visible(const WorldCamera* view, int frames_passed)
+		const opengl::_Shader* TileMapChunk::get_tile_shader() const
 		{
-			m_Manager.update_visible(view, frames_passed);
+			if (!m_TileMapShaders)
+				m_TileMapShaders = new ShaderPermutations<FLOAT_MAT4, Int, Int, Int, INT_VEC2, Int, Int, Int>(
+					"world/flat_tile_map",
+					{ "model", "tileTexture", "noiseTexture", "tileMap", "origin", "tileSize", "lightmap", "lightmapStep" }
+				);
+			return m_TileMapShaders->get_default();
 		}
 
-		void FlatChunk::display_objects(const vec3i& normal) const
+		void TileMapChunk::activate_tile_shader() const
 		{
-			m_Manager.display(normal);
+			Lighting::get_shader(m_TileMapShaders)->activate(Transform::model.get(), 0, 1, 2, m_Origin, m_TileSize, 3, m_LightmapStep);
+			get_tile_image()->activate(0);
+			get_bluenoise_image()->activate(1);
+			if (m_TileMap)
+				m_TileMap->activate(2);
+			if (m_Lightmap)
+				m_Lightmap->activate(3);
 		}
 
 
 
-		SmoothChunk::SmoothChunk(const char* path) : Chunk(path) {}
+		SmoothChunk::SmoothChunk(const char* path, const vec2i& origin) : Chunk(path, origin) {}
+
+		SmoothChunk::~SmoothChunk()
+		{
+			// The merged graphics must be freed while the chunk is still a smooth chunk
+			unload();
+		}
 
-		void SmoothChunk::__load_tile(const StringData& line, SmoothChunk::buffer_t* data)
+		void SmoothChunk::__load_tile(const StringData& line)
 		{
 			int x, y;
 			if (line.get("x", x) && line.get("y", y))
@@ -420,56 +1080,6 @@ namespace onion
 				if (!line.get("dy", dy))
 					dy = 1;
 
-				if (x + dx >= m_Dimensions.get(0) || y + dy >= m_Dimensions.get(1))
-				{
-					// Resize the dimensions of the vertex array in the buffer
-
-					int ddx = max(x + dx - m_Dimensions.get(0), 0);
-					int ddy = max(y + dy - m_Dimensions.get(1), 0);
-
-					if (ddx > 0)
-					{
-						if (m_Dimensions.get(0) == 0)
-						{
-							if (m_Dimensions.get(1) > 0)
-							{
-								data->push(6 * ddx * m_Dimensions.get(1));
-								m_TileCornerHeights.insert(
-									m_TileCornerHeights.end(), 
-									(ddx + 1) * (m_Dimensions.get(1) + 1),
-									0
-								);
-							}
-						}
-						else
-						{
-							// Resize the number of vertices per row in the buffer
-							int index = get_index(m_Dimensions.get(0), 1);
-							for (int r = 0; r < m_Dimensions.get(1) - 1; ++r)
-							{
-								data->insert(6 * index, 6 * ddx);
-								m_TileCornerHeights.insert(m_TileCornerHeights.begin() + (index + r), ddx, 0);
-								index += m_Dimensions.get(0) + ddx;
-							}
-							data->push(6 * ddx);
-							m_TileCornerHeights.insert(m_TileCornerHeights.end(), ddx, 0);
-						}
-					}
-
-					if (ddy > 0)
-					{
-						data->push(6 * (m_Dimensions.get(0) + ddx) * ddy);
-
-						m_TileCornerHeights.insert(
-							m_TileCornerHeights.end(),
-							(m_Dimensions.get(0) + ddx + 1) * (m_Dimensions.get(1) > 0 ? ddy : ddy + 1),
-							0
-						);
-					}
-
-					m_Dimensions += vec2i(ddx, ddy);
-				}
-
 				Int heights[4] = { -1, -1, -1, -1 };
 				if (line.get("bottom_left_height", heights[TILE_CORNER_BOTTOM_LEFT]) 
 					|| line.get("bottom_right_height", heights[TILE_CORNER_BOTTOM_RIGHT])
@@ -481,7 +1091,7 @@ namespace onion
 						if (heights[k] < 0)
 						{
 							// If the height wasn't set for that corner, use the previous height of that corner
-							heights[k] = get_tile_height(
+							heights[k] = __get_tile_height(
 								m_TileSize * ((k + (k / 2)) % 2 == 0 ? x : x + dx),
 								m_TileSize * (k / 2 == 0 ? y : y + dy)
 							);
@@ -504,40 +1114,12 @@ namespace onion
 					if (!line.get("rotation", sprite_rot))
 						sprite_rot = 0;
 
-					const opengl::_Image* img = get_tile_image();
-					int sx = (sprite % (img->get_width() / m_TileSize)) * m_TileSize;
-					int sy = (sprite / (img->get_height() / m_TileSize)) * m_TileSize;
-
-					Float l = (Float)sx / img->get_width();
-					Float r = (Float)(sx + m_TileSize) / img->get_width();
-					Float t = (Float)sy / img->get_height();
-					Float b = (Float)(sy + m_TileSize) / img->get_height();
-
-					vec2f uv[4];
-					uv[TILE_CORNER_BOTTOM_LEFT] = vec2f(l, b);
-					uv[TILE_CORNER_BOTTOM_RIGHT] = vec2f(r, b);
-					uv[TILE_CORNER_TOP_RIGHT] = vec2f(r, t);
-					uv[TILE_CORNER_TOP_LEFT] = vec2f(l, t);
-
 					for (int i = x; i < x + dx; ++i)
 					{
 						for (int j = y; j < y + dy; ++j)
 						{
-							// The order in which vertices are inserted
-							int ordering[6] = {
-								TILE_CORNER_BOTTOM_LEFT,
-								TILE_CORNER_BOTTOM_RIGHT,
-								i + j % 2 == 0 ? TILE_CORNER_TOP_RIGHT : TILE_CORNER_TOP_LEFT,
-
-								i + j % 2 == 0 ? TILE_CORNER_BOTTOM_LEFT : TILE_CORNER_BOTTOM_RIGHT,
-								TILE_CORNER_TOP_LEFT,
-								TILE_CORNER_TOP_RIGHT
-							};
-
-							// Insert the texture uv information into the buffer for each vertex
-							int index = 6 * get_index(i, j);
-							for (int k = 5; k >= 0; --k)
-								data->set<2>(index + k, uv[(ordering[k] + sprite_rot) % 4]);
+							m_Tiles[get_index(i, j)].sprite = sprite;
+							m_Tiles[get_index(i, j)].rotation = sprite_rot;
 						}
 					}
 				}
@@ -546,7 +1128,7 @@ namespace onion
 
 		void SmoothChunk::__load_obj(String id, const StringData& line)
 		{
-			if (Object* obj = ObjectGenerator::generate(id, line))
+			if (Object* obj = __generate_obj(id, line))
 			{
 				m_Manager.add(obj);
 			}
@@ -554,116 +1136,76 @@ namespace onion
 
 		opengl::_VertexBufferData* SmoothChunk::__load()
 		{
+			// Find the final dimensions first, so that the buffer and corner heights are allocated once rather than grown as tiles appear
+			std::vector<StringData> tiles;
+			__scan_file(tiles);
+
 			buffer_t* data = new buffer_t();
-			m_Dimensions = vec2i(0, 0);
+			data->push(6 * m_Dimensions.get(0) * m_Dimensions.get(1));
+			m_TileCornerHeights.assign((m_Dimensions.get(0) + 1) * (m_Dimensions.get(1) + 1), 0);
 
-			regex tile_regex("^tile");
-			regex obj_regex("^obj\\s+(.*)");
+			for (auto iter = tiles.begin(); iter != tiles.end(); ++iter)
+				__load_tile(*iter);
 
-			string fpath = string("res/data/world/") + m_Path;
-			LoadFile file(fpath);
-			while (file.good())
-			{
-				StringData line;
-				string id = file.load_data(line);
+			// Lay out the objects in each block now that all of them have been loaded
+			m_Manager.build();
 
-				smatch match;
-				if (regex_match(id, match, tile_regex))
-				{
-					__load_tile(line, data);
-				}
-				else if (regex_match(id, match, obj_regex))
-				{
-					id = match[1].str();
-					__load_obj(id, line);
-				}
-				else
-				{
-					string img;
-					if (line.get("sprites", img))
-						set_tile_image(img);
-				}
-			}
+			Int width = m_Dimensions.get(0);
+			Int height = m_Dimensions.get(1);
 
-			// Determine the normal vector of each face on each tile
-			std::vector<vec3f> face_normals(2 * m_Dimensions.get(0) * m_Dimensions.get(1));
-			for (int i = m_Dimensions.get(0) - 1; i >= 0; --i)
+			// Determine the normal vector of each face on each tile, with each component in its own array
+			std::vector<Float> face_x(2 * width * height), face_y(2 * width * height), face_z(2 * width * height);
+			WorkerPool::get_shared().parallel_for(height, ONION_CHUNK_PARALLEL_ROWS, [&](Uint row)
 			{
-				for (int j = m_Dimensions.get(1) - 1; j >= 0; --j)
+				int j = row;
+				for (int i = 0; i < width; ++i)
 				{
-					int index = 2 * get_index(i, j);
-
-					int heights[4] = {
-						m_TileCornerHeights[get_index(i, j) + j],
-						m_TileCornerHeights[get_index(i + 1, j) + j],
-						m_TileCornerHeights[get_index(i + 1, j + 1) + j + 1],
-						m_TileCornerHeights[get_index(i, j + 1) + j + 1]
-					};
+					vec3f normals[2];
+					__get_face_normals(i, j, normals);
 
-					if (i + j % 2 == 0)
-					{
-						// Faces are:
-						//		bottom-left, bottom-right, top-right
-						//		bottom-left, top-left, top-right
-						vec3i(
-							heights[TILE_CORNER_BOTTOM_LEFT] - heights[TILE_CORNER_BOTTOM_RIGHT],
-							heights[TILE_CORNER_BOTTOM_RIGHT] - heights[TILE_CORNER_TOP_RIGHT],
-							m_TileSize
-						).normalize(face_normals[index + 0]);
-						vec3i(
-							heights[TILE_CORNER_TOP_LEFT] - heights[TILE_CORNER_TOP_RIGHT],
-							heights[TILE_CORNER_BOTTOM_LEFT] - heights[TILE_CORNER_TOP_LEFT],
-							m_TileSize
-						).normalize(face_normals[index + 1]);
-					}
-					else
+					int index = 2 * get_index(i, j);
+					for (int k = 1; k >= 0; --k)
 					{
-						// Faces are:
-						//		bottom-left, bottom-right, top-left
-						//		top-right, bottom-right, top-left
-						vec3i(
-							heights[TILE_CORNER_BOTTOM_LEFT] - heights[TILE_CORNER_BOTTOM_RIGHT],
-							heights[TILE_CORNER_BOTTOM_LEFT] - heights[TILE_CORNER_TOP_LEFT],
-							m_TileSize
-						).normalize(face_normals[index + 0]);
-						vec3i(
-							heights[TILE_CORNER_BOTTOM_RIGHT] - heights[TILE_CORNER_TOP_RIGHT],
-							heights[TILE_CORNER_TOP_LEFT] - heights[TILE_CORNER_TOP_RIGHT],
-							m_TileSize
-						).normalize(face_normals[index + 1]);
+						face_x[index + k] = normals[k].get(0);
+						face_y[index + k] = normals[k].get(1);
+						face_z[index + k] = normals[k].get(2);
 					}
 				}
-			}
+			});
 
-			// Determine the normal vector of each vertex
-			std::vector<vec3f> vertex_normals((m_Dimensions.get(0) + 1) * (m_Dimensions.get(1) + 1));
-			for (int i = m_Dimensions.get(0); i >= 0; --i)
+			// Determine the normal vector of each vertex, by averaging the faces of the tiles around it
+			std::vector<Float> vertex_x((width + 1) * (height + 1)), vertex_y((width + 1) * (height + 1)), vertex_z((width + 1) * (height + 1));
+			WorkerPool::get_shared().parallel_for(height + 1, ONION_CHUNK_PARALLEL_ROWS, [&](Uint row)
 			{
-				for (int j = m_Dimensions.get(1); j >= 0; --j)
+				int j = row;
+				for (int i = 0; i <= width; ++i)
 				{
-					vec3f normal_sum;
+					Float sum_x = 0.f, sum_y = 0.f, sum_z = 0.f;
 					int normal_count = 0;
 
 					for (int di = -1; di <= 0; ++di)
 					{
 						for (int dj = -1; dj <= 0; ++dj)
 						{
-							if (i + di < m_Dimensions.get(0) && i + di >= 0
-								&& j + dj < m_Dimensions.get(1) && j + dj >= 0)
+							if (i + di < width && i + di >= 0
+								&& j + dj < height && j + dj >= 0)
 							{
 								int index = 2 * get_index(i + di, j + dj);
-								vec3f norm;
 
 								if (i + j % 2 == 0)
 								{
 									// Add both normals
-									normal_sum += face_normals[index + 0];
-									normal_sum += face_normals[index + 1];
+									sum_x += face_x[index + 0] + face_x[index + 1];
+									sum_y += face_y[index + 0] + face_y[index + 1];
+									sum_z += face_z[index + 0] + face_z[index + 1];
 									normal_count += 2;
 								}
 								else
 								{
-									normal_sum += face_normals[index + (dj == 0 ? 0 : 1)];
+									index += dj == 0 ? 0 : 1;
+									sum_x += face_x[index];
+									sum_y += face_y[index];
+									sum_z += face_z[index];
 									++normal_count;
 								}
 							}
@@ -671,66 +1213,216 @@ namespace onion
 					}
 
 					// Shouldn't need to ensure no division by zero because there should always be at least 1 normal being summed
-					vertex_normals[get_index(i, j) + j] = normal_sum / normal_count;
+					int corner_index = ((width + 1) * j) + i;
+					vertex_x[corner_index] = sum_x / normal_count;
+					vertex_y[corner_index] = sum_y / normal_count;
+					vertex_z[corner_index] = sum_z / normal_count;
 				}
-			}
+			});
 
-			// Set the position and normal vector for each corner of every tile
-			for (int i = m_Dimensions.get(0) - 1; i >= 0; --i)
+			// Set the vertices of each tile
+			WorkerPool::get_shared().parallel_for(height, ONION_CHUNK_PARALLEL_ROWS, [&](Uint row)
 			{
-				for (int j = m_Dimensions.get(1) - 1; j >= 0; --j)
+				int j = row;
+				for (int i = 0; i < width; ++i)
 				{
-					// The order in which vertices are inserted
-					int ordering[6] = {
-						TILE_CORNER_BOTTOM_LEFT,
-						TILE_CORNER_BOTTOM_RIGHT,
-						i + j % 2 == 0 ? TILE_CORNER_TOP_RIGHT : TILE_CORNER_TOP_LEFT,
-
-						i + j % 2 == 0 ? TILE_CORNER_BOTTOM_LEFT : TILE_CORNER_BOTTOM_RIGHT,
-						TILE_CORNER_TOP_LEFT,
-						TILE_CORNER_TOP_RIGHT
-					};
-
-					// Calculate the position and retrieve the normal vector of each vertex
-					vec3f base_pos = vec3f(m_TileSize * i, m_TileSize * j, 0.f);
-
-					vec3f pos[4], normal[4];
-					pos[TILE_CORNER_BOTTOM_LEFT] = base_pos + vec3f(0.f, 0.f, 0.f);
-					pos[TILE_CORNER_BOTTOM_RIGHT] = base_pos + vec3f(m_TileSize, 0.f, 0.f);
-					pos[TILE_CORNER_TOP_RIGHT] = base_pos + vec3f(m_TileSize, m_TileSize, 0.f);
-					pos[TILE_CORNER_TOP_LEFT] = base_pos + vec3f(0.f, m_TileSize, 0.f);
-
+					// The index of each corner in the vertex normals
+					int corners[4];
+					corners[TILE_CORNER_BOTTOM_LEFT] = ((width + 1) * j) + i;
+					corners[TILE_CORNER_BOTTOM_RIGHT] = corners[TILE_CORNER_BOTTOM_LEFT] + 1;
+					corners[TILE_CORNER_TOP_LEFT] = corners[TILE_CORNER_BOTTOM_LEFT] + width + 1;
+					corners[TILE_CORNER_TOP_RIGHT] = corners[TILE_CORNER_TOP_LEFT] + 1;
+
+					vec3f normals[4];
 					for (int k = 3; k >= 0; --k)
-					{
-						vec2i corner(pos[k] / m_TileSize);
-						int corner_index = get_index(corner.get(0), corner.get(1)) + corner.get(1);
+						normals[k] = vec3f(vertex_x[corners[k]], vertex_y[corners[k]], vertex_z[corners[k]]);
 
-						pos[k](2) = m_TileCornerHeights[corner_index];
-						normal[k] = vertex_normals[corner_index];
-					}
+					__set_tile_vertices(i, j, normals, data, 6 * get_index(i, j));
+				}
+			});
+
+			return data;
+		}
+
+		void SmoothChunk::__get_face_normals(Int i, Int j, vec3f* normals) const
+		{
+			const Int* bottom = m_TileCornerHeights.data() + ((m_Dimensions.get(0) + 1) * j);
+			const Int* top = bottom + (m_Dimensions.get(0) + 1);
+			Int heights[4] = { bottom[i], bottom[i + 1], top[i + 1], top[i] };
+
+			// The unnormalized x- and y-components of each face. The z-component is always the tile size.
+			Float x[2], y[2];
+			if (i + j % 2 == 0)
+			{
+				// Faces are:
+				//		bottom-left, bottom-right, top-right
+				//		bottom-left, top-left, top-right
+				x[0] = heights[TILE_CORNER_BOTTOM_LEFT] - heights[TILE_CORNER_BOTTOM_RIGHT];
+				y[0] = heights[TILE_CORNER_BOTTOM_RIGHT] - heights[TILE_CORNER_TOP_RIGHT];
+				x[1] = heights[TILE_CORNER_TOP_LEFT] - heights[TILE_CORNER_TOP_RIGHT];
+				y[1] = heights[TILE_CORNER_BOTTOM_LEFT] - heights[TILE_CORNER_TOP_LEFT];
+			}
+			else
+			{
+				// Faces are:
+				//		bottom-left, bottom-right, top-left
+				//		top-right, bottom-right, top-left
+				x[0] = heights[TILE_CORNER_BOTTOM_LEFT] - heights[TILE_CORNER_BOTTOM_RIGHT];
+				y[0] = heights[TILE_CORNER_BOTTOM_LEFT] - heights[TILE_CORNER_TOP_LEFT];
+				x[1] = heights[TILE_CORNER_BOTTOM_RIGHT] - heights[TILE_CORNER_TOP_RIGHT];
+				y[1] = heights[TILE_CORNER_TOP_LEFT] - heights[TILE_CORNER_TOP_RIGHT];
+			}
+
+			Float tile_size = m_TileSize;
+			for (int k = 1; k >= 0; --k)
+			{
+				Float mag = sqrt((x[k] * x[k]) + (y[k] * y[k]) + (tile_size * tile_size));
+				normals[k] = vec3f(x[k] / mag, y[k] / mag, tile_size / mag);
+			}
+		}
+
+		vec3f SmoothChunk::__get_vertex_normal(Int x, Int y) const
+		{
+			vec3f sum;
+			int normal_count = 0;
 
-					// Insert the vertex information into the buffer
-					int index = 6 * get_index(i, j);
-					for (int k = 5; k >= 0; --k)
+			for (int di = -1; di <= 0; ++di)
+			{
+				for (int dj = -1; dj <= 0; ++dj)
+				{
+					if (x + di < m_Dimensions.get(0) && x + di >= 0
+						&& y + dj < m_Dimensions.get(1) && y + dj >= 0)
 					{
-						data->set<0>(index + k, pos[ordering[k]]);
-						data->set<1>(index + k, normal[ordering[k]]);
+						vec3f faces[2];
+						__get_face_normals(x + di, y + dj, faces);
+
+						if (x + y % 2 == 0)
+						{
+							// Add both normals
+							sum += faces[0] + faces[1];
+							normal_count += 2;
+						}
+						else
+						{
+							sum += faces[dj == 0 ? 0 : 1];
+							++normal_count;
+						}
 					}
 				}
 			}
 
-			return data;
+			// Shouldn't need to ensure no division by zero because there should always be at least 1 normal being summed
+			return sum / (Float)normal_count;
+		}
+
+		void SmoothChunk::__set_tile_vertices(Int i, Int j, const vec3f* normals, SmoothChunk::buffer_t* data, int index) const
+		{
+			// The order in which vertices are inserted
+			int ordering[6] = {
+				TILE_CORNER_BOTTOM_LEFT,
+				TILE_CORNER_BOTTOM_RIGHT,
+				i + j % 2 == 0 ? TILE_CORNER_TOP_RIGHT : TILE_CORNER_TOP_LEFT,
+
+				i + j % 2 == 0 ? TILE_CORNER_BOTTOM_LEFT : TILE_CORNER_BOTTOM_RIGHT,
+				TILE_CORNER_TOP_LEFT,
+				TILE_CORNER_TOP_RIGHT
+			};
+
+			// The position of each corner, offset by the origin of the chunk
+			const Int* bottom = m_TileCornerHeights.data() + ((m_Dimensions.get(0) + 1) * j);
+			const Int* top = bottom + (m_Dimensions.get(0) + 1);
+			Int heights[4] = { bottom[i], bottom[i + 1], top[i + 1], top[i] };
+
+			vec3f pos[4];
+			for (int k = 3; k >= 0; --k)
+			{
+				pos[k] = vec3f(
+					m_Origin.get(0) + (m_TileSize * (i + ((k + (k / 2)) % 2))),
+					m_Origin.get(1) + (m_TileSize * (j + (k / 2))),
+					heights[k]
+				);
+			}
+
+			// Tiles without a sprite use the top-left pixel of the image
+			const Tile& tile = m_Tiles[get_index(i, j)];
+			vec2f uv[4];
+			if (tile.sprite >= 0)
+				__get_sprite_uvs(tile.sprite, uv);
+
+			for (int k = 5; k >= 0; --k)
+			{
+				data->set<0>(index + k, pos[ordering[k]]);
+				data->set<1>(index + k, normals[ordering[k]]);
+				data->set<2>(index + k, uv[(ordering[k] + tile.rotation) % 4]);
+			}
+		}
+
+		void SmoothChunk::__update_tiles(Int min_i, Int min_j, Int max_i, Int max_j)
+		{
+			// Each row of tiles is contiguous in the buffer, so each row is uploaded at once
+			for (Int j = min_j; j <= max_j; ++j)
+			{
+				buffer_t data;
+				data.push(6 * (max_i - min_i + 1));
+				for (Int i = max_i; i >= min_i; --i)
+				{
+					vec3f normals[4];
+					for (int k = 3; k >= 0; --k)
+						normals[k] = __get_vertex_normal(i + ((k + (k / 2)) % 2), j + (k / 2));
+
+					__set_tile_vertices(i, j, normals, &data, 6 * (i - min_i));
+				}
+
+				__update_vertices(6 * get_index(min_i, j), &data);
+			}
+		}
+
+		Uint SmoothChunk::__finish_upload()
+		{
+			return m_Manager.upload_batch();
+		}
+
+		void SmoothChunk::__finish_unload()
+		{
+			m_Manager.clear_batch();
 		}
 
 		int SmoothChunk::get_tile_height(int x, int y) const
+		{
+			return __get_tile_height(x - m_Origin.get(0), y - m_Origin.get(1));
+		}
+
+		bool SmoothChunk::set_corner_height(Int x, Int y, Int height)
+		{
+			if (get_state() != CHUNK_READY
+				|| x < 0 || x > m_Dimensions.get(0)
+				|| y < 0 || y > m_Dimensions.get(1))
+				return false;
+
+			m_TileCornerHeights[((m_Dimensions.get(0) + 1) * y) + x] = height;
+
+			// Only the rows that share the corner can have new minimum and maximum heights
+			for (Int j = std::min<Int>(y, m_Dimensions.get(1) - 1); j >= std::max<Int>(y - 1, 0); --j)
+				__update_row_heights(j);
+
+			// The corner changes the faces of the tiles around it, which change the normals of their corners, which are shared by the tiles around those
+			__update_tiles(
+				std::max<Int>(x - 2, 0), std::max<Int>(y - 2, 0),
+				std::min<Int>(x + 1, m_Dimensions.get(0) - 1), std::min<Int>(y + 1, m_Dimensions.get(1) - 1)
+			);
+			invalidate_display();
+			return true;
+		}
+
+		int SmoothChunk::__get_tile_height(int x, int y) const
 		{
 			int i = x / m_TileSize;
 			int j = y / m_TileSize;
 
 			if (i < 0)
-				return get_tile_height(0, y);
+				return __get_tile_height(0, y);
 			if (j < 0)
-				return get_tile_height(x, 0);
+				return __get_tile_height(x, 0);
 
 			if (i >= m_Dimensions.get(0))
 			{
@@ -810,6 +1502,31 @@ namespace onion
 			return heights[TILE_CORNER_BOTTOM_LEFT] + (((u * dhu) + (v * dhv)) / m_TileSize);
 		}
 
+		std::size_t SmoothChunk::__get_vertex_size() const
+		{
+			return buffer_t().vertex_size();
+		}
+
+		void SmoothChunk::__write_cooked(SaveFile& file) const
+		{
+			file.save_int32_binary(m_TileCornerHeights.size());
+			for (auto iter = m_TileCornerHeights.begin(); iter != m_TileCornerHeights.end(); ++iter)
+				file.save_int32_binary(*iter);
+		}
+
+		bool SmoothChunk::__read_cooked(MappedFile& file)
+		{
+			std::vector<Int> heights(std::max<Int>(file.load_int32_binary(), 0));
+			for (auto iter = heights.begin(); iter != heights.end() && file.good(); ++iter)
+				*iter = file.load_int32_binary();
+
+			if (!file.good())
+				return false;
+
+			m_TileCornerHeights.swap(heights);
+			return true;
+		}
+
 		const opengl::_Shader* SmoothChunk::get_tile_shader() const
 		{
 			return Flat3DPixelSpriteSheet::get_shader();
@@ -817,7 +1534,7 @@ namespace onion
 
 		void SmoothChunk::activate_tile_shader() const
 		{
-			Flat3DPixelSpriteSheet::get_shader()->activate(Transform::model.get(), 0, 1);
+			Flat3DPixelSpriteSheet::get_lit_shader()->activate(Transform::model.get(), 0, 1);
 			get_tile_image()->activate(0);
 			get_bluenoise_image()->activate(1);
 		}
@@ -827,35 +1544,141 @@ namespace onion
 			m_Manager.add(obj);
 		}
 
-		void SmoothChunk::reset_visible(const WorldCamera* view)
+		ObjectManager& SmoothChunk::get_object_manager()
+		{
+			return m_Manager;
+		}
+
+		vec2i SmoothChunk::__get_tile_heights(Int i, Int j) const
+		{
+			const Int corners[4] = {
+				m_TileCornerHeights[get_index(i, j) + j],
+				m_TileCornerHeights[get_index(i + 1, j) + j],
+				m_TileCornerHeights[get_index(i + 1, j + 1) + j + 1],
+				m_TileCornerHeights[get_index(i, j + 1) + j + 1]
+			};
+
+			vec2i heights(corners[0], corners[0]);
+			for (int k = 3; k > 0; --k)
+			{
+				heights(0) = std::min<Int>(heights.get(0), corners[k]);
+				heights(1) = std::max<Int>(heights.get(1), corners[k]);
+			}
+			return heights;
+		}
+
+		void SmoothChunk::__finish_parse()
+		{
+			// Make sure that every corner has a height, even if the data file was inconsistent
+			std::size_t num_corners = std::max<Int>(m_Dimensions.get(0) + 1, 0) * std::max<Int>(m_Dimensions.get(1) + 1, 0);
+			if (m_TileCornerHeights.size() < num_corners)
+			{
+				errlog("ONION: Chunk " + m_Path + " is missing the heights of some tile corners.\n");
+				m_TileCornerHeights.resize(num_corners, 0);
+			}
+
+			Int num_blocks = (m_Dimensions.get(0) + ONION_CHUNK_HEIGHT_BLOCK - 1) / ONION_CHUNK_HEIGHT_BLOCK;
+			const vec2i empty(type_limits<Int>::max(), type_limits<Int>::min());
+
+			m_RowHeights.assign(std::max<Int>(m_Dimensions.get(1), 0), empty);
+			m_BlockHeights.assign(std::max<Int>(m_Dimensions.get(1), 0) * num_blocks, empty);
+
+			for (Int j = m_Dimensions.get(1) - 1; j >= 0; --j)
+				__update_row_heights(j);
+		}
+
+		void SmoothChunk::__update_row_heights(Int j)
+		{
+			Int num_blocks = (m_Dimensions.get(0) + ONION_CHUNK_HEIGHT_BLOCK - 1) / ONION_CHUNK_HEIGHT_BLOCK;
+			const vec2i empty(type_limits<Int>::max(), type_limits<Int>::min());
+
+			for (Int b = num_blocks - 1; b >= 0; --b)
+				m_BlockHeights[(j * num_blocks) + b] = empty;
+
+			for (Int i = m_Dimensions.get(0) - 1; i >= 0; --i)
+			{
+				vec2i tile = __get_tile_heights(i, j);
+
+				vec2i& block = m_BlockHeights[(j * num_blocks) + (i / ONION_CHUNK_HEIGHT_BLOCK)];
+				block(0) = std::min<Int>(block.get(0), tile.get(0));
+				block(1) = std::max<Int>(block.get(1), tile.get(1));
+			}
+
+			vec2i& row = m_RowHeights[j];
+			row = empty;
+			for (Int b = num_blocks - 1; b >= 0; --b)
+			{
+				const vec2i& block = m_BlockHeights[(j * num_blocks) + b];
+				row(0) = std::min<Int>(row.get(0), block.get(0));
+				row(1) = std::max<Int>(row.get(1), block.get(1));
+			}
+		}
+
+		bool SmoothChunk::__is_visible(const WorldCamera* view, Int min_i, Int max_i, Int j, const vec2i& heights) const
 		{
-			static const Int max_allowed = type_limits<Int>::max();
+			// The tiles span up to and including the corners they share with the next row and column
+			Int min_y = m_Origin.get(1) + (m_TileSize * j);
+			Int min_x, max_x;
+			if (!view->get_visible_span(min_y, min_y + m_TileSize, heights.get(0), heights.get(1), min_x, max_x))
+				return false;
+
+			return min_x <= m_Origin.get(0) + (m_TileSize * (max_i + 1))
+				&& max_x >= m_Origin.get(0) + (m_TileSize * min_i);
+		}
 
+		void SmoothChunk::reset_visible(const WorldCamera* view)
+		{
 			// Reset visible tiles
-			// TODO take height into account
 			m_VisibleTiles.clear();
-			
-			Segment r(vec3i(), vec3i(0, max_allowed, 0));
-			Int min_x = r.get_distance(view);
 
-			r.translate(vec3i(max_allowed, 0, 0));
-			Int x_dist = r.get_distance(view);
-			Int max_x = max_allowed - x_dist;
+			// Narrow down the visible tiles in each row, first using the heights of the whole row, then each block, then each tile
+			Int num_blocks = (m_Dimensions.get(0) + ONION_CHUNK_HEIGHT_BLOCK - 1) / ONION_CHUNK_HEIGHT_BLOCK;
+			for (Int j = 0; j < m_Dimensions.get(1); ++j)
+			{
+				const vec2i& row = m_RowHeights[j];
 
-			r = Segment(vec3i(), vec3i(max_allowed, 0, 0));
-			Int min_y = r.get_distance(view);
+				Int min_y = m_Origin.get(1) + (m_TileSize * j);
+				Int min_x, max_x;
+				if (!view->get_visible_span(min_y, min_y + m_TileSize, row.get(0), row.get(1), min_x, max_x))
+					continue;
 
-			r.translate(vec3i(0, max_allowed, 0));
-			Int y_dist = r.get_distance(view);
-			Int max_y = max_allowed - y_dist;
+				// Tiles are treated as including their right edge, which is shared with the next tile
+				Int first_i = std::max<Int>(0, floor_div(min_x - m_Origin.get(0) - 1, m_TileSize));
+				Int last_i = std::min<Int>(m_Dimensions.get(0) - 1, floor_div(max_x - m_Origin.get(0), m_TileSize));
 
-			Int min_i = std::max<Int>(0, min_x / m_TileSize);
-			Int max_i = std::min<Int>(m_Dimensions.get(0) - 1, max_x / m_TileSize);
-			Int min_j = std::max<Int>(0, min_y / m_TileSize);
-			Int max_j = std::min<Int>(m_Dimensions.get(1) - 1, max_y / m_TileSize);
-			for (Int j = min_j; j <= max_j; ++j)
-			{
-				m_VisibleTiles.emplace_back(get_index(min_i, j) * 6, max_i - min_i + 1); // TODO can this be done more efficiently?
+				// Skip past blocks and tiles on the left that are out of view
+				while (first_i <= last_i)
+				{
+					Int b = first_i / ONION_CHUNK_HEIGHT_BLOCK;
+					Int block_end = std::min<Int>(last_i, ((b + 1) * ONION_CHUNK_HEIGHT_BLOCK) - 1);
+					if (__is_visible(view, first_i, block_end, j, m_BlockHeights[(j * num_blocks) + b]))
+					{
+						while (first_i <= block_end && !__is_visible(view, first_i, first_i, j, __get_tile_heights(first_i, j)))
+							++first_i;
+						if (first_i <= block_end)
+							break;
+					}
+					first_i = block_end + 1;
+				}
+
+				// Skip past blocks and tiles on the right that are out of view
+				while (first_i <= last_i)
+				{
+					Int b = last_i / ONION_CHUNK_HEIGHT_BLOCK;
+					Int block_start = std::max<Int>(first_i, b * ONION_CHUNK_HEIGHT_BLOCK);
+					if (__is_visible(view, block_start, last_i, j, m_BlockHeights[(j * num_blocks) + b]))
+					{
+						while (last_i >= block_start && !__is_visible(view, last_i, last_i, j, __get_tile_heights(last_i, j)))
+							--last_i;
+						if (last_i >= block_start)
+							break;
+					}
+					last_i = block_start - 1;
+				}
+
+				// Add the visible row
+				if (first_i <= last_i)
+					m_VisibleTiles.emplace_back(get_index(first_i, j) * 6, last_i - first_i + 1);
 			}
 
 			// Reset visible objects
@@ -867,9 +1690,14 @@ namespace onion
 			m_Manager.update_visible(view, frames_passed);
 		}
 
-		void SmoothChunk::display_objects(const vec3i& normal) const
+		void SmoothChunk::display_opaque_objects(const vec3i& normal) const
+		{
+			m_Manager.display_opaque(normal);
+		}
+
+		void SmoothChunk::display_translucent_objects(const vec3i& normal) const
 		{
-			m_Manager.display(normal);
+			m_Manager.display_translucent(normal);
 		}
 
 
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include "../../../include/onions/world/geometry.h"
 
 namespace onion
@@ -314,6 +315,44 @@ namespace onion
 			return __get_distance(other, s, d);
 		}
 
+		void Shape::__get_bounding_box(mat2x3i& box) const
+		{
+			static constexpr Float inv_distance_scale = 1.f / ONION_WORLD_GEOMETRY_SCALE;
+
+			for (int k = 2; k >= 0; --k)
+			{
+				vec3f dir;
+				dir(k) = 1.f;
+				box(k, 1) = (Int)ceil(support(dir).get(k) * inv_distance_scale);
+
+				dir(k) = -1.f;
+				box(k, 0) = (Int)floor(support(dir).get(k) * inv_distance_scale);
+			}
+		}
+
+		const mat2x3i& Shape::get_bounding_box() const
+		{
+			if (m_BoundingBoxOutdated)
+			{
+				__get_bounding_box(m_BoundingBox);
+				m_BoundingBoxOutdated = false;
+			}
+
+			return m_BoundingBox;
+		}
+
+		bool Shape::overlaps(const Shape* other) const
+		{
+			const mat2x3i& lhs = get_bounding_box();
+			const mat2x3i& rhs = other->get_bounding_box();
+
+			// All vertices lie on integer coordinates, so boxes that are separated on any axis are at least 1 unit apart
+			for (int k = 2; k >= 0; --k)
+				if (lhs.get(k, 1) < rhs.get(k, 0) || rhs.get(k, 1) < lhs.get(k, 0))
+					return false;
+			return true;
+		}
+
 
 
 		Point::Point(const vec3i& pos)
@@ -334,6 +373,16 @@ namespace onion
 		void Point::translate(const vec3i& trans)
 		{
 			m_Position += trans;
+
+			// Shift the cached bounding box along with the shape
+			if (!m_BoundingBoxOutdated)
+			{
+				for (int k = 2; k >= 0; --k)
+				{
+					m_BoundingBox(k, 0) += trans.get(k);
+					m_BoundingBox(k, 1) += trans.get(k);
+				}
+			}
 		}
 		
 		vec3f Point::support(const vec3f& dir) const
@@ -341,6 +390,15 @@ namespace onion
 			return ONION_WORLD_GEOMETRY_SCALE * m_Position;
 		}
 
+		void Point::__get_bounding_box(mat2x3i& box) const
+		{
+			for (int k = 2; k >= 0; --k)
+			{
+				box(k, 0) = m_Position.get(k);
+				box(k, 1) = m_Position.get(k);
+			}
+		}
+
 
 		Segment::Segment(const vec3i& origin, const vec3i& direction) : Point(origin)
 		{
@@ -355,6 +413,15 @@ namespace onion
 			return ONION_WORLD_GEOMETRY_SCALE * (d1 >= d2 ? m_Position : m_EndPoint);
 		}
 
+		void Segment::__get_bounding_box(mat2x3i& box) const
+		{
+			for (int k = 2; k >= 0; --k)
+			{
+				box(k, 0) = std::min<Int>(m_Position.get(k), m_EndPoint.get(k));
+				box(k, 1) = std::max<Int>(m_Position.get(k), m_EndPoint.get(k));
+			}
+		}
+
 		void Segment::translate(const vec3i& trans)
 		{
 			Point::translate(trans);
@@ -362,6 +429,39 @@ namespace onion
 		}
 		
 		
+		SweptShape::SweptShape(const Shape* shape, const vec3i& trans) : Segment(vec3i(0, 0, 0), trans)
+		{
+			m_Shape = shape;
+		}
+
+		vec3f SweptShape::support(const vec3f& dir) const
+		{
+			return m_Shape->support(dir) + Segment::support(dir);
+		}
+
+		void SweptShape::__get_bounding_box(mat2x3i& box) const
+		{
+			const mat2x3i& shape_box = m_Shape->get_bounding_box();
+			Segment::__get_bounding_box(box);
+
+			for (int k = 2; k >= 0; --k)
+			{
+				box(k, 0) += shape_box.get(k, 0);
+				box(k, 1) += shape_box.get(k, 1);
+			}
+		}
+
+		vec3i SweptShape::get_position() const
+		{
+			return m_Shape->get_position() + m_Position;
+		}
+
+		void SweptShape::set_position(const vec3i& pos)
+		{
+			translate(pos - get_position());
+		}
+		
+		
 		OrthogonalPrism::OrthogonalPrism(const vec3i& pos, const vec3i& dimensions) : Point(pos)
 		{
 			m_Dimensions = dimensions;
@@ -376,6 +476,15 @@ namespace onion
 			return ONION_WORLD_GEOMETRY_SCALE * res;
 		}
 
+		void OrthogonalPrism::__get_bounding_box(mat2x3i& box) const
+		{
+			for (int k = 2; k >= 0; --k)
+			{
+				box(k, 0) = m_Position.get(k);
+				box(k, 1) = m_Position.get(k) + m_Dimensions.get(k);
+			}
+		}
+
 
 		UprightRectangle::UprightRectangle(const vec3i& pos, const vec3i& dimensions) : Point(pos) 
 		{
@@ -400,6 +509,15 @@ namespace onion
 			return ONION_WORLD_GEOMETRY_SCALE * res;
 		}
 
+		void UprightRectangle::__get_bounding_box(mat2x3i& box) const
+		{
+			for (int k = 2; k >= 0; --k)
+			{
+				box(k, 0) = std::min<Int>(m_Position.get(k), m_Position.get(k) + m_Dimensions.get(k));
+				box(k, 1) = std::max<Int>(m_Position.get(k), m_Position.get(k) + m_Dimensions.get(k));
+			}
+		}
+
 
 		Parallelogram::Parallelogram(const vec3i& pos, const vec3i& dir1, const vec3i& dir2) : Point(pos)
 		{
@@ -410,7 +528,7 @@ namespace onion
 		vec3f Parallelogram::support(const vec3f& dir) const
 		{
 			vec3i res;
-			Float d_max = std::numeric_limits<Float>::min();
+			Float d_max = std::numeric_limits<Float>::lowest();
 
 			for (int c = 3; c >= 0; --c)
 			{
@@ -431,6 +549,15 @@ namespace onion
 			return ONION_WORLD_GEOMETRY_SCALE * res;
 		}
 
+		void Parallelogram::__get_bounding_box(mat2x3i& box) const
+		{
+			for (int k = 2; k >= 0; --k)
+			{
+				box(k, 0) = m_Position.get(k) + std::min<Int>(m_Radii[0].get(k), 0) + std::min<Int>(m_Radii[1].get(k), 0);
+				box(k, 1) = m_Position.get(k) + std::max<Int>(m_Radii[0].get(k), 0) + std::max<Int>(m_Radii[1].get(k), 0);
+			}
+		}
+
 
 
 
@@ -440,6 +567,11 @@ namespace onion
 			m_Shape = shape;
 		}
 
+		const vec3i& SubpixelHandler::get_subpixels() const
+		{
+			return m_Subpixels;
+		}
+
 		void SubpixelHandler::translate(const vec3i& trans)
 		{
 			m_Subpixels += trans;
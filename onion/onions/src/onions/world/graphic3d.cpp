@@ -5,20 +5,32 @@ namespace onion
 {
 	namespace world
 	{
+
+		bool Graphic3D::batch(StaticGraphicBatch&, const vec3i&) const
+		{
+			return false;
+		}
+
+		bool Graphic3D::is_translucent() const
+		{
+			return true;
+		}
+
+
 		
-		Flat3DPixelSpriteSheet::_SpriteShader* Flat3DPixelSpriteSheet::m_Flat3DPixelShader{ nullptr };
+		ShaderPermutations<FLOAT_MAT4, Int, Int>* Flat3DPixelSpriteSheet::m_Flat3DPixelShaders{ nullptr };
 
 		Flat3DPixelSpriteSheet::Flat3DPixelSpriteSheet(const char* path)
 		{
-			if (!m_Flat3DPixelShader)
+			if (!m_Flat3DPixelShaders)
 			{
-				m_Flat3DPixelShader = new Flat3DPixelSpriteSheet::_SpriteShader(
+				m_Flat3DPixelShaders = new ShaderPermutations<FLOAT_MAT4, Int, Int>(
 					"world/dithered_object",
 					{ "model", "tileTexture", "noiseTexture" }
 				);
 			}
 
-			m_Shader = m_Flat3DPixelShader;
+			m_Shader = m_Flat3DPixelShaders->get_default();
 
 			String fpath("world/");
 			fpath += path;
@@ -28,12 +40,28 @@ namespace onion
 
 		Flat3DPixelSpriteSheet::_SpriteShader* Flat3DPixelSpriteSheet::get_shader()
 		{
-			return m_Flat3DPixelShader;
+			return m_Flat3DPixelShaders->get_default();
+		}
+
+		Flat3DPixelSpriteSheet::_SpriteShader* Flat3DPixelSpriteSheet::get_lit_shader()
+		{
+			return Lighting::get_shader(m_Flat3DPixelShaders);
+		}
+
+		Flat3DPixelSpriteSheet::_SpriteShader* Flat3DPixelSpriteSheet::__get_display_shader() const
+		{
+			return get_lit_shader();
+		}
+
+		opengl::_Image* Flat3DPixelSpriteSheet::load_image(const char* path)
+		{
+			m_Image = PixelSpriteSheet<Int, Int>::load_image(path);
+			return m_Image;
 		}
 		
 		opengl::_VertexBufferData* Flat3DPixelSpriteSheet::__load(LoadFile& file, opengl::_Image* image)
 		{
-			auto data = new VertexBufferData<FLOAT_VEC3, FLOAT_VEC3, FLOAT_VEC2>();
+			auto data = new buffer_t();
 
 			while (file.good())
 			{
@@ -45,8 +73,8 @@ namespace onion
 				{
 					int index = data->buffer_size();
 
-					// Create a sprite data object
-					m_SpriteManager.set(id, new Sprite(index, size.get(0), size.get(1)));
+					// Create a sprite data object, classified by the transparency of its pixels
+					m_SpriteManager.set(id, new Sprite(index, size.get(0), size.get(1), __get_alpha(image, pos.get(0), pos.get(1), size.get(0), size.get(1))));
 
 					// Construct the corners, in the order bottom-left -> bottom-right -> top-left -> top-right
 					vec3f vertex_pos[4];
@@ -100,6 +128,9 @@ namespace onion
 				}
 			}
 
+			// Keep a copy of the vertices, since the buffer is freed once it has been uploaded
+			m_Vertices = *data;
+
 			return data;
 		}
 
@@ -112,21 +143,134 @@ namespace onion
 			PixelSpriteSheet<Int, Int>::display(sprite, 0, 1);
 		}
 
+		void Flat3DPixelSpriteSheet::transform(const Sprite* sprite, const TransformMatrix& transform, buffer_t* data) const
+		{
+			int index = data->push(6);
+			for (int k = 5; k >= 0; --k)
+			{
+				const vec3f& pos = m_Vertices.get<0>(sprite->key + k);
+				const vec3f& normal = m_Vertices.get<1>(sprite->key + k);
+
+				// Transform the position as a point and the normal vector as a direction
+				vec3f transformed_pos, transformed_normal;
+				for (int r = 2; r >= 0; --r)
+				{
+					transformed_pos(r) = transform.get(r, 3);
+					for (int c = 2; c >= 0; --c)
+					{
+						transformed_pos(r) += transform.get(r, c) * pos.get(c);
+						transformed_normal(r) += transform.get(r, c) * normal.get(c);
+					}
+				}
+
+				data->set<0>(index + k, transformed_pos);
+				data->set<1>(index + k, transformed_normal);
+				data->set<2>(index + k, m_Vertices.get<2>(sprite->key + k));
+			}
+		}
+
+		void Flat3DPixelSpriteSheet::display_batch(const opengl::_VertexBufferDisplayer* displayer, Int count) const
+		{
+			// The vertices are already in world coordinates, so the model matrix is whatever the chunk is displayed with
+			get_lit_shader()->activate(Transform::model.get(), 0, 1);
+			m_Image->activate(0);
+			get_bluenoise_image()->activate(1);
+
+			// Display every sprite in the batch at once
+			displayer->display(0, count);
+		}
+
+
+
+		StaticGraphicBatch::Batch::Batch(const Flat3DPixelSpriteSheet* sprite_sheet) : sprite_sheet(sprite_sheet), data(new Flat3DPixelSpriteSheet::buffer_t()) {}
+
+		StaticGraphicBatch::~StaticGraphicBatch()
+		{
+			clear();
+		}
+
+		bool StaticGraphicBatch::add(const Flat3DPixelSpriteSheet* sprite_sheet, const Sprite* sprite, const TransformMatrix& transform)
+		{
+			// Translucent sprites are displayed separately, since they must be blended back to front
+			if (m_Uploaded || sprite->alpha == SPRITE_TRANSLUCENT)
+				return false;
+
+			// Find the batch for the sprite sheet, since a chunk uses only a handful of them
+			auto iter = m_Batches.begin();
+			while (iter != m_Batches.end() && iter->sprite_sheet != sprite_sheet)
+				++iter;
+			if (iter == m_Batches.end())
+			{
+				m_Batches.emplace_back(sprite_sheet);
+				iter = m_Batches.end() - 1;
+			}
+
+			sprite_sheet->transform(sprite, transform, iter->data);
+			++iter->count;
+			return true;
+		}
+
+		bool StaticGraphicBatch::is_uploaded() const
+		{
+			return m_Uploaded;
+		}
+
+		Uint StaticGraphicBatch::upload()
+		{
+			Uint bytes = 0;
+			for (auto iter = m_Batches.begin(); iter != m_Batches.end(); ++iter)
+			{
+				if (iter->data)
+				{
+					bytes += iter->data->vertex_size() * iter->data->buffer_size();
+
+					iter->displayer = new opengl::_SquareBufferDisplayer();
+					iter->displayer->set_buffer(new opengl::_VertexBuffer(iter->data, Flat3DPixelSpriteSheet::get_shader()->get_attribs()));
+
+					// The buffer keeps its own copy of the vertices
+					delete iter->data;
+					iter->data = nullptr;
+				}
+			}
+
+			m_Uploaded = true;
+			return bytes;
+		}
+
+		void StaticGraphicBatch::clear()
+		{
+			for (auto iter = m_Batches.begin(); iter != m_Batches.end(); ++iter)
+			{
+				delete iter->data;
+				delete iter->displayer;
+			}
+
+			m_Batches.clear();
+			m_Uploaded = false;
+		}
+
+		void StaticGraphicBatch::display() const
+		{
+			for (auto iter = m_Batches.begin(); iter != m_Batches.end(); ++iter)
+				if (iter->displayer)
+					iter->sprite_sheet->display_batch(iter->displayer, iter->count);
+		}
+
 
 
-		Textured3DPixelSpriteSheet::_SpriteShader* Textured3DPixelSpriteSheet::m_Textured3DPixelShader{ nullptr };
+		ShaderPermutations<FLOAT_MAT4, FLOAT_MAT4X2, FLOAT_MAT4, Int>* Textured3DPixelSpriteSheet::m_Textured3DPixelShaders{ nullptr };
 
 		Textured3DPixelSpriteSheet::Textured3DPixelSpriteSheet(const char* path)
 		{
-			if (!m_Textured3DPixelShader)
+			if (!m_Textured3DPixelShaders)
 			{
-				m_Textured3DPixelShader = new Textured3DPixelSpriteSheet::_SpriteShader(
+				m_Textured3DPixelShaders = new ShaderPermutations<FLOAT_MAT4, FLOAT_MAT4X2, FLOAT_MAT4, Int>(
 					"world/textured_object",
 					{ "model", "mappingMatrix", "paletteMatrix", "objTexture" }
 				);
 			}
 
-			m_Shader = m_Textured3DPixelShader;
+			m_Shader = m_Textured3DPixelShaders->get_default();
 
 			String fpath("world/");
 			fpath += path;
@@ -136,7 +280,17 @@ namespace onion
 
 		Textured3DPixelSpriteSheet::_SpriteShader* Textured3DPixelSpriteSheet::get_shader()
 		{
-			return m_Textured3DPixelShader;
+			return m_Textured3DPixelShaders->get_default();
+		}
+
+		Textured3DPixelSpriteSheet::_SpriteShader* Textured3DPixelSpriteSheet::get_lit_shader()
+		{
+			return Lighting::get_shader(m_Textured3DPixelShaders);
+		}
+
+		Textured3DPixelSpriteSheet::_SpriteShader* Textured3DPixelSpriteSheet::__get_display_shader() const
+		{
+			return get_lit_shader();
 		}
 
 		Texture* Textured3DPixelSpriteSheet::get_texture(TEXTURE_ID id)
@@ -171,7 +325,7 @@ namespace onion
 						id = tex_idmatch[1].str();
 
 						// Set the information for the texture
-						m_TextureManager.set(id, new Texture(pos.get(0), pos.get(1), size.get(0), size.get(1), image->get_width(), image->get_height()));
+						m_TextureManager.set(id, new Texture(pos.get(0), pos.get(1), size.get(0), size.get(1), image->get_width(), image->get_height(), __get_alpha(image, pos.get(0), pos.get(1), size.get(0), size.get(1))));
 					}
 				}
 				else
@@ -181,8 +335,8 @@ namespace onion
 					{
 						int index = data->buffer_size();
 
-						// Set the information for the sprite
-						m_SpriteManager.set(id, new Sprite(index, size.get(0), size.get(1)));
+						// Set the information for the sprite, classified by the transparency of its shading
+						m_SpriteManager.set(id, new Sprite(index, size.get(0), size.get(1), __get_alpha(image, shading.get(0), shading.get(1), size.get(0), size.get(1))));
 
 						// Construct the corners, in the order bottom-left -> bottom-right -> top-left -> top-right
 						vec3f vertex_pos[4];
@@ -261,6 +415,19 @@ namespace onion
 			m_SpriteSheet->display(m_Sprite);
 		}
 
+		bool FlatWallGraphic3D::batch(StaticGraphicBatch& batch, const vec3i& pos) const
+		{
+			TransformMatrix transform;
+			transform.translate(pos.get(0), pos.get(1), pos.get(2));
+
+			return batch.add(m_SpriteSheet, m_Sprite, transform);
+		}
+
+		bool FlatWallGraphic3D::is_translucent() const
+		{
+			return m_Sprite->alpha == SPRITE_TRANSLUCENT;
+		}
+
 
 		TransformedFlatWallGraphic3D::TransformedFlatWallGraphic3D(const Flat3DPixelSpriteSheet* sprite_sheet, const Sprite* sprite, const vec2f& scale) : FlatWallGraphic3D(sprite_sheet, sprite)
 		{
@@ -292,6 +459,15 @@ namespace onion
 			Transform::model.pop();
 		}
 
+		bool TransformedFlatWallGraphic3D::batch(StaticGraphicBatch& batch, const vec3i& pos) const
+		{
+			TransformMatrix transform;
+			transform.translate(pos.get(0), pos.get(1), pos.get(2));
+			transform *= m_Transform;
+
+			return batch.add(m_SpriteSheet, m_Sprite, transform);
+		}
+
 
 
 		DynamicShadingSpriteGraphic3D::DynamicShadingSpriteGraphic3D(const Textured3DPixelSpriteSheet* sprite_sheet, const std::vector<const Sprite*>& sprites, bool flip_horizontally, const Texture* texture, Palette* palette) : SpriteGraphic3D(sprite_sheet)
@@ -309,5 +485,19 @@ namespace onion
 			m_SpriteSheet->display(m_Sprites[m_SpriteIndex], false, m_Texture, m_Palette);
 		}
 
+		bool DynamicShadingSpriteGraphic3D::is_translucent() const
+		{
+			if (m_Sprites[m_SpriteIndex]->alpha == SPRITE_TRANSLUCENT || m_Texture->alpha == SPRITE_TRANSLUCENT)
+				return true;
+
+			// The palette can also map a color to a partially transparent one
+			const PALETTE_MATRIX& palette = m_Palette->get_red_palette_matrix();
+			for (int c = 2; c >= 0; --c)
+				if (palette.get(3, c) > 0.f && palette.get(3, c) < 1.f)
+					return true;
+
+			return false;
+		}
+
 	}
 }
\ No newline at end of file
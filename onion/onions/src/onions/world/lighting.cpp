@@ -1,4 +1,8 @@
+#include <algorithm>
 #include <regex>
+#include <cmath>
+#include <limits>
+#include <GL/glew.h>
 #include "../../../include/onions/world/camera.h"
 #include "../../../include/onions/world/lighting.h"
 
@@ -15,33 +19,272 @@ namespace onion
 
 	void Lighting::Light::reset() const
 	{
-		set<FLOAT_VEC3>("color", color);
-		set<Float>("intensity", intensity);
-		set<Float>("radius", radius);
+		if (array)
+			array->changed = true;
 	}
 
-	void PointLight::reset() const
+	void Lighting::Light::write(std::vector<float>& texels) const
 	{
-		Lighting::Light::reset();
+		texels.insert(texels.end(), {
+			intensity - flicker_differential, flicker_differential, flicker_probability, (float)flicker_seed
+		});
+	}
+
+	void PointLight::write(std::vector<float>& texels) const
+	{
+		Lighting::Light::write(texels);
+
+		texels.insert(texels.end(), {
+			pos.get(0), pos.get(1), pos.get(2), (float)radius,
+			color.get(0), color.get(1), color.get(2), intensity
+		});
+	}
+
+	void PointLight::get_bounds(vec2f& mins, vec2f& maxs) const
+	{
+		mins = vec2f(pos.get(0) - radius, pos.get(1) - radius);
+		maxs = vec2f(pos.get(0) + radius, pos.get(1) + radius);
+	}
+
+	void CubeLight::write(std::vector<float>& texels) const
+	{
+		Lighting::Light::write(texels);
 
-		set<FLOAT_VEC3>("pos", pos);
+		texels.insert(texels.end(), {
+			mins.get(0), mins.get(1), mins.get(2), (float)radius,
+			maxs.get(0), maxs.get(1), maxs.get(2), intensity,
+			color.get(0), color.get(1), color.get(2), baked ? 1.f : 0.f
+		});
 	}
 
-	void CubeLight::reset() const
+	void CubeLight::get_bounds(vec2f& mins, vec2f& maxs) const
 	{
-		Lighting::Light::reset();
+		mins = vec2f(this->mins.get(0) - radius, this->mins.get(1) - radius);
+		maxs = vec2f(this->maxs.get(0) + radius, this->maxs.get(1) + radius);
+	}
 
-		set<FLOAT_VEC3>("mins", mins);
-		set<FLOAT_VEC3>("maxs", maxs);
+	Float CubeLight::get_ground_strength(Float x, Float y) const
+	{
+		// Calculate the closest point on the light
+		float closest[3] = {
+			std::max<float>(mins.get(0), std::min<float>(maxs.get(0), x)),
+			std::max<float>(mins.get(1), std::min<float>(maxs.get(1), y)),
+			std::max<float>(mins.get(2), std::min<float>(maxs.get(2), 0.f))
+		};
+		float dir[3] = { closest[0] - x, closest[1] - y, closest[2] };
+
+		// The maximum distance from the closest point, within the plane of the ground
+		float height_squared = closest[2] * closest[2];
+		float radius_squared = (float)radius * radius;
+		if (height_squared >= radius_squared)
+			return 0.f;
+		float max_distance = std::sqrt(radius_squared - height_squared);
+
+		float distance = std::sqrt((dir[0] * dir[0]) + (dir[1] * dir[1]) + (dir[2] * dir[2]));
+		float levels = std::round(5.f * intensity);
+		if (distance <= 0.f || distance >= max_distance || levels <= 0.f)
+			return 0.f;
+
+		float strength_per_level = intensity / levels; // The difference in strength between each discretized level
+
+		// Calculate the base strength of the light
+		float edge_diffuse_strength = 0.081024f * strength_per_level;
+		float attenuation = std::max<float>((dir[2] / (max_distance * edge_diffuse_strength)) - 1.f, 0.f) * std::pow(distance / max_distance, 5.f);
+		float base_strength = (dir[2] / distance) * intensity / (1.f + attenuation);
+
+		// Calculate the discretized strength of the light
+		return strength_per_level * std::round(base_strength / strength_per_level);
 	}
 
-	void ConeLight::reset() const
+	void ConeLight::write(std::vector<float>& texels) const
 	{
-		Lighting::Light::reset();
+		Lighting::Light::write(texels);
 
-		set<FLOAT_VEC3>("pos", pos);
-		set<FLOAT_VEC3>("dir", dir);
-		set<Float>("angle", angle);
+		texels.insert(texels.end(), {
+			pos.get(0), pos.get(1), pos.get(2), (float)radius,
+			dir.get(0), dir.get(1), dir.get(2), angle,
+			color.get(0), color.get(1), color.get(2), intensity
+		});
+	}
+
+	void ConeLight::get_bounds(vec2f& mins, vec2f& maxs) const
+	{
+		mins = vec2f(pos.get(0) - radius, pos.get(1) - radius);
+		maxs = vec2f(pos.get(0) + radius, pos.get(1) + radius);
+	}
+
+
+
+	// The most lights in any cell that each bounded permutation allows. The permutation after the last one has no bound.
+	const int g_PermutationLightCounts[ONION_LIGHT_PERMUTATIONS - 1] = { 0, 2, 4, 8 };
+
+	Lighting::_LightArray::_LightArray(std::string array_name, std::string cluster_name, std::string define_name) :
+		records(opengl::_TextureBuffer::get_buffer(array_name)),
+		clusters(opengl::_TextureBuffer::get_buffer(cluster_name)),
+		changed(true),
+		define_name(define_name),
+		permutation(0),
+		cell_size(ONION_LIGHT_CLUSTER_SIZE) {}
+
+	bool Lighting::_LightArray::remove(Light* light)
+	{
+		if (light->array == this)
+		{
+			for (int k = elements.size() - 1; k >= 0; --k)
+			{
+				if (elements[k] == light)
+				{
+					// Move the light at the back of the array to replace the light being removed
+					elements[k] = elements.back();
+					elements.pop_back();
+					break;
+				}
+			}
+
+			light->array = nullptr;
+			changed = true;
+			return true;
+		}
+
+		return false;
+	}
+
+	void Lighting::_LightArray::upload()
+	{
+		changed = false;
+
+		// Write the data for each light, and find the area each light illuminates
+		std::vector<float> texels;
+		std::vector<vec2f> mins(elements.size()), maxs(elements.size());
+		for (int k = elements.size() - 1; k >= 0; --k)
+			elements[k]->get_bounds(mins[k], maxs[k]);
+		for (auto iter = elements.begin(); iter != elements.end(); ++iter)
+			(*iter)->write(texels);
+
+		// Find the cells spanned by all lights, doubling the size of the cells until there are few enough of them
+		int size = ONION_LIGHT_CLUSTER_SIZE;
+		int origin_x = 0, origin_y = 0, count_x = 0, count_y = 0;
+		if (!elements.empty())
+		{
+			vec2f grid_mins = mins[0], grid_maxs = maxs[0];
+			for (int k = elements.size() - 1; k > 0; --k)
+			{
+				for (int n = 1; n >= 0; --n)
+				{
+					grid_mins(n) = std::min<float>(grid_mins.get(n), mins[k].get(n));
+					grid_maxs(n) = std::max<float>(grid_maxs.get(n), maxs[k].get(n));
+				}
+			}
+
+			while (true)
+			{
+				origin_x = (int)std::floor(grid_mins.get(0) / size);
+				origin_y = (int)std::floor(grid_mins.get(1) / size);
+				count_x = (int)std::floor(grid_maxs.get(0) / size) - origin_x + 1;
+				count_y = (int)std::floor(grid_maxs.get(1) / size) - origin_y + 1;
+
+				if (count_x * count_y <= ONION_MAX_LIGHT_CLUSTERS)
+					break;
+				size *= 2;
+			}
+		}
+		int num_cells = count_x * count_y;
+
+		// Find the range of cells that each light illuminates
+		std::vector<vec4i> ranges(elements.size());
+		for (int k = elements.size() - 1; k >= 0; --k)
+		{
+			ranges[k] = vec4i(
+				(int)std::floor(mins[k].get(0) / size) - origin_x,
+				(int)std::floor(mins[k].get(1) / size) - origin_y,
+				(int)std::floor(maxs[k].get(0) / size) - origin_x,
+				(int)std::floor(maxs[k].get(1) / size) - origin_y
+			);
+		}
+
+		// Count the lights in each cell, after the header and before the start of the lists, up to the limit
+		std::vector<std::int32_t> grid(6 + num_cells, 0);
+		grid[0] = origin_x;
+		grid[1] = origin_y;
+		grid[2] = count_x;
+		grid[3] = count_y;
+		grid[4] = size;
+
+		for (int k = elements.size() - 1; k >= 0; --k)
+			for (int y = ranges[k].get(1); y <= ranges[k].get(3); ++y)
+				for (int x = ranges[k].get(0); x <= ranges[k].get(2); ++x)
+					++grid[6 + x + (y * count_x)];
+
+		if (m_MaxClusterLights >= 0)
+			for (int c = 0; c < num_cells; ++c)
+				grid[6 + c] = std::min<int>(grid[6 + c], m_MaxClusterLights);
+
+		// Convert the counts into the index where each cell's list starts
+		grid[5] = 6 + num_cells;
+		for (int c = 0; c < num_cells; ++c)
+			grid[6 + c] += grid[5 + c];
+
+		// Fill each cell's list with the indices of the lights that reach it, brightest first so that the dimmest are dropped from full cells
+		std::vector<std::int32_t> next(grid.begin() + 5, grid.begin() + 5 + num_cells);
+		grid.resize(grid[5 + num_cells]);
+
+		std::vector<int> order(elements.size());
+		for (int k = elements.size() - 1; k >= 0; --k)
+			order[k] = k;
+		if (m_MaxClusterLights >= 0)
+			std::stable_sort(order.begin(), order.end(), [this](int lhs, int rhs) { return elements[lhs]->intensity > elements[rhs]->intensity; });
+
+		std::vector<bool> flickers(num_cells, false);
+		for (auto k = order.begin(); k != order.end(); ++k)
+		{
+			for (int y = ranges[*k].get(1); y <= ranges[*k].get(3); ++y)
+			{
+				for (int x = ranges[*k].get(0); x <= ranges[*k].get(2); ++x)
+				{
+					int cell = x + (y * count_x);
+					if (next[cell] < grid[6 + cell]) // The end of the cell's list is the start of the next one
+					{
+						grid[next[cell]++] = *k;
+						if (elements[*k]->flicker_differential != 0.f)
+							flickers[cell] = true;
+					}
+				}
+			}
+		}
+
+		// Remember which cells list a flickering light, so that only those that can be seen redraw the screen
+		cell_size = size;
+		flickering_cells.clear();
+		for (int c = 0; c < num_cells; ++c)
+			if (flickers[c])
+				flickering_cells.emplace_back(origin_x + (c % count_x), origin_y + (c / count_x));
+
+		// Pick the smallest permutation that fits the busiest cell
+		int most_lights = 0;
+		for (int c = 0; c < num_cells; ++c)
+			most_lights = std::max<int>(most_lights, grid[6 + c] - grid[5 + c]);
+
+		for (permutation = 0; permutation < ONION_LIGHT_PERMUTATIONS - 1; ++permutation)
+			if (most_lights <= g_PermutationLightCounts[permutation])
+				break;
+
+		// Upload the data for the lights and the grid
+		records->update(texels.data(), texels.size() / 4);
+		clusters->update(grid.data(), grid.size());
+	}
+
+	bool Lighting::_LightArray::flickers_within(const vec2f& mins, const vec2f& maxs) const
+	{
+		for (auto iter = flickering_cells.begin(); iter != flickering_cells.end(); ++iter)
+		{
+			// Compare in pixels, so that an unbounded area cannot overflow when converted to cells
+			float cell_x = (float)iter->get(0) * cell_size;
+			float cell_y = (float)iter->get(1) * cell_size;
+			if (cell_x + cell_size > mins.get(0) && cell_x <= maxs.get(0) && cell_y + cell_size > mins.get(1) && cell_y <= maxs.get(1))
+				return true;
+		}
+
+		return false;
 	}
 
 
@@ -49,10 +292,40 @@ namespace onion
 	void Lighting::set_ambient_light(const vec3f& ambient)
 	{
 		m_Buffer->set<FLOAT_VEC3>("ambient", ambient);
+		invalidate_display();
 	}
 
 
 	std::vector<Lighting::_LightArray*> Lighting::m_LightArrays{};
+	Int Lighting::m_Permutation{ -1 };
+	std::string Lighting::m_PermutationDefines{};
+	Int Lighting::m_PermutationCount{ 1 };
+	Int Lighting::m_MaxClusterLights{ -1 };
+	Int Lighting::m_FlickerInterval{ 1 };
+	Int Lighting::m_FlickerFrame{ -1 };
+	vec2f Lighting::m_VisibleMins{ std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() };
+	vec2f Lighting::m_VisibleMaxs{ std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+
+	void Lighting::set_max_cluster_lights(Int max_lights)
+	{
+		if (max_lights != m_MaxClusterLights)
+		{
+			m_MaxClusterLights = max_lights;
+			for (auto iter = m_LightArrays.begin(); iter != m_LightArrays.end(); ++iter)
+				(*iter)->changed = true;
+		}
+	}
+
+	void Lighting::set_flicker_interval(Int frames)
+	{
+		m_FlickerInterval = frames > 1 ? frames : 1;
+	}
+
+	void Lighting::set_visible_area(const vec2f& mins, const vec2f& maxs)
+	{
+		m_VisibleMins = mins;
+		m_VisibleMaxs = maxs;
+	}
 
 	void Lighting::add(Lighting::Light* light)
 	{
@@ -68,6 +341,109 @@ namespace onion
 				break;
 	}
 
+	void Lighting::upload()
+	{
+		// Flickering lights only change intensity once per interval
+		Int frame = UpdateEvent::frame - (UpdateEvent::frame % m_FlickerInterval);
+		m_Buffer->set<Int>("frame", frame);
+
+		bool changed = false;
+		for (auto iter = m_LightArrays.begin(); iter != m_LightArrays.end(); ++iter)
+		{
+			if ((*iter)->changed)
+			{
+				(*iter)->upload();
+				changed = true;
+			}
+
+			// The screen also changes whenever a flickering light that reaches the visible area changes intensity
+			if (frame != m_FlickerFrame && !changed && (*iter)->flickers_within(m_VisibleMins, m_VisibleMaxs))
+				changed = true;
+		}
+
+		m_FlickerFrame = frame;
+		if (changed)
+			invalidate_display();
+
+		// Combine the permutation of each array into one key
+		Int permutation = 0;
+		for (auto iter = m_LightArrays.rbegin(); iter != m_LightArrays.rend(); ++iter)
+			permutation = (permutation * ONION_LIGHT_PERMUTATIONS) + (*iter)->permutation;
+
+		if (permutation != m_Permutation)
+		{
+			// Define the light counts for every array with a bounded permutation
+			m_Permutation = permutation;
+			m_PermutationDefines.clear();
+			for (auto iter = m_LightArrays.begin(); iter != m_LightArrays.end(); ++iter)
+				if ((*iter)->permutation < ONION_LIGHT_PERMUTATIONS - 1)
+					m_PermutationDefines += "#define " + (*iter)->define_name + " " + std::to_string(g_PermutationLightCounts[(*iter)->permutation]) + "\n";
+		}
+	}
+
+
+	bool Lighting::m_Deferred{ false };
+	bool Lighting::m_GeometryPass{ false };
+	opengl::_FrameBuffer* Lighting::m_FrameBuffer{ nullptr };
+	ShaderPermutations<Int, Int, Int, Int>* Lighting::m_DeferredShaders{ nullptr };
+
+	void Lighting::set_deferred(bool deferred)
+	{
+		m_Deferred = deferred;
+	}
+
+	bool Lighting::is_deferred()
+	{
+		return m_Deferred;
+	}
+
+	bool Lighting::is_geometry_pass()
+	{
+		return m_GeometryPass;
+	}
+
+	void Lighting::begin_geometry_pass()
+	{
+		if (!m_Deferred)
+			return;
+
+		if (!m_FrameBuffer)
+		{
+			// The diffuse color, the normal or baked light, and the position with the kind of surface
+			m_FrameBuffer = new opengl::_FrameBuffer({ GL_RGBA8, GL_RGBA16F, GL_RGBA32F });
+			m_DeferredShaders = new ShaderPermutations<Int, Int, Int, Int>(
+				"world/deferred_lighting",
+				{ "albedoTarget", "normalTarget", "positionTarget", "noiseTexture" }
+			);
+		}
+
+		// Surfaces overwrite each other instead of blending, so that only the front surface of each pixel is lit
+		m_FrameBuffer->bind(vec4f(0.f, 0.f, 0.f, -1.f));
+		glDisable(GL_BLEND);
+		m_GeometryPass = true;
+	}
+
+	void Lighting::end_geometry_pass()
+	{
+		if (!m_GeometryPass)
+			return;
+
+		m_GeometryPass = false;
+		m_FrameBuffer->unbind();
+		glEnable(GL_BLEND);
+
+		// Light every pixel once, over whatever was already on the screen
+		m_DeferredShaders->get(m_Permutation, m_PermutationDefines)->activate(0, 1, 2, 3);
+		m_FrameBuffer->activate(0, 0);
+		m_FrameBuffer->activate(1, 1);
+		m_FrameBuffer->activate(2, 2);
+		get_bluenoise_image()->activate(3);
+
+		glDisable(GL_DEPTH_TEST);
+		m_FrameBuffer->display();
+		glEnable(GL_DEPTH_TEST);
+	}
+
 
 	opengl::_Image* get_bluenoise_image()
 	{
@@ -82,6 +458,14 @@ namespace onion
 
 		LightObject::LightObject(Shape* bounds) : Object(bounds) {}
 
+		void LightObject::translate(const vec3i& trans)
+		{
+			m_Bounds->translate(trans);
+
+			// Upload the moved light again, if it is being used
+			get_light()->reset();
+		}
+
 		void LightObject::toggle(bool on)
 		{
 			if (on)
@@ -108,6 +492,17 @@ namespace onion
 			return &m_Light;
 		}
 
+		void CubeLightObject::translate(const vec3i& trans)
+		{
+			for (int k = 2; k >= 0; --k)
+			{
+				m_Light.mins(k) += trans.get(k);
+				m_Light.maxs(k) += trans.get(k);
+			}
+
+			LightObject::translate(trans);
+		}
+
 
 		CubeLightObjectGenerator::CubeLightObjectGenerator(std::string id, const StringData& params) : ObjectGenerator(id)
 		{
@@ -159,6 +554,14 @@ namespace onion
 			return &m_Light;
 		}
 
+		void ConeLightObject::translate(const vec3i& trans)
+		{
+			for (int k = 2; k >= 0; --k)
+				m_Light.pos(k) += trans.get(k);
+
+			LightObject::translate(trans);
+		}
+
 
 		ConeLightObjectGenerator::ConeLightObjectGenerator(std::string id, const StringData& params) : ObjectGenerator(id)
 		{
@@ -1,4 +1,6 @@
 #include <algorithm>
+#include <GL/glew.h>
+#include "../../../include/onions/worker.h"
 #include "../../../include/onions/world/manager.h"
 
 namespace onion
@@ -10,40 +12,210 @@ namespace onion
 		
 		ObjectManager::~ObjectManager()
 		{
-			for (auto iter = m_Blocks.begin(); iter != m_Blocks.end(); ++iter)
-				delete iter->second;
-
 			for (auto iter = m_Actors.begin(); iter != m_Actors.end(); ++iter)
 				delete *iter;
+
+			// Static objects and lights can be stored in many blocks, so collect each one once before deleting it
+			std::vector<Object*> objects(m_BlockObjects.begin(), m_BlockObjects.end());
+			objects.insert(objects.end(), m_BlockLights.begin(), m_BlockLights.end());
+			for (auto iter = m_PendingObjects.begin(); iter != m_PendingObjects.end(); ++iter)
+				objects.push_back(iter->second);
+			for (auto iter = m_PendingLights.begin(); iter != m_PendingLights.end(); ++iter)
+				objects.push_back(iter->second);
+			objects.insert(objects.end(), m_UnassignedLights.begin(), m_UnassignedLights.end());
+
+			std::sort(objects.begin(), objects.end());
+			objects.erase(std::unique(objects.begin(), objects.end()), objects.end());
+			for (auto iter = objects.begin(); iter != objects.end(); ++iter)
+				delete *iter;
 		}
 
 
 		vec3i ObjectManager::m_BlockDimensions{ 320, 320, 320 };
 		Int ObjectManager::m_UpperBound = 320;
 
-		ObjectManager::Block::Block(const vec3i& pos, Object* obj) : cube(pos, m_BlockDimensions)
+		ObjectManager::Block::Block(const vec3i& index) : index(index), cube(index * m_BlockDimensions, m_BlockDimensions) {}
+
+		Uint ObjectManager::__find_slot(const vec3i& index) const
 		{
-			objects.insert(obj);
+			Uint mask = m_BlockTable.size() - 1;
+			Uint slot = std::hash<INT_VEC3>()(index) & mask;
+
+			// Probe linearly until either the block or an empty slot is found
+			while (m_BlockTable[slot] >= 0 && m_Blocks[m_BlockTable[slot]].index != index)
+				slot = (slot + 1) & mask;
+
+			return slot;
 		}
-		
-		ObjectManager::Block::Block(const vec3i& pos, LightObject* light) : cube(pos, m_BlockDimensions)
+
+		Int ObjectManager::get_block(const vec3i& index) const
+		{
+			if (m_BlockTable.empty())
+				return -1;
+			return m_BlockTable[__find_slot(index)];
+		}
+
+		Int ObjectManager::get_or_create_block(const vec3i& index)
 		{
-			lights.insert(light);
+			// Keep the table at most half full, so that probe sequences stay short
+			if (2 * (m_Blocks.size() + 1) > m_BlockTable.size())
+			{
+				m_BlockTable.assign(m_BlockTable.empty() ? 16 : 2 * m_BlockTable.size(), -1);
+				for (Int k = m_Blocks.size() - 1; k >= 0; --k)
+					m_BlockTable[__find_slot(m_Blocks[k].index)] = k;
+			}
+
+			Uint slot = __find_slot(index);
+			if (m_BlockTable[slot] < 0)
+			{
+				// Construct a new block
+				m_BlockTable[slot] = m_Blocks.size();
+				m_Blocks.emplace_back(index);
+			}
+
+			return m_BlockTable[slot];
 		}
 
-		ObjectManager::Block* ObjectManager::get_block(const vec3i& index)
+		template <typename T>
+		void ObjectManager::__build(std::vector<std::pair<Int, T*>>& pending, std::vector<T*>& members, Uint Block::* begin, Uint Block::* count)
 		{
-			auto iter = m_Blocks.find(index);
-			if (iter != m_Blocks.end())
-				return iter->second;
-			return nullptr;
+			if (pending.empty())
+				return;
+
+			// Merge the members that were already built with the pending members
+			for (Int n = m_Blocks.size() - 1; n >= 0; --n)
+			{
+				Block& block = m_Blocks[n];
+				for (Uint k = block.*begin; k < block.*begin + block.*count; ++k)
+					pending.emplace_back(n, members[k]);
+
+				block.*begin = 0;
+				block.*count = 0;
+			}
+
+			// Group the members by block, removing any duplicates
+			std::sort(pending.begin(), pending.end());
+			pending.erase(std::unique(pending.begin(), pending.end()), pending.end());
+
+			// Lay out each block's members contiguously
+			members.resize(pending.size());
+			for (Uint k = 0; k < pending.size(); ++k)
+			{
+				Block& block = m_Blocks[pending[k].first];
+				if (block.*count == 0)
+					block.*begin = k;
+				++(block.*count);
+
+				members[k] = pending[k].second;
+			}
+
+			std::vector<std::pair<Int, T*>>().swap(pending);
 		}
 
-		bool ObjectManager::Block::collision(Object* obj)
+		void ObjectManager::__assign_lights()
 		{
-			for (auto iter = objects.begin(); iter != objects.end(); ++iter)
-				if ((*iter)->collision(obj))
+			if (m_UnassignedLights.empty())
+				return;
+
+			// Find the range of blocks that each light could illuminate, counting them so that memory is only allocated once
+			std::vector<mat2x3i> ranges(m_UnassignedLights.size());
+			Uint candidates = 0;
+			Int top = (m_UpperBound - 1) / m_BlockDimensions.get(2);
+			for (Int n = m_UnassignedLights.size() - 1; n >= 0; --n)
+			{
+				LightObject* light = m_UnassignedLights[n];
+				const mat2x3i& box = light->get_bounds()->get_bounding_box();
+				Int radius = light->get_light()->radius;
+
+				Uint count = 1;
+				for (int k = 2; k >= 0; --k)
+				{
+					ranges[n](k, 0) = floor_div(box.get(k, 0) - radius, m_BlockDimensions.get(k));
+					ranges[n](k, 1) = floor_div(box.get(k, 1) + radius, m_BlockDimensions.get(k));
+				}
+				ranges[n](2, 0) = std::max<Int>(ranges[n].get(2, 0), 0);
+				ranges[n](2, 1) = std::min<Int>(ranges[n].get(2, 1), top);
+
+				for (int k = 2; k >= 0; --k)
+					count *= std::max<Int>(ranges[n].get(k, 1) - ranges[n].get(k, 0) + 1, 0);
+				candidates += count;
+			}
+			m_PendingLights.reserve(m_PendingLights.size() + candidates);
+
+			// Sweep through the lights, keeping each block in range that lies within the radius of the light
+			for (Uint n = 0; n < m_UnassignedLights.size(); ++n)
+			{
+				LightObject* light = m_UnassignedLights[n];
+				const mat2x3i& box = light->get_bounds()->get_bounding_box();
+				long long radius = light->get_light()->radius;
+
+				for (Int i = ranges[n].get(0, 0); i <= ranges[n].get(0, 1); ++i)
+				{
+					for (Int j = ranges[n].get(1, 0); j <= ranges[n].get(1, 1); ++j)
+					{
+						for (Int k = ranges[n].get(2, 0); k <= ranges[n].get(2, 1); ++k)
+						{
+							// Find the squared distance between the bounding box of the light and the block
+							vec3i index(i, j, k);
+							long long dist = 0;
+							for (int m = 2; m >= 0; --m)
+							{
+								long long block_min = index.get(m) * m_BlockDimensions.get(m);
+								long long block_max = block_min + m_BlockDimensions.get(m);
+								long long gap = std::max<long long>(std::max<long long>(block_min - box.get(m, 1), box.get(m, 0) - block_max), 0);
+								dist += gap * gap;
+							}
+
+							if (dist < radius * radius)
+								m_PendingLights.emplace_back(get_or_create_block(index), light);
+						}
+					}
+				}
+			}
+
+			std::vector<LightObject*>().swap(m_UnassignedLights);
+		}
+
+		void ObjectManager::build()
+		{
+			__assign_lights();
+			__build(m_PendingObjects, m_BlockObjects, &Block::objects_begin, &Block::objects_count);
+			__build(m_PendingLights, m_BlockLights, &Block::lights_begin, &Block::lights_count);
+		}
+
+		Uint ObjectManager::upload_batch()
+		{
+			return m_Batch.upload();
+		}
+
+		void ObjectManager::clear_batch()
+		{
+			m_Batch.clear();
+		}
+
+		bool ObjectManager::collision(const Block& block, Object* obj)
+		{
+			const Shape* bounds = obj->get_bounds();
+			for (Uint k = block.objects_begin + block.objects_count; k > block.objects_begin; --k)
+			{
+				Object* other = m_BlockObjects[k - 1];
+				++m_Counters.pairs_tested;
+
+				// Only run GJK if the bounding boxes overlap
+				if (!bounds->overlaps(other->get_bounds()))
+				{
+					++m_Counters.pairs_rejected_by_bounds;
+				}
+				else if (other->collision(obj))
+				{
+					++m_Counters.collisions;
 					return true;
+				}
+				else
+				{
+					++m_Counters.pairs_rejected_by_gjk;
+				}
+			}
 			return false;
 		}
 
@@ -52,40 +224,296 @@ namespace onion
 			// Construct a rectangular prism representing the block
 			OrthogonalPrism rect(index * m_BlockDimensions, m_BlockDimensions);
 
+			// Check if the bounding boxes overlap before running GJK
+			const Shape* bounds = obj->get_bounds();
+			if (!bounds->overlaps(&rect))
+				return false;
+
 			// Check if the distance between the object and the block is 0
-			return obj->get_bounds()->get_distance(&rect) == 0;
+			return bounds->get_distance(&rect) == 0;
 		}
 
 		bool ObjectManager::collision(Object* obj)
 		{
-			const Shape* bounds = obj->get_bounds();
-			vec3i base_index = bounds->get_position();
+			// Find the range of blocks that the bounding box of the object overlaps
+			const mat2x3i& box = obj->get_bounds()->get_bounding_box();
+
+			vec3i min_index, max_index;
+			for (int k = 2; k >= 0; --k)
+			{
+				min_index(k) = floor_div(box.get(k, 0), m_BlockDimensions.get(k));
+				max_index(k) = floor_div(box.get(k, 1), m_BlockDimensions.get(k));
+			}
+			min_index(2) = std::max<Int>(min_index.get(2), 0);
+
+			// Test against the objects in each block in range
+			for (Int i = min_index.get(0); i <= max_index.get(0); ++i)
+			{
+				for (Int j = min_index.get(1); j <= max_index.get(1); ++j)
+				{
+					for (Int k = min_index.get(2); k <= max_index.get(2); ++k)
+					{
+						Int n = get_block(vec3i(i, j, k));
+						if (n >= 0 && m_Blocks[n].objects_count > 0)
+						{
+							++m_Counters.blocks_visited;
+							if (collision(m_Blocks[n], obj))
+								return true;
+						}
+					}
+				}
+			}
+
+			return false;
+		}
+
+		void ObjectManager::__sweep(Actor* actor, const vec3i& trans, const long long* start, const SweptShape& swept, Object* other, Impact& impact)
+		{
+			static constexpr Int num_subpixels = SubpixelHandler::num_subpixels;
+
+			const mat2x3i& box = actor->get_bounds()->get_bounding_box();
+			const mat2x3i& other_box = other->get_bounds()->get_bounding_box();
+
+			// Find when the bounding boxes start and stop overlapping on every axis
+			long long enter_num = -1, enter_den = 1, exit_num = 2, exit_den = 1;
+			int enter_axis = -1;
+			long long lowers[3], uppers[3];
+			for (int c = 2; c >= 0; --c)
+			{
+				// The range of minimum corners, in subpixel units, where the boxes overlap on this axis
+				long long width = box.get(c, 1) - box.get(c, 0);
+				long long lower = (other_box.get(c, 0) - width) * num_subpixels;
+				long long upper = ((other_box.get(c, 1) + 1) * num_subpixels) - 1;
+				lowers[c] = lower;
+				uppers[c] = upper;
+
+				long long t = trans.get(c);
+				if (t == 0)
+				{
+					if (start[c] < lower || start[c] > upper)
+					{
+						++m_Counters.pairs_rejected_by_bounds;
+						return;
+					}
+				}
+				else
+				{
+					long long den = t > 0 ? t : -t;
+					long long en = t > 0 ? lower - start[c] : start[c] - upper;
+					long long ex = t > 0 ? upper - start[c] : start[c] - lower;
+
+					if (en * enter_den > enter_num * den)
+					{
+						enter_num = en;
+						enter_den = den;
+						enter_axis = c;
+					}
+					if (ex * exit_den < exit_num * den)
+					{
+						exit_num = ex;
+						exit_den = den;
+					}
+				}
+			}
+
+			// Reject the pair if the boxes never overlap during the translation, or only overlap after an earlier impact
+			if (enter_num * exit_den > exit_num * enter_den
+				|| exit_num < 0
+				|| (impact.hit ? enter_num * impact.denominator >= impact.numerator * enter_den : enter_num > enter_den))
+			{
+				++m_Counters.pairs_rejected_by_bounds;
+			}
+			else if (other->collision(actor, &swept))
+			{
+				if (enter_num <= 0)
+				{
+					// The actor already overlaps the object, so find the axis that it is least deep into the object along
+					int axis = 0;
+					long long depth = -1, direction = 0;
+					for (int c = 2; c >= 0; --c)
+					{
+						long long below = start[c] - lowers[c] + 1;
+						long long above = uppers[c] - start[c] + 1;
+						if (depth < 0 || std::min(below, above) < depth)
+						{
+							axis = c;
+							depth = std::min(below, above);
+							direction = below < above ? -1 : 1;
+						}
+					}
+
+					// Let the actor through if it does not move any deeper into the object along that axis
+					if (trans.get(axis) * direction >= 0)
+					{
+						++m_Counters.pairs_rejected_by_bounds;
+						return;
+					}
+
+					++m_Counters.collisions;
+					impact.hit = true;
+					impact.numerator = 0;
+					impact.denominator = 1;
+					impact.axis = axis;
+				}
+				else
+				{
+					++m_Counters.collisions;
+					impact.hit = true;
+					impact.numerator = enter_num;
+					impact.denominator = enter_den;
+					impact.axis = enter_axis;
+				}
+			}
+			else
+			{
+				++m_Counters.pairs_rejected_by_gjk;
+			}
+		}
+
+		bool ObjectManager::sweep(Actor* actor, const vec3i& trans, SweepResult& result)
+		{
+			static constexpr Int num_subpixels = SubpixelHandler::num_subpixels;
+
+			const Shape* bounds = actor->get_bounds();
+			const mat2x3i& box = bounds->get_bounding_box();
+			const vec3i& subpixels = actor->get_subpixels();
+
+			// Calculate the minimum corner of the actor in subpixel units, and how far the actor would move in pixels
+			long long start[3];
+			vec3i pixel_trans;
+			for (int k = 2; k >= 0; --k)
+			{
+				start[k] = ((long long)box.get(k, 0) * num_subpixels) + subpixels.get(k);
+				pixel_trans(k) = floor_div(subpixels.get(k) + trans.get(k), num_subpixels);
+			}
+
+			// Construct the volume that the actor sweeps through
+			SweptShape swept(bounds, pixel_trans);
+			const mat2x3i& swept_box = swept.get_bounding_box();
+
+			vec3i min_index, max_index;
 			for (int k = 2; k >= 0; --k)
-				base_index(k) /= m_BlockDimensions.get(k);
+			{
+				min_index(k) = floor_div(swept_box.get(k, 0), m_BlockDimensions.get(k));
+				max_index(k) = floor_div(swept_box.get(k, 1), m_BlockDimensions.get(k));
+			}
+			min_index(2) = std::max<Int>(min_index.get(2), 0);
+
+			Impact impact;
+			std::vector<Object*> nearby;
 
-			for (Int i = -1; i <= 1; ++i)
+			// Test against this manager first, then against each neighbouring manager
+			const Int neighbours = (Int)m_Neighbours.size();
+			for (Int g = neighbours; g >= 0; --g)
 			{
-				for (Int j = -1; j <= 1; ++j)
+				const ObjectManager* manager = g == neighbours ? this : m_Neighbours[g];
+
+				// Test against static objects in every block that the swept volume overlaps
+				for (Int i = min_index.get(0); i <= max_index.get(0); ++i)
 				{
-					for (Int k = -1; k <= 1; ++k)
+					for (Int j = min_index.get(1); j <= max_index.get(1); ++j)
 					{
-						vec3i index = base_index + vec3i(i, j, k);
-						if (index.get(2) >= 0)
+						for (Int k = min_index.get(2); k <= max_index.get(2); ++k)
 						{
-							if (Block* block = get_block(index))
+							Int n = manager->get_block(vec3i(i, j, k));
+							if (n < 0 || manager->m_Blocks[n].objects_count == 0)
+								continue;
+
+							++m_Counters.blocks_visited;
+
+							const Block& block = manager->m_Blocks[n];
+							for (Uint m = block.objects_begin + block.objects_count; m > block.objects_begin; --m)
 							{
-								if (contains(index, obj))
-								{
-									if (block->collision(obj))
-										return true;
-								}
+								++m_Counters.pairs_tested;
+								__sweep(actor, trans, start, swept, manager->m_BlockObjects[m - 1], impact);
 							}
 						}
 					}
 				}
+
+				// Test against other actors whose fattened boxes overlap the swept volume
+				nearby.clear();
+				manager->m_ActorTree.query(swept_box, nearby);
+				for (auto iter = nearby.begin(); iter != nearby.end(); ++iter)
+				{
+					if (*iter != actor)
+					{
+						++m_Counters.actor_pairs_tested;
+						__sweep(actor, trans, start, swept, *iter, impact);
+					}
+				}
 			}
 
-			return false;
+			if (impact.hit)
+			{
+				result.time = Frac(impact.numerator, impact.denominator);
+				result.normal = vec3i(0, 0, 0);
+
+				// Stop one subpixel short of the impact along the axis that was hit, and scale the other axes to match
+				for (int k = 2; k >= 0; --k)
+					result.translation(k) = impact.numerator > 0 ? (Int)(trans.get(k) * (impact.numerator - 1) / impact.denominator) : 0;
+				if (impact.axis >= 0)
+					result.normal(impact.axis) = trans.get(impact.axis) > 0 ? -1 : 1;
+			}
+			else
+			{
+				result.time = Frac(1, 1);
+				result.translation = trans;
+				result.normal = vec3i(0, 0, 0);
+			}
+
+			return impact.hit;
+		}
+
+		void ObjectManager::get_actors(const Shape* shape, std::vector<Actor*>& actors) const
+		{
+			const mat2x3i& box = shape->get_bounding_box();
+
+			std::vector<Object*> nearby;
+			m_ActorTree.query(box, nearby);
+			for (auto iter = nearby.begin(); iter != nearby.end(); ++iter)
+			{
+				const Shape* bounds = (*iter)->get_bounds();
+				if (bounds != shape && shape->overlaps(bounds) && shape->get_distance(bounds) == 0)
+					actors.push_back(static_cast<Actor*>(*iter));
+			}
+		}
+
+		const ObjectManager::CollisionCounters& ObjectManager::get_collision_counters() const
+		{
+			return m_Counters;
+		}
+
+
+		void ObjectManager::remove(Actor* actor)
+		{
+			auto iter = std::find(m_Actors.begin(), m_Actors.end(), actor);
+			if (iter == m_Actors.end())
+				return;
+
+			m_Actors.erase(iter);
+			m_ActorTree.remove(actor);
+
+			// Search by identity, since the actor may have moved since it was ordered in the set
+			for (auto active = m_ActiveObjects.begin(); active != m_ActiveObjects.end(); ++active)
+			{
+				if (*active == actor)
+				{
+					m_ActiveObjects.erase(active);
+					invalidate_display();
+					break;
+				}
+			}
+		}
+
+		const std::vector<Actor*>& ObjectManager::get_actors() const
+		{
+			return m_Actors;
+		}
+
+		void ObjectManager::set_neighbours(const std::vector<ObjectManager*>& neighbours)
+		{
+			m_Neighbours = neighbours;
 		}
 
 
@@ -146,16 +574,11 @@ namespace onion
 			}
 		}
 
-		template <typename T>
-		void ObjectManager::add(T* obj)
+		template <>
+		void ObjectManager::add<LightObject>(LightObject* obj)
 		{
-			// Calculates the index of the block that the position of the object is in
-			vec3i base_index = obj->get_bounds()->get_position();
-			for (int k = 2; k >= 0; --k)
-				base_index(k) /= m_BlockDimensions.get(k);
-
-			// Starting from the base index and radiating outwards, inserts the object into all blocks that it affects
-			__insert<T, 2>(base_index, obj);
+			// Lights are assigned to the blocks they illuminate all at once, the next time the blocks are built
+			m_UnassignedLights.push_back(obj);
 		}
 
 		template <>
@@ -163,7 +586,14 @@ namespace onion
 		{
 			if (Actor* actor = dynamic_cast<Actor*>(obj))
 			{
-				m_Actors.insert(actor);
+				// Keep the actors sorted by ID, so that they are always moved in the same order
+				auto iter = std::lower_bound(m_Actors.begin(), m_Actors.end(), actor,
+					[](const Actor* lhs, const Actor* rhs) { return lhs->get_id() < rhs->get_id(); });
+				if (iter == m_Actors.end() || *iter != actor)
+				{
+					m_Actors.insert(iter, actor);
+					m_ActorTree.insert(actor);
+				}
 			}
 			else
 			{
@@ -175,6 +605,10 @@ namespace onion
 				// Starting from the base index and radiating outwards, inserts the object into all blocks that it affects
 				__insert<Object, 2>(base_index, obj);
 
+				// Merge the object's graphic with those of other static objects, if it never changes
+				if (!m_Batch.is_uploaded())
+					obj->batch(m_Batch);
+
 				// Add the object's lighting data, if it has any
 				if (LightObject* light = dynamic_cast<LightObject*>(obj))
 				{
@@ -192,52 +626,12 @@ namespace onion
 				return false;
 
 			// Add the object to the block
-			if (Block* block = get_block(index))
-			{
-				// Insert the light into an existing block
-				block->objects.insert(obj);
-			}
-			else
-			{
-				// Construct a new block, then insert the light
-				m_Blocks.emplace(index, new Block(index * m_BlockDimensions, obj));
-			}
+			m_PendingObjects.emplace_back(get_or_create_block(index), obj);
 
 			return true;
 		}
 
 
-		template <>
-		bool ObjectManager::__insert<LightObject, -1>(const vec3i& index, LightObject* obj)
-		{
-			// Construct a rectangular prism representing the block
-			OrthogonalPrism rect(index * m_BlockDimensions, m_BlockDimensions);
-
-			// Find the minimum (squared) difference from the light to the block
-			Int dist = obj->get_bounds()->get_distance(&rect);
-
-			// If the (squared) length of the minimal difference vector is less than or equal to the (squared) radius of the light, then add it to the block
-			Int radius = obj->get_light()->radius;
-			if (dist < radius)
-			{
-				if (Block* block = get_block(index))
-				{
-					// Insert the light into an existing block
-					block->lights.insert(obj);
-				}
-				else
-				{
-					// Construct a new block, then insert the light
-					m_Blocks.emplace(index, new Block(rect.get_position(), obj));
-				}
-				return true;
-			}
-
-			return false;
-		}
-
-
-
 		const WorldCamera* ObjectManager::ObjectComparer::view{ nullptr };
 
 		bool ObjectManager::ObjectComparer::operator()(const Object* lhs, const Object* rhs) const
@@ -248,31 +642,34 @@ namespace onion
 
 		void ObjectManager::reset_visible(const WorldCamera* view)
 		{
-			// A set of all blocks within view.
-			std::unordered_set<Block*> active_blocks;
+			// Make sure any objects added since the chunk was loaded are in their blocks
+			build();
+
+			std::vector<Object*> active_objects; // All static objects in blocks within view
+			std::unordered_set<LightObject*> active_lights; // A set of all lights illuminating a block within view
 
 			// Determine which blocks are in view
-			// TODO do this more efficiently??
 			for (auto iter = m_Blocks.begin(); iter != m_Blocks.end(); ++iter) // Iterate over every block to check if each is visible
 			{
-				Block* block = iter->second;
+				const Block& block = *iter;
 
-				// Check if the block is visible, and add it to the list of active blocks if it is
-				if (view->get_distance(&block->cube) == 0)
-					active_blocks.insert(block);
-			}
-
-			std::unordered_set<Object*> active_objects; // A set of all visible objects
-			std::unordered_set<LightObject*> active_lights; // A set of all lights illuminating a block within view
-			for (auto iter = active_blocks.begin(); iter != active_blocks.end(); ++iter)
-			{
-				// Add all static objects in active blocks
-				active_objects.insert((*iter)->objects.begin(), (*iter)->objects.end());
+				// Check if the block is visible
+				if (view->get_distance(&block.cube) == 0)
+				{
+					// Add all static objects in the block
+					auto obj_begin = m_BlockObjects.begin() + block.objects_begin;
+					active_objects.insert(active_objects.end(), obj_begin, obj_begin + block.objects_count);
 
-				// Add all lights illuminating the block to the set of active lights
-				active_lights.insert((*iter)->lights.begin(), (*iter)->lights.end());
+					// Add all lights illuminating the block to the set of active lights
+					auto light_begin = m_BlockLights.begin() + block.lights_begin;
+					active_lights.insert(light_begin, light_begin + block.lights_count);
+				}
 			}
 
+			// Remove objects that were in more than one visible block
+			std::sort(active_objects.begin(), active_objects.end());
+			active_objects.erase(std::unique(active_objects.begin(), active_objects.end()), active_objects.end());
+
 			// Reset which static objects are visible and in which order
 			m_ActiveObjects.clear();
 			ObjectManager::ObjectComparer::view = view;
@@ -280,8 +677,8 @@ namespace onion
 			{
 				Object* obj = *iter;
 
-				// Check if the object is visible
-				if (view->get_distance(obj->get_bounds()) == 0)
+				// Check if the object is visible, unless it is displayed as part of a batch
+				if (!obj->is_batched() && view->get_distance(obj->get_bounds()) == 0)
 				{
 					m_ActiveObjects.insert(obj);
 				}
@@ -312,44 +709,46 @@ namespace onion
 
 		void ObjectManager::update_visible(const WorldCamera* view, int frames_passed)
 		{
-			for (auto iter = m_Actors.begin(); iter != m_Actors.end(); ++iter)
-			{
-				Actor* actor = *iter;
+			// Make sure any objects added since the chunk was loaded are in their blocks
+			build();
 
-				// Calculate how the actor should (ideally) be translated
-				vec3i trans = actor->update(view, frames_passed);
+			// Reset the collision counters for this pass
+			m_Counters = CollisionCounters();
+
+			// Calculate how each actor should (ideally) be translated, spreading the agents across the worker threads
+			m_Translations.resize(m_Actors.size());
+			WorkerPool::get_shared().parallel_for(m_Actors.size(), ONION_WORLD_ACTOR_UPDATE_BATCH,
+				[this, view, frames_passed](Uint k) { m_Translations[k] = m_Actors[k]->update(view, frames_passed); });
+
+			// Resolve collisions on this thread, in order of ID
+			for (Uint m = 0; m < m_Actors.size(); ++m)
+			{
+				Actor* actor = m_Actors[m];
+				vec3i trans = m_Translations[m];
 
 				if (trans.square_sum() > 0)
 				{
-					// Test whether there are any collisions if the actor is translated as it is supposed to be
-					actor->translate(trans);
-					if (collision(actor))
+					// Move the actor until it hits something, then slide along the surface that was hit with whatever translation remains
+					for (int n = ONION_WORLD_MAX_SLIDE_ITERATIONS; n > 0 && trans.square_sum() > 0; --n)
 					{
-						// If there was a collision, reset the position
-						actor->translate(-1 * trans);
-
-						vec3i norm = view->get_normal();
-						
-						// Translate by only the vertical axis
-						vec3i dy = vec3i(norm.get(0), norm.get(1), 0);
-						dy = dy * Frac(trans.get(1), dy.square_sum());
-						actor->translate(dy);
-						if (collision(actor))
-						{
-							actor->translate(-1 * dy);
-
-							// Translate by only the horizontal axis
-							vec3i dx = vec3i(vec2i(trans - dy), 0);
-							actor->translate(dx);
-							if (collision(actor))
-							{
-								actor->translate(-1 * dx);
-
-								// TODO test other translations?
-							}
-						}
+						SweepResult result;
+						sweep(actor, trans, result);
+						actor->translate(result.translation);
+
+						// Stop if nothing was hit
+						if (result.normal.square_sum() == 0)
+							break;
+
+						// Discard the part of the remaining translation that points into the surface
+						trans -= result.translation;
+						for (int k = 2; k >= 0; --k)
+							if (result.normal.get(k) != 0)
+								trans(k) = 0;
 					}
 
+					// Reinsert the actor into the tree, if it has left its fattened box
+					m_ActorTree.update(actor);
+
 					// Check if the actor is visible
 					if (view->get_distance(actor->get_bounds()) == 0)
 					{
@@ -365,11 +764,38 @@ namespace onion
 			}
 		}
 
-		void ObjectManager::display(const vec3i& normal) const
+		void ObjectManager::display_opaque(const vec3i& normal) const
 		{
-			// Display all static objects
+			// The geometry buffer holds one opaque surface per pixel, so every object is displayed front to back into it
+			if (Lighting::is_geometry_pass())
+			{
+				m_Batch.display();
+				for (auto iter = m_ActiveObjects.rbegin(); iter != m_ActiveObjects.rend(); ++iter)
+					(*iter)->display(normal);
+				return;
+			}
+
+			// Display the merged static geometry and all opaque objects front to back without blending, so that hidden pixels fail the depth test early
+			glDisable(GL_BLEND);
+			m_Batch.display();
+			for (auto iter = m_ActiveObjects.rbegin(); iter != m_ActiveObjects.rend(); ++iter)
+				if (!(*iter)->is_translucent())
+					(*iter)->display(normal);
+			glEnable(GL_BLEND);
+		}
+
+		void ObjectManager::display_translucent(const vec3i& normal) const
+		{
+			// Translucent objects were already displayed into the geometry buffer
+			if (Lighting::is_geometry_pass())
+				return;
+
+			// Display translucent objects back to front over everything else, without writing depth, so that they never hide objects displayed after them
+			glDepthMask(GL_FALSE);
 			for (auto iter = m_ActiveObjects.begin(); iter != m_ActiveObjects.end(); ++iter)
-				(*iter)->display(normal);
+				if ((*iter)->is_translucent())
+					(*iter)->display(normal);
+			glDepthMask(GL_TRUE);
 		}
 
 	}
@@ -41,7 +41,12 @@ namespace onion
 
 		bool Object::collision(Object* obj)
 		{
-			if (m_Bounds->get_distance(obj->get_bounds()) == 0)
+			return collision(obj, obj->get_bounds());
+		}
+
+		bool Object::collision(Object* obj, const Shape* bounds)
+		{
+			if (m_Bounds->get_distance(bounds) == 0)
 			{
 				return __collision(obj);
 			}
@@ -49,6 +54,23 @@ namespace onion
 			return false;
 		}
 
+		bool Object::batch(StaticGraphicBatch& batch)
+		{
+			if (!m_Batched && m_Graphic)
+				m_Batched = m_Graphic->batch(batch, m_Bounds->get_position());
+			return m_Batched;
+		}
+
+		bool Object::is_batched() const
+		{
+			return m_Batched;
+		}
+
+		bool Object::is_translucent() const
+		{
+			return m_Graphic && m_Graphic->is_translucent();
+		}
+
 		void Object::display(const vec3i& normal) const 
 		{
 			if (m_Graphic)
@@ -71,6 +93,7 @@ namespace onion
 
 		std::unordered_map<std::string, ObjectGenerator*> ObjectGenerator::m_Generators{};
 		std::unordered_map<std::string, ObjectGenerator::Generator*> ObjectGenerator::m_GeneratorFinder{};
+		std::once_flag ObjectGenerator::m_InitFlag{};
 
 		ObjectGenerator::ObjectGenerator(std::string id)
 		{
@@ -78,6 +101,11 @@ namespace onion
 		}
 
 		void ObjectGenerator::init()
+		{
+			std::call_once(m_InitFlag, __init);
+		}
+
+		void ObjectGenerator::__init()
 		{
 			// Register all types included as part of the Onion library
 			// Lights
@@ -112,19 +140,12 @@ namespace onion
 
 		Object* ObjectGenerator::generate(std::string id, const StringData& params)
 		{
+			// Load the generators before any are used. Later calls wait until loading has finished, and never write to the generators.
+			init();
+
 			auto iter = m_Generators.find(id);
 			if (iter != m_Generators.end())
 				return iter->second->generate(params);
-			
-			// Check if generators haven't been loaded yet
-			if (m_Generators.empty())
-			{
-				init();
-
-				iter = m_Generators.find(id);
-				if (iter != m_Generators.end())
-					return iter->second->generate(params);
-			}
 
 			return nullptr;
 		}
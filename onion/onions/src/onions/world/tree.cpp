@@ -0,0 +1,353 @@
+#include <algorithm>
+#include "../../../include/onions/world/tree.h"
+
+namespace onion
+{
+	namespace world
+	{
+
+		/// <summary>Calculates half the surface area of a box, used as the cost of a node.</summary>
+		/// <param name="box">The box.</param>
+		/// <returns>The sum of the areas of three faces of the box.</returns>
+		long long get_box_cost(const mat2x3i& box)
+		{
+			long long x = box.get(0, 1) - box.get(0, 0);
+			long long y = box.get(1, 1) - box.get(1, 0);
+			long long z = box.get(2, 1) - box.get(2, 0);
+			return (x * y) + (y * z) + (z * x);
+		}
+
+
+		bool BoundingBoxTree::Node::is_leaf() const
+		{
+			return children[0] < 0;
+		}
+
+
+		BoundingBoxTree::BoundingBoxTree(Int margin) : m_Margin(margin) {}
+
+
+		void BoundingBoxTree::combine(const mat2x3i& lhs, const mat2x3i& rhs, mat2x3i& res)
+		{
+			for (int k = 2; k >= 0; --k)
+			{
+				res(k, 0) = std::min<Int>(lhs.get(k, 0), rhs.get(k, 0));
+				res(k, 1) = std::max<Int>(lhs.get(k, 1), rhs.get(k, 1));
+			}
+		}
+
+		bool BoundingBoxTree::contains(const mat2x3i& outer, const mat2x3i& inner)
+		{
+			for (int k = 2; k >= 0; --k)
+				if (inner.get(k, 0) < outer.get(k, 0) || inner.get(k, 1) > outer.get(k, 1))
+					return false;
+			return true;
+		}
+
+		bool BoundingBoxTree::overlaps(const mat2x3i& lhs, const mat2x3i& rhs)
+		{
+			for (int k = 2; k >= 0; --k)
+				if (lhs.get(k, 1) < rhs.get(k, 0) || rhs.get(k, 1) < lhs.get(k, 0))
+					return false;
+			return true;
+		}
+
+
+		Int BoundingBoxTree::size() const
+		{
+			return m_Leaves.size();
+		}
+
+		Int BoundingBoxTree::get_height() const
+		{
+			return m_Root < 0 ? -1 : m_Nodes[m_Root].height;
+		}
+
+
+		Int BoundingBoxTree::__allocate()
+		{
+			Int node;
+			if (m_FreeNodes >= 0)
+			{
+				// Reuse an unused node
+				node = m_FreeNodes;
+				m_FreeNodes = m_Nodes[node].parent;
+			}
+			else
+			{
+				node = m_Nodes.size();
+				m_Nodes.emplace_back();
+			}
+
+			Node& n = m_Nodes[node];
+			n.obj = nullptr;
+			n.parent = -1;
+			n.children[0] = -1;
+			n.children[1] = -1;
+			n.height = 0;
+			return node;
+		}
+
+		void BoundingBoxTree::__free(Int node)
+		{
+			m_Nodes[node].obj = nullptr;
+			m_Nodes[node].height = -1;
+			m_Nodes[node].parent = m_FreeNodes;
+			m_FreeNodes = node;
+		}
+
+		void BoundingBoxTree::__fatten(const Object* obj, mat2x3i& box) const
+		{
+			box = obj->get_bounds()->get_bounding_box();
+			for (int k = 2; k >= 0; --k)
+			{
+				box(k, 0) -= m_Margin;
+				box(k, 1) += m_Margin;
+			}
+		}
+
+
+		void BoundingBoxTree::__insert_leaf(Int leaf)
+		{
+			if (m_Root < 0)
+			{
+				m_Root = leaf;
+				m_Nodes[leaf].parent = -1;
+				return;
+			}
+
+			// Descend the tree, choosing the child that grows the least from including the leaf
+			const mat2x3i leaf_box = m_Nodes[leaf].box;
+			Int sibling = m_Root;
+			while (!m_Nodes[sibling].is_leaf())
+			{
+				const Node& node = m_Nodes[sibling];
+
+				mat2x3i combined;
+				combine(node.box, leaf_box, combined);
+				long long cost = get_box_cost(combined);
+
+				// The cost of making a new parent for this node and the leaf
+				long long sibling_cost = 2 * cost;
+
+				// The minimum cost that every descendant must pay, since this node's box grows regardless
+				long long inherited_cost = 2 * (cost - get_box_cost(node.box));
+
+				long long child_costs[2];
+				for (int c = 1; c >= 0; --c)
+				{
+					const Node& child = m_Nodes[node.children[c]];
+					combine(child.box, leaf_box, combined);
+					child_costs[c] = get_box_cost(combined) + inherited_cost;
+					if (!child.is_leaf())
+						child_costs[c] -= get_box_cost(child.box);
+				}
+
+				if (sibling_cost < child_costs[0] && sibling_cost < child_costs[1])
+					break;
+
+				sibling = node.children[child_costs[0] < child_costs[1] ? 0 : 1];
+			}
+
+			// Make a new parent for the sibling and the leaf
+			Int old_parent = m_Nodes[sibling].parent;
+			Int new_parent = __allocate();
+
+			Node& parent = m_Nodes[new_parent];
+			parent.parent = old_parent;
+			combine(leaf_box, m_Nodes[sibling].box, parent.box);
+			parent.height = m_Nodes[sibling].height + 1;
+			parent.children[0] = sibling;
+			parent.children[1] = leaf;
+
+			if (old_parent >= 0)
+			{
+				Node& grandparent = m_Nodes[old_parent];
+				grandparent.children[grandparent.children[0] == sibling ? 0 : 1] = new_parent;
+			}
+			else
+			{
+				m_Root = new_parent;
+			}
+			m_Nodes[sibling].parent = new_parent;
+			m_Nodes[leaf].parent = new_parent;
+
+			__refit(new_parent);
+		}
+
+		void BoundingBoxTree::__remove_leaf(Int leaf)
+		{
+			if (leaf == m_Root)
+			{
+				m_Root = -1;
+				return;
+			}
+
+			// Replace the parent of the leaf with the leaf's sibling
+			Int parent = m_Nodes[leaf].parent;
+			Int grandparent = m_Nodes[parent].parent;
+			Int sibling = m_Nodes[parent].children[m_Nodes[parent].children[0] == leaf ? 1 : 0];
+
+			if (grandparent >= 0)
+			{
+				Node& node = m_Nodes[grandparent];
+				node.children[node.children[0] == parent ? 0 : 1] = sibling;
+				m_Nodes[sibling].parent = grandparent;
+				__free(parent);
+
+				__refit(grandparent);
+			}
+			else
+			{
+				m_Root = sibling;
+				m_Nodes[sibling].parent = -1;
+				__free(parent);
+			}
+		}
+
+		void BoundingBoxTree::__refit(Int node)
+		{
+			while (node >= 0)
+			{
+				node = __balance(node);
+
+				Node& n = m_Nodes[node];
+				const Node& lhs = m_Nodes[n.children[0]];
+				const Node& rhs = m_Nodes[n.children[1]];
+				n.height = 1 + std::max<Int>(lhs.height, rhs.height);
+				combine(lhs.box, rhs.box, n.box);
+
+				node = n.parent;
+			}
+		}
+
+		Int BoundingBoxTree::__balance(Int a)
+		{
+			if (m_Nodes[a].is_leaf() || m_Nodes[a].height < 2)
+				return a;
+
+			Int b = m_Nodes[a].children[0];
+			Int c = m_Nodes[a].children[1];
+
+			Int balance = m_Nodes[c].height - m_Nodes[b].height;
+			if (balance > 1 || balance < -1)
+			{
+				// Rotate the taller child up into the place of the node
+				int tall_index = balance > 1 ? 1 : 0;
+				Int tall = m_Nodes[a].children[tall_index];
+				Int short_child = m_Nodes[a].children[1 - tall_index];
+
+				Int f = m_Nodes[tall].children[0];
+				Int g = m_Nodes[tall].children[1];
+
+				// Swap the node with its taller child
+				m_Nodes[tall].children[0] = a;
+				m_Nodes[tall].parent = m_Nodes[a].parent;
+				m_Nodes[a].parent = tall;
+
+				Int old_parent = m_Nodes[tall].parent;
+				if (old_parent >= 0)
+				{
+					Node& p = m_Nodes[old_parent];
+					p.children[p.children[0] == a ? 0 : 1] = tall;
+				}
+				else
+				{
+					m_Root = tall;
+				}
+
+				// Keep the taller grandchild under the rotated child, and move the shorter one under the node
+				if (m_Nodes[f].height < m_Nodes[g].height)
+					std::swap(f, g);
+
+				m_Nodes[tall].children[1] = f;
+				m_Nodes[a].children[tall_index] = g;
+				m_Nodes[a].children[1 - tall_index] = short_child;
+				m_Nodes[g].parent = a;
+
+				Node& na = m_Nodes[a];
+				combine(m_Nodes[na.children[0]].box, m_Nodes[na.children[1]].box, na.box);
+				na.height = 1 + std::max<Int>(m_Nodes[na.children[0]].height, m_Nodes[na.children[1]].height);
+
+				Node& nt = m_Nodes[tall];
+				combine(m_Nodes[nt.children[0]].box, m_Nodes[nt.children[1]].box, nt.box);
+				nt.height = 1 + std::max<Int>(m_Nodes[nt.children[0]].height, m_Nodes[nt.children[1]].height);
+
+				return tall;
+			}
+
+			return a;
+		}
+
+
+		void BoundingBoxTree::insert(Object* obj)
+		{
+			if (m_Leaves.count(obj) > 0)
+				return;
+
+			Int leaf = __allocate();
+			m_Nodes[leaf].obj = obj;
+			__fatten(obj, m_Nodes[leaf].box);
+
+			m_Leaves.emplace(obj, leaf);
+			__insert_leaf(leaf);
+		}
+
+		void BoundingBoxTree::remove(Object* obj)
+		{
+			auto iter = m_Leaves.find(obj);
+			if (iter == m_Leaves.end())
+				return;
+
+			__remove_leaf(iter->second);
+			__free(iter->second);
+			m_Leaves.erase(iter);
+		}
+
+		bool BoundingBoxTree::update(Object* obj)
+		{
+			auto iter = m_Leaves.find(obj);
+			if (iter == m_Leaves.end())
+				return false;
+
+			// Nothing needs to change while the object stays within its fattened box
+			Int leaf = iter->second;
+			if (contains(m_Nodes[leaf].box, obj->get_bounds()->get_bounding_box()))
+				return false;
+
+			__remove_leaf(leaf);
+			__fatten(obj, m_Nodes[leaf].box);
+			__insert_leaf(leaf);
+			return true;
+		}
+
+
+		void BoundingBoxTree::query(const mat2x3i& box, std::vector<Object*>& objects) const
+		{
+			if (m_Root < 0)
+				return;
+
+			std::vector<Int> stack;
+			stack.push_back(m_Root);
+			while (!stack.empty())
+			{
+				const Node& node = m_Nodes[stack.back()];
+				stack.pop_back();
+
+				if (!overlaps(node.box, box))
+					continue;
+
+				if (node.is_leaf())
+				{
+					objects.push_back(node.obj);
+				}
+				else
+				{
+					stack.push_back(node.children[1]);
+					stack.push_back(node.children[0]);
+				}
+			}
+		}
+
+	}
+}
@@ -1,5 +1,7 @@
+#include <algorithm>
 #include "../../../include/onions/world/world.h"
 #include "../../../include/onions/application.h"
+#include "../../../include/onions/error.h"
 
 namespace onion
 {
@@ -22,8 +24,17 @@ namespace onion
 		void World::display() const
 		{
 			if (m_Camera)
+			{
 				m_Camera->activate();
+
+				// Flickering lights only redraw the screen if they reach the part of the world that the camera can see
+				const mat2x3i& box = m_Camera->get_bounding_box();
+				Lighting::set_visible_area(vec2f(box.get(0, 0), box.get(1, 0)), vec2f(box.get(0, 1), box.get(1, 1)));
+			}
+
+			Lighting::begin_geometry_pass();
 			__display();
+			Lighting::end_geometry_pass();
 		}
 
 
@@ -71,7 +82,8 @@ namespace onion
 		{
 			// Display the chunk
 			m_Chunk->display_tiles();
-			m_Chunk->display_objects(m_Camera->get_normal());
+			m_Chunk->display_opaque_objects(m_Camera->get_normal());
+			m_Chunk->display_translucent_objects(m_Camera->get_normal());
 		}
 
 		void BasicWorld::set_chunk(Chunk* chunk)
@@ -83,6 +95,303 @@ namespace onion
 
 			if (m_Chunk)
 				m_Chunk->load();
+			invalidate_display();
+		}
+
+	
+
+
+		StreamingWorld::StreamingWorld(const vec2i& cell_size, Int radius, Uint memory_budget) :
+			m_CellSize(cell_size), m_Radius(radius), m_MemoryBudget(memory_budget), m_MemoryUsage(0)
+		{
+			m_Camera = new StaticTopDownWorldCamera(m_Bounds);
+
+			// Load the cell containing the camera right away, and queue its neighbours
+			m_CenterCell = __get_cell(m_Camera->get_position());
+			if (Chunk* chunk = __create_cell(m_CenterCell))
+			{
+				chunk->load();
+				m_MemoryUsage += chunk->get_memory_usage();
+			}
+			__queue_cells();
+			__link_neighbours();
+
+			unfreeze(INT_MAX);
+		}
+
+		StreamingWorld::~StreamingWorld()
+		{
+			for (auto iter = m_Chunks.begin(); iter != m_Chunks.end(); ++iter)
+				delete iter->second;
+		}
+
+		vec2i StreamingWorld::__get_cell(const vec3i& pos) const
+		{
+			return vec2i(floor_div(pos.get(0), m_CellSize.get(0)), floor_div(pos.get(1), m_CellSize.get(1)));
+		}
+
+		Chunk* StreamingWorld::__get_chunk(const vec2i& cell) const
+		{
+			auto iter = m_Chunks.find(cell);
+			return (iter == m_Chunks.end() || !iter->second || !iter->second->is_loaded()) ? nullptr : iter->second;
+		}
+
+		Chunk* StreamingWorld::__create_cell(const vec2i& cell)
+		{
+			auto iter = m_Chunks.find(cell);
+			if (iter != m_Chunks.end())
+				return iter->second;
+
+			Chunk* chunk = __create_chunk(cell, vec2i(cell.get(0) * m_CellSize.get(0), cell.get(1) * m_CellSize.get(1)));
+			m_Chunks.emplace(cell, chunk);
+			return chunk;
+		}
+
+		void StreamingWorld::__queue_cells()
+		{
+			// Forget empty cells that are out of range, so that the map doesn't grow without bound
+			for (auto iter = m_Chunks.begin(); iter != m_Chunks.end();)
+			{
+				vec2i d = vec2i(iter->first) - m_CenterCell;
+				if (!iter->second && (abs(d.get(0)) > m_Radius || abs(d.get(1)) > m_Radius))
+					iter = m_Chunks.erase(iter);
+				else
+					++iter;
+			}
+
+			std::vector<vec2i> cells;
+			for (Int i = -m_Radius; i <= m_Radius; ++i)
+				for (Int j = -m_Radius; j <= m_Radius; ++j)
+					if (m_Chunks.count(m_CenterCell + vec2i(i, j)) < 1)
+						cells.push_back(m_CenterCell + vec2i(i, j));
+
+			// Queue the nearest cells first, so that workers get to them first
+			const vec2i& center = m_CenterCell;
+			std::sort(cells.begin(), cells.end(), [&center](const vec2i& lhs, const vec2i& rhs)
+			{
+				return vec2i(lhs - center).square_sum() < vec2i(rhs - center).square_sum();
+			});
+
+			for (auto iter = cells.begin(); iter != cells.end(); ++iter)
+				if (Chunk* chunk = __create_cell(*iter))
+					chunk->load_async();
+		}
+
+		bool StreamingWorld::__finish_next()
+		{
+			for (auto iter = m_Chunks.begin(); iter != m_Chunks.end(); ++iter)
+			{
+				Chunk* chunk = iter->second;
+				if (chunk && chunk->get_state() == CHUNK_UPLOADING)
+				{
+					chunk->finish_loading();
+					m_MemoryUsage += chunk->get_memory_usage();
+
+					chunk->reset_visible(m_Camera);
+					invalidate_display();
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		bool StreamingWorld::__can_evict(const vec2i& cell, Chunk* chunk) const
+		{
+			// Chunks within the radius are still wanted, and would never be queued again until the camera changed cells
+			vec2i offset = cell - m_CenterCell;
+			if (std::max<int>(std::abs(offset.get(0)), std::abs(offset.get(1))) <= m_Radius)
+				return false;
+
+			// Deleting the chunk deletes every actor in it, and reloading it creates the actors in its data file again.
+			// Keep chunks holding actors from elsewhere, such as actors created in code or followed by the camera, and chunks whose own actors have moved away.
+			const std::vector<Actor*>& actors = chunk->get_object_manager().get_actors();
+			for (auto actor = actors.begin(); actor != actors.end(); ++actor)
+				if ((*actor)->get_id().origin != chunk->get_origin())
+					return false;
+
+			for (auto iter = m_Chunks.begin(); iter != m_Chunks.end(); ++iter)
+			{
+				if (iter->second == chunk || !iter->second || !iter->second->is_loaded())
+					continue;
+
+				const std::vector<Actor*>& others = iter->second->get_object_manager().get_actors();
+				for (auto actor = others.begin(); actor != others.end(); ++actor)
+					if ((*actor)->get_id().origin == chunk->get_origin())
+						return false;
+			}
+
+			return true;
+		}
+
+		void StreamingWorld::__evict()
+		{
+			while (m_MemoryUsage > m_MemoryBudget)
+			{
+				// Find the evictable chunk farthest from the camera
+				auto farthest = m_Chunks.end();
+				Int farthest_dist = 0;
+				for (auto iter = m_Chunks.begin(); iter != m_Chunks.end(); ++iter)
+				{
+					if (iter->second && iter->second->is_loaded() && __can_evict(vec2i(iter->first), iter->second))
+					{
+						Int dist = vec2i(vec2i(iter->first) - m_CenterCell).square_sum();
+						if (dist > farthest_dist)
+						{
+							farthest = iter;
+							farthest_dist = dist;
+						}
+					}
+				}
+
+				if (farthest == m_Chunks.end())
+					break;
+
+				m_MemoryUsage -= farthest->second->get_memory_usage();
+				delete farthest->second;
+				m_Chunks.erase(farthest);
+				invalidate_display();
+			}
+		}
+
+		void StreamingWorld::__link_neighbours()
+		{
+			for (auto iter = m_Chunks.begin(); iter != m_Chunks.end(); ++iter)
+			{
+				if (!iter->second || !iter->second->is_loaded())
+					continue;
+
+				std::vector<ObjectManager*> neighbours;
+				for (Int i = -1; i <= 1; ++i)
+				{
+					for (Int j = -1; j <= 1; ++j)
+					{
+						Chunk* neighbour = (i == 0 && j == 0) ? nullptr : __get_chunk(vec2i(iter->first) + vec2i(i, j));
+						if (neighbour)
+							neighbours.push_back(&neighbour->get_object_manager());
+					}
+				}
+				iter->second->get_object_manager().set_neighbours(neighbours);
+			}
+		}
+
+		void StreamingWorld::__transfer_actors()
+		{
+			bool transferred = false;
+
+			for (auto iter = m_Chunks.begin(); iter != m_Chunks.end(); ++iter)
+			{
+				Chunk* chunk = iter->second;
+				if (!chunk || !chunk->is_loaded())
+					continue;
+
+				// Copy the list, since it changes as actors leave
+				std::vector<Actor*> actors = chunk->get_object_manager().get_actors();
+				for (auto actor = actors.begin(); actor != actors.end(); ++actor)
+				{
+					vec2i cell = __get_cell((*actor)->get_bounds()->get_position());
+					if (cell != vec2i(iter->first))
+					{
+						if (Chunk* target = __get_chunk(cell))
+						{
+							chunk->get_object_manager().remove(*actor);
+							target->add(*actor);
+							transferred = true;
+						}
+					}
+				}
+			}
+
+			// Make sure transferred actors are displayed by the chunks they moved into
+			if (transferred)
+				reset_camera();
+		}
+
+		void StreamingWorld::reset_camera()
+		{
+			for (auto iter = m_Chunks.begin(); iter != m_Chunks.end(); ++iter)
+				if (iter->second && iter->second->is_loaded())
+					iter->second->reset_visible(m_Camera);
+		}
+
+		void StreamingWorld::update(int frames_passed)
+		{
+			// Queue any cells that came into range since the camera last changed cells
+			vec2i center = __get_cell(m_Camera->get_position());
+			if (center != m_CenterCell)
+			{
+				m_CenterCell = center;
+				__queue_cells();
+			}
+
+			// Upload at most one parsed chunk per update, so that no single frame does more than one upload
+			if (__finish_next())
+			{
+				__evict();
+				__link_neighbours();
+			}
+
+			// Only simulate chunks within the simulation radius of the quality tier
+			Int radius = get_application_settings()->get_quality_tier().simulation_radius;
+			for (auto iter = m_Chunks.begin(); iter != m_Chunks.end(); ++iter)
+			{
+				if (iter->second && iter->second->is_loaded())
+				{
+					vec2i offset = vec2i(iter->first) - m_CenterCell;
+					if (radius < 0 || std::max<int>(std::abs(offset.get(0)), std::abs(offset.get(1))) <= radius)
+						iter->second->update_visible(m_Camera, frames_passed);
+				}
+			}
+
+			__transfer_actors();
+		}
+
+		void StreamingWorld::__display() const
+		{
+			// Display the ground of every chunk before any objects, since objects can overlap neighbouring chunks
+			for (auto iter = m_Chunks.begin(); iter != m_Chunks.end(); ++iter)
+				if (iter->second)
+					iter->second->display_tiles();
+
+			// Display the opaque objects of every chunk before any translucent objects, so that translucent objects blend over everything behind them
+			for (auto iter = m_Chunks.begin(); iter != m_Chunks.end(); ++iter)
+				if (iter->second && iter->second->is_loaded())
+					iter->second->display_opaque_objects(m_Camera->get_normal());
+
+			for (auto iter = m_Chunks.begin(); iter != m_Chunks.end(); ++iter)
+				if (iter->second && iter->second->is_loaded())
+					iter->second->display_translucent_objects(m_Camera->get_normal());
+		}
+
+		void StreamingWorld::add(Object* obj)
+		{
+			vec2i cell = __get_cell(obj->get_bounds()->get_position());
+
+			if (Chunk* chunk = __create_cell(cell))
+			{
+				if (!chunk->is_loaded())
+				{
+					// Finish loading the chunk containing the object right away
+					chunk->load();
+					m_MemoryUsage += chunk->get_memory_usage();
+
+					chunk->reset_visible(m_Camera);
+					__evict();
+					__link_neighbours();
+				}
+
+				chunk->add(obj);
+				invalidate_display();
+			}
+			else
+			{
+				errlog("ONION: Object added outside of any chunk in the streaming world.\n");
+			}
+		}
+
+		Uint StreamingWorld::get_memory_usage() const
+		{
+			return m_MemoryUsage;
 		}
 
 	}